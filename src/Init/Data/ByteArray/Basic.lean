@@ -77,6 +77,13 @@ protected opaque hash (a : @& ByteArray) : UInt64
 instance : Hashable ByteArray where
   hash := ByteArray.hash
 
+/--
+  A fast non-cryptographic hash of the array contents, intended for large buffers such as file contents.
+  Unlike `ByteArray.hash` (used by `Hashable ByteArray`), its values are not guaranteed to be stable
+  across Lean versions and should not be persisted beyond the current toolchain. -/
+@[extern "lean_byte_array_fast_hash"]
+opaque fastHash (a : @& ByteArray) : UInt64
+
 def isEmpty (s : ByteArray) : Bool :=
   s.size == 0
 
@@ -112,6 +119,27 @@ partial def toList (bs : ByteArray) : List UInt8 :=
       none
   loop start
 
+/--
+  Index of the first occurrence of `b` in `a` at or after position `start`, if any.
+  This is a primitive implemented using `memchr`. -/
+@[extern "lean_byte_array_index_of"]
+def indexOf? (a : @& ByteArray) (b : UInt8) (start : @& Nat := 0) : Option Nat :=
+  a.findIdx? (· == b) start
+
+/-- Byte-wise equality of two arrays. This is a primitive implemented using `memcmp`. -/
+@[extern "lean_byte_array_beq"]
+protected def beq (a b : @& ByteArray) : Bool :=
+  a.data == b.data
+
+instance : BEq ByteArray := ⟨ByteArray.beq⟩
+
+/--
+  Set the bytes at `[start, stop)` in `a` to `v`, where `stop` is clamped to `a.size`.
+  This is a primitive implemented using `memset`. -/
+@[extern "lean_byte_array_fill"]
+def fill (a : ByteArray) (v : UInt8) (start : @& Nat := 0) (stop : @& Nat := a.size) : ByteArray :=
+  ⟨a.data.mapIdx fun i b => if start ≤ i.val ∧ i.val < stop then v else b⟩
+
 /--
   We claim this unsafe implementation is correct because an array cannot have more than `usizeSz` elements in our runtime.
   This is similar to the `Array` version.
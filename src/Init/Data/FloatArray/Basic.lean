@@ -6,6 +6,7 @@ Author: Leonardo de Moura
 prelude
 import Init.Data.Array.Basic
 import Init.Data.Float
+import Init.Data.OfScientific
 import Init.Data.Option.Basic
 universe u
 
@@ -162,6 +163,35 @@ def foldlM {β : Type v} {m : Type v → Type w} [Monad m] (f : β → Float →
 def foldl {β : Type v} (f : β → Float → β) (init : β) (as : FloatArray) (start := 0) (stop := as.size) : β :=
   Id.run <| as.foldlM f init start stop
 
+/--
+  Sum of the elements of `a`. This is a vectorized primitive; the order in which the elements
+  are added is unspecified, so the result may differ from `a.foldl (· + ·) 0` by rounding. -/
+@[extern "lean_float_array_sum"]
+def sum (a : @& FloatArray) : Float :=
+  a.foldl (· + ·) 0
+
+/--
+  Dot product of the first `min a.size b.size` elements of `a` and `b`. This is a vectorized primitive;
+  as with `sum`, the summation order is unspecified. -/
+@[extern "lean_float_array_dot"]
+def dot (a b : @& FloatArray) : Float :=
+  (a.data.zipWith b.data (· * ·)).foldl (· + ·) 0
+
+/-- Element-wise sum of the first `min a.size b.size` elements of `a` and `b`. Reuses `a` if it is not shared. -/
+@[extern "lean_float_array_add"]
+def add (a : FloatArray) (b : @& FloatArray) : FloatArray :=
+  ⟨a.data.zipWith b.data (· + ·)⟩
+
+/-- Element-wise product of the first `min a.size b.size` elements of `a` and `b`. Reuses `a` if it is not shared. -/
+@[extern "lean_float_array_mul"]
+def mul (a : FloatArray) (b : @& FloatArray) : FloatArray :=
+  ⟨a.data.zipWith b.data (· * ·)⟩
+
+/-- Set all elements at `[start, stop)` in `a` to `v`, where `stop` is clamped to `a.size`. -/
+@[extern "lean_float_array_fill"]
+def fill (a : FloatArray) (v : Float) (start : @& Nat := 0) (stop : @& Nat := a.size) : FloatArray :=
+  ⟨a.data.mapIdx fun i d => if start ≤ i.val ∧ i.val < stop then v else d⟩
+
 end FloatArray
 
 def List.toFloatArray (ds : List Float) : FloatArray :=
@@ -162,6 +162,19 @@ instance : Ord USize where
 instance : Ord Char where
   compare x y := compareOfLessAndEq x y
 
+/--
+Lexicographic order on byte arrays, where a proper prefix comes first.
+This is a primitive implemented using `memcmp`.
+-/
+@[extern "lean_byte_array_compare"]
+protected def ByteArray.compare (a b : @& ByteArray) : Ordering :=
+  let rec loop : Nat → Nat → Ordering
+    | 0,      _ => compare a.size b.size
+    | fuel+1, i => (compare a[i]! b[i]!).then (loop fuel (i+1))
+  loop (min a.size b.size) 0
+
+instance : Ord ByteArray := ⟨ByteArray.compare⟩
+
 instance [Ord α] : Ord (Option α) where
   compare
   | none,   none   => .eq
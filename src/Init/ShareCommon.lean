@@ -81,6 +81,23 @@ instance : Inhabited (State σ) := ⟨.mk σ⟩
 @[extern "lean_state_sharecommon"]
 def State.shareCommon {σ : @& StateFactory} (s : State σ) (a : α) : α × State σ := (a, s)
 
+/--
+Returns a maximally shared version of `a`, i.e., structurally equal subobjects are represented by the same object.
+This is equivalent to `(State.mk σ).shareCommon a |>.1`, but it uses native hash tables instead of the
+`Map` and `Set` operations of a `StateFactory`, which makes it considerably faster when no state needs to be
+preserved between calls.
+-/
+@[extern "lean_sharecommon_quick"]
+def shareCommon' (a : @& α) : α := a
+
+/--
+Parallel version of `shareCommon'` for very large objects. Independent subobjects are processed by up to
+`numThreads` threads (`0` means one per hardware thread) that share a concurrent hash table. The result has the same
+shape as the one of `shareCommon'`, independently of `numThreads`.
+-/
+@[extern "lean_sharecommon_par"]
+def shareCommonPar (a : @& α) (numThreads : UInt32 := 0) : α := a
+
 end ShareCommon
 
 class MonadShareCommon (m : Type u → Type v) where
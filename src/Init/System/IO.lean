@@ -7,11 +7,14 @@ prelude
 import Init.Control.Reader
 import Init.Data.String
 import Init.Data.ByteArray
+import Init.Data.Float
+import Init.Data.OfScientific
 import Init.System.IOError
 import Init.System.FilePath
 import Init.System.ST
 import Init.Data.ToString.Macro
 import Init.Data.Ord
+import Init.Data.Range
 
 open System
 
@@ -177,10 +180,77 @@ def lazyPure (fn : Unit → α) : IO α :=
 /-- Monotonically increasing time since an unspecified past point in nanoseconds. No relation to wall clock time. -/
 @[extern "lean_io_mono_nanos_now"] opaque monoNanosNow : BaseIO Nat
 
+/--
+Performance counters of the current thread, see `getPerfCounters`.
+The hardware counters are only available on Linux, and only if `perf_event_open` is permitted; otherwise they are `0`
+and `hardware` is `false`.
+-/
+structure PerfCounters where
+  /-- CPU cycles spent in user space. -/
+  cycles       : UInt64 := 0
+  /-- Instructions retired in user space. -/
+  instructions : UInt64 := 0
+  /-- Last-level cache misses. -/
+  cacheMisses  : UInt64 := 0
+  /-- Mispredicted branches. -/
+  branchMisses : UInt64 := 0
+  /-- CPU time in nanoseconds. Always available. -/
+  taskClock    : UInt64 := 0
+  /-- Whether the hardware counters (at least `cycles` and `instructions`) are available. -/
+  hardware     : Bool := false
+  /--
+  Whether the kernel had to multiplex the hardware counters, i.e. some counter was not running all the time it was
+  enabled. Its count is then extrapolated from the time it was running and only an estimate; differences of such
+  estimates are clamped at `0`.
+  -/
+  multiplexed  : Bool := false
+  deriving Repr, Inhabited
+
+instance : Sub PerfCounters where
+  sub a b :=
+    -- the extrapolated counts of multiplexed counters are not monotone, so a later reading may be smaller
+    let sub (x y : UInt64) := if x ≥ y then x - y else 0
+    { cycles       := sub a.cycles b.cycles
+      instructions := sub a.instructions b.instructions
+      cacheMisses  := sub a.cacheMisses b.cacheMisses
+      branchMisses := sub a.branchMisses b.branchMisses
+      taskClock    := sub a.taskClock b.taskClock
+      hardware     := a.hardware && b.hardware
+      multiplexed  := a.multiplexed || b.multiplexed }
+
+/-- Instructions per cycle, or `0` if no cycles were recorded. -/
+def PerfCounters.ipc (c : PerfCounters) : Float :=
+  if c.cycles == 0 then 0 else c.instructions.toFloat / c.cycles.toFloat
+
+/--
+Read the current values of the performance counters of the calling thread, which count from the first call on that
+thread. Only differences between two readings are meaningful, see `withPerfCounters`.
+-/
+@[extern "lean_io_get_perf_counters"] opaque getPerfCounters : BaseIO PerfCounters
+
+/--
+Run `act` and return the performance counters it consumed. Only work done on the calling thread is counted,
+not that of tasks spawned by `act`.
+-/
+def withPerfCounters [Monad m] [MonadLiftT BaseIO m] (act : m α) : m (α × PerfCounters) := do
+  let start ← getPerfCounters
+  let a ← act
+  let stop ← getPerfCounters
+  return (a, stop - start)
+
 /-- Read bytes from a system entropy source. Not guaranteed to be cryptographically secure.
 If `nBytes = 0`, return immediately with an empty buffer. -/
 @[extern "lean_io_get_random_bytes"] opaque getRandomBytes (nBytes : USize) : IO ByteArray
 
+/--
+Return `nBytes` bytes from a per-thread ChaCha20 generator that is seeded from the system entropy source.
+This is much faster than `getRandomBytes` for many small requests, as it only enters the kernel for reseeding.
+-/
+@[extern "lean_io_get_random_bytes_fast"] opaque getRandomBytesFast (nBytes : USize) : BaseIO ByteArray
+
+/-- Return a random `UInt64` from the same generator as `getRandomBytesFast`. -/
+@[extern "lean_io_rand_uint64"] opaque randUInt64 : BaseIO UInt64
+
 def sleep (ms : UInt32) : BaseIO Unit :=
   -- TODO: add a proper primitive for IO.sleep
   fun s => dbgSleep ms fun _ => EStateM.Result.ok () s
@@ -228,6 +298,9 @@ local macro "nonempty_list" : tactic =>
 /-- Helper method for implementing "deterministic" timeouts. It is the number of "small" memory allocations performed by the current execution thread. -/
 @[extern "lean_io_get_num_heartbeats"] opaque getNumHeartbeats : BaseIO Nat
 
+/-- Resident set size of the current process in bytes, or `0` if it is not available on this platform. -/
+@[extern "lean_io_get_current_rss"] opaque getCurrentRSS : BaseIO Nat
+
 /--
 The mode of a file handle (i.e., a set of `open` flags and an `fdopen` mode).
 
@@ -292,6 +365,12 @@ inductive FS.Mode where
 
 opaque FS.Handle : Type := Unit
 
+/--
+  The contents of a file mapped read-only into memory (via `mmap` where available), see `IO.FS.MappedFile.mk`.
+  Pages are only loaded from disk when they are accessed, and the mapping is released when the object is freed.
+-/
+opaque FS.MappedFile : Type := Unit
+
 /--
   A pure-Lean abstraction of POSIX streams. We use `Stream`s for the standard streams stdin/stdout/stderr so we can
   capture output of `#eval` commands into memory. -/
@@ -379,6 +458,17 @@ Note that EOF does not actually close a handle, so further reads may block and r
 -/
 @[extern "lean_io_prim_handle_read"] opaque read (h : @& Handle) (bytes : USize) : IO ByteArray
 @[extern "lean_io_prim_handle_write"] opaque write (h : @& Handle) (buffer : @& ByteArray) : IO Unit
+/--
+Write all given buffers to the handle, in order.
+Large batches are written using a single vectored system call instead of going through the handle's buffer.
+-/
+@[extern "lean_io_prim_handle_write_many"] opaque writeMany (h : @& Handle) (buffers : @& Array ByteArray) : IO Unit
+/--
+Set the size of the buffer used for reading from and writing to the handle.
+A size of `0` makes the handle unbuffered. This must be the first operation on the handle and can only be called
+once; otherwise, an error is thrown. In particular, it fails for the standard streams.
+-/
+@[extern "lean_io_prim_handle_set_buffer_size"] opaque setBufferSize (h : @& Handle) (size : USize) : IO Unit
 
 /--
 Read text up to (including) the next line break from the handle.
@@ -386,10 +476,65 @@ If the returned string is empty, an end-of-file marker has been reached.
 Note that EOF does not actually close a handle, so further reads may block and return more data.
 -/
 @[extern "lean_io_prim_handle_get_line"] opaque getLine (h : @& Handle) : IO String
+/--
+Read up to `maxLines` lines from the handle, without their line terminators
+(`\n`, and on Windows also a preceding `\r`).
+Fewer lines are only returned when an end-of-file marker has been reached, so an empty array
+means that there is nothing left to read. This is faster than repeatedly calling `getLine`.
+-/
+@[extern "lean_io_prim_handle_read_lines"] opaque readLines (h : @& Handle) (maxLines : USize := 1024) : IO (Array String)
 @[extern "lean_io_prim_handle_put_str"] opaque putStr (h : @& Handle) (s : @& String) : IO Unit
+/-- Write all given strings to the handle, in order. See also `writeMany`. -/
+@[extern "lean_io_prim_handle_put_str_many"] opaque putStrMany (h : @& Handle) (ss : @& Array String) : IO Unit
 
 end Handle
 
+/-- Expected access pattern of (parts of) a `MappedFile`, see `MappedFile.advise`. -/
+inductive MappedFile.Advice where
+  /-- No special treatment. -/
+  | normal
+  /-- Pages will be accessed in order, so they may be read ahead aggressively and freed soon after use. -/
+  | sequential
+  /-- Pages will be accessed in random order, so read-ahead is not useful. -/
+  | random
+  /-- Pages will be accessed soon and should be loaded in the background. -/
+  | willNeed
+  /-- Pages will not be accessed soon and their memory may be reclaimed. -/
+  | dontNeed
+
+namespace MappedFile
+
+/--
+Maps the contents of the regular file `fn` read-only into memory without copying them.
+The file must not be truncated or modified while it is mapped; in particular, on truncation,
+accessing the missing pages may terminate the process.
+On platforms without `mmap`, the file is read into memory instead.
+-/
+@[extern "lean_io_mapped_file_mk"] opaque mk (fn : @& FilePath) : IO MappedFile
+
+/-- The size of the mapped file in bytes. -/
+@[extern "lean_mapped_file_size"] opaque size (m : @& MappedFile) : Nat
+@[extern "lean_mapped_file_uget"] opaque uget (m : @& MappedFile) (i : USize) (h : i.toNat < m.size) : UInt8
+/-- The byte at position `i`, or `0` if `i` is out of bounds. -/
+@[extern "lean_mapped_file_get"] opaque get! (m : @& MappedFile) (i : @& Nat) : UInt8
+/-- Copies the bytes at `[start, stop)` into a new `ByteArray`, where `stop` is clamped to `m.size`. -/
+@[extern "lean_mapped_file_extract"] opaque extract (m : @& MappedFile) (start stop : @& Nat) : ByteArray
+/-- Index of the first occurrence of `b` at or after position `start`, if any. -/
+@[extern "lean_mapped_file_index_of"] opaque indexOf? (m : @& MappedFile) (b : UInt8) (start : @& Nat := 0) : Option Nat
+
+/--
+Advises the operating system about the expected access pattern of the bytes at `[start, stop)` (using `madvise`).
+This is only a hint and a no-op on platforms without `mmap`.
+-/
+@[extern "lean_io_mapped_file_advise"]
+opaque advise (m : @& MappedFile) (advice : Advice) (start : @& Nat := 0) (stop : @& Nat := m.size) : IO Unit
+
+/-- Copies the entire contents into a `ByteArray`. -/
+def toByteArray (m : MappedFile) : ByteArray :=
+  m.extract 0 m.size
+
+end MappedFile
+
 @[extern "lean_io_realpath"] opaque realPath (fname : FilePath) : IO FilePath
 @[extern "lean_io_remove_file"] opaque removeFile (fname : @& FilePath) : IO Unit
 /-- Remove given directory. Fails if not empty; see also `IO.FS.removeDirAll`. -/
@@ -437,9 +582,13 @@ partial def Handle.readToEnd (h : Handle) : IO String := do
       loop (s ++ line)
   loop ""
 
-def readBinFile (fname : FilePath) : IO ByteArray := do
-  let h ← Handle.mk fname Mode.read
-  h.readBinToEnd
+/--
+Read the entire contents of the file `fname`.
+For regular files, the result is allocated with the right size up front and filled with as few system calls as
+possible.
+-/
+@[extern "lean_io_read_bin_file"]
+opaque readBinFile (fname : @& FilePath) : IO ByteArray
 
 def readFile (fname : FilePath) : IO String := do
   let h ← Handle.mk fname Mode.read
@@ -448,15 +597,11 @@ def readFile (fname : FilePath) : IO String := do
 partial def lines (fname : FilePath) : IO (Array String) := do
   let h ← Handle.mk fname Mode.read
   let rec read (lines : Array String) := do
-    let line ← h.getLine
-    if line.length == 0 then
+    let batch ← h.readLines
+    if batch.isEmpty then
       pure lines
-    else if line.back == '\n' then
-      let line := line.dropRight 1
-      let line := if System.Platform.isWindows && line.back == '\x0d' then line.dropRight 1 else line
-      read <| lines.push line
     else
-      pure <| lines.push line
+      read (lines ++ batch)
   read #[]
 
 def writeBinFile (fname : FilePath) (content : ByteArray) : IO Unit := do
@@ -467,6 +612,47 @@ def writeFile (fname : FilePath) (content : String) : IO Unit := do
   let h ← Handle.mk fname Mode.write
   h.putStr content
 
+/--
+Copy the contents of the file `src` to `dst`, replacing `dst` if it exists already.
+The data is copied within the kernel where supported (`copy_file_range`/`sendfile` on Linux, `fcopyfile` on macOS),
+and the blocks are shared between both files on file systems supporting it (reflinks).
+On POSIX systems, the permission bits of `src` are copied as well when `dst` is created.
+-/
+@[extern "lean_io_copy_file"]
+opaque copyFile (src dst : @& FilePath) : IO Unit
+
+/--
+Hash the contents of the file `fname`, reading it in large chunks without materializing it in memory.
+The result agrees with `hash (← readBinFile fname)`.
+-/
+@[extern "lean_io_hash_file"]
+opaque hashFile (fname : @& FilePath) : IO UInt64
+
+/--
+Hash the contents of the file `fname` using the considerably faster `ByteArray.fastHash`, with which the result
+agrees. Regular files are mapped into memory for this instead of being read.
+-/
+@[extern "lean_io_fast_hash_file"]
+opaque fastHashFile (fname : @& FilePath) : IO UInt64
+
+/-- Compute the SHA-256 digest (32 bytes) of the contents of the file `fname`, reading it in large chunks. -/
+@[extern "lean_io_sha256_file"]
+opaque sha256File (fname : @& FilePath) : IO ByteArray
+
+/--
+Hash many files in parallel on the task pool using `hashFn` (e.g. `hashFile`), returning the hashes in the same order.
+The files are split into batches so that small files do not each pay for the creation of a task.
+-/
+def hashFiles (fnames : Array FilePath) (hashFn : FilePath → IO α) (batchSize := 16) : IO (Array α) := do
+  let batchSize := max batchSize 1
+  let mut tasks := #[]
+  for i in [0:fnames.size:batchSize] do
+    tasks := tasks.push <| ← IO.asTask ((fnames.extract i (i + batchSize)).mapM hashFn)
+  let mut r := Array.mkEmpty fnames.size
+  for t in tasks do
+    r := r ++ (← IO.ofExcept t.get)
+  return r
+
 def Stream.putStrLn (strm : FS.Stream) (s : String) : IO Unit :=
   strm.putStr (s.push '\n')
 
@@ -545,6 +731,48 @@ where
       | .error (.noFileOrDirectory ..) => pure ()
       | .error e => throw e
 
+/--
+Return all entries below the directory `p` together with their type, in preorder, using a single native traversal.
+This is much faster than `walkDir` as types are taken from the directory listing where possible.
+* `recursive`: whether to descend into subdirectories.
+* `followSymlinks`: whether to also descend into symbolic links to directories. Symbolic links are always reported
+  with type `.symlink`, and cycles are skipped.
+* `extensions`: if non-empty, only non-directory entries with one of these extensions are reported.
+  All directories are still traversed.
+-/
+@[extern "lean_io_scan_dir"]
+opaque scanDir (p : @& FilePath) (recursive := true) (followSymlinks := false) (extensions : @& Array String := #[]) :
+    IO (Array (FilePath × IO.FS.FileType))
+
+/--
+Like `scanDir`, but returns the metadata of each entry. Unlike `metadata`, symbolic links are not resolved for this.
+-/
+@[extern "lean_io_scan_dir_metadata"]
+opaque scanDirMetadata (p : @& FilePath) (recursive := true) (followSymlinks := false) (extensions : @& Array String := #[]) :
+    IO (Array (FilePath × IO.FS.Metadata))
+
+/--
+Like `scanDirMetadata`, but scans each subdirectory of `p` in a separate task.
+Symbolic links to directories are not followed.
+-/
+def scanDirMetadataPar (p : FilePath) (extensions : Array String := #[]) : IO (Array (FilePath × IO.FS.Metadata)) := do
+  let top ← p.scanDirMetadata (recursive := false)
+  let tasks ← top.mapM fun (q, m) =>
+    if m.type == .dir then
+      IO.asTask (q.scanDirMetadata (extensions := extensions))
+    else
+      pure (Task.pure (.ok #[]))
+  let mut r := #[]
+  for ((q, m), t) in top.zip tasks do
+    let report := if m.type == .dir then extensions.isEmpty else
+      match q.extension with
+      | some ext => extensions.isEmpty || extensions.contains ext
+      | none     => extensions.isEmpty
+    if report then
+      r := r.push (q, m)
+    r := r ++ (← IO.ofExcept t.get)
+  return r
+
 end System.FilePath
 
 namespace IO
@@ -663,6 +891,22 @@ structure Child (cfg : StdioConfig) where
 
 @[extern "lean_io_process_child_wait"] opaque Child.wait {cfg : @& StdioConfig} : @& Child cfg → IO UInt32
 
+/--
+Returns the exit code of the child process if it has already terminated, and `none` otherwise.
+Like `Child.wait`, a successful result releases the process, so it must not be waited for again.
+-/
+@[extern "lean_io_process_child_try_wait"] opaque Child.tryWait {cfg : @& StdioConfig} : @& Child cfg → IO (Option UInt32)
+
+/--
+Waits for any of the given child processes to terminate, and returns its index in `children` together with its
+exit code. Only that process is released; the others can be waited for again.
+This makes it possible to supervise many concurrent processes from a single thread.
+Throws an error if `children` is empty.
+On Linux, a pidfd is kept open for each of `children` until the process is released by `Child.wait`,
+`Child.tryWait`, or `waitAny`, so that repeated calls do not reopen them.
+-/
+@[extern "lean_io_process_wait_any"] opaque waitAny {cfg : @& StdioConfig} (children : @& Array (Child cfg)) : IO (Nat × UInt32)
+
 /-- Terminates the child process using the SIGTERM signal or a platform analogue.
     If the process was started using `SpawnArgs.setsid`, terminates the entire process group instead. -/
 @[extern "lean_io_process_child_kill"] opaque Child.kill {cfg : @& StdioConfig} : @& Child cfg → IO Unit
@@ -35,7 +35,7 @@ abbrev ConstMap := SMap Name ConstantInfo
 structure Import where
   module      : Name
   runtimeOnly : Bool := false
-  deriving Repr, Inhabited
+  deriving Repr, Inhabited, BEq
 
 instance : Coe Name Import := ⟨({module := ·})⟩
 
@@ -50,6 +50,10 @@ def CompactedRegion := USize
 @[extern "lean_compacted_region_is_memory_mapped"]
 opaque CompactedRegion.isMemoryMapped : CompactedRegion → Bool
 
+/-- Size of the objects of a compacted region in bytes. -/
+@[extern "lean_compacted_region_size"]
+opaque CompactedRegion.size : CompactedRegion → USize
+
 /-- Free a compacted region and its contents. No live references to the contents may exist at the time of invocation. -/
 @[extern "lean_compacted_region_free"]
 unsafe opaque CompactedRegion.free : CompactedRegion → IO Unit
@@ -636,28 +640,16 @@ end MapDeclarationExtension
 opaque saveModuleData (fname : @& System.FilePath) (mod : @& Name) (data : @& ModuleData) : IO Unit
 @[extern "lean_read_module_data"]
 opaque readModuleData (fname : @& System.FilePath) : IO (ModuleData × CompactedRegion)
+/-- Like `readModuleData`, but opens, maps and relocates all given files in parallel. -/
+@[extern "lean_read_module_data_batch"]
+opaque readModuleDataBatch (fnames : @& Array System.FilePath) : IO (Array (ModuleData × CompactedRegion))
 
-/--
-  Free compacted regions of imports. No live references to imported objects may exist at the time of invocation; in
-  particular, `env` should be the last reference to any `Environment` derived from these imports. -/
-@[noinline, export lean_environment_free_regions]
-unsafe def Environment.freeRegions (env : Environment) : IO Unit :=
-  /-
-    NOTE: This assumes `env` is not inferred as a borrowed parameter, and is freed after extracting the `header` field.
-    Otherwise, we would encounter undefined behavior when the constant map in `env`, which may reference objects in
-    compacted regions, is freed after the regions.
-
-    In the currently produced IR, we indeed see:
-    ```
-      def Lean.Environment.freeRegions (x_1 : obj) (x_2 : obj) : obj :=
-        let x_3 : obj := proj[3] x_1;
-        inc x_3;
-        dec x_1;
-        ...
-    ```
-
-    TODO: statically check for this. -/
-  env.header.regions.forM CompactedRegion.free
+/-- Compress `data` into a single LZ4 block, the codec of compressed .olean files (`LEAN_OLEAN_COMPRESS`). -/
+@[extern "lean_lz4_compress_block"]
+opaque Internal.lz4CompressBlock (data : @& ByteArray) : ByteArray
+/-- Decompress an LZ4 block of `size` uncompressed bytes, or return `none` if the block is malformed. -/
+@[extern "lean_lz4_decompress_block"]
+opaque Internal.lz4DecompressBlock (block : @& ByteArray) (size : USize) : Option ByteArray
 
 def mkModuleData (env : Environment) : IO ModuleData := do
   let pExts ← persistentEnvExtensionsRef.get
@@ -748,6 +740,8 @@ structure ImportState where
   moduleNames   : Array Name := #[]
   moduleData    : Array ModuleData := #[]
   regions       : Array CompactedRegion := #[]
+  /-- Modules that have been read ahead by `importModulesCore` but not been imported yet. -/
+  prefetched    : HashMap Name (ModuleData × CompactedRegion) := {}
 
 def throwAlreadyImported (s : ImportState) (const2ModIdx : HashMap Name ModuleIdx) (modIdx : Nat) (cname : Name) : IO α := do
   let modName := s.moduleNames[modIdx]!
@@ -759,15 +753,151 @@ abbrev ImportStateM := StateRefT ImportState IO
 @[inline] nonrec def ImportStateM.run (x : ImportStateM α) (s : ImportState := {}) : IO (α × ImportState) :=
   x.run s
 
+/-- An environment cached by `importModules` while the import cache is enabled, see `ImportCache`. -/
+structure ImportCacheEntry where
+  imports     : Array Import
+  trustLevel  : UInt32
+  /-- Modification times of the .olean files of `env.header.moduleNames` when they were imported. -/
+  oleanMTimes : Array IO.FS.SystemTime
+  env         : Environment
+  /--
+  Growth of the resident set size while importing `env`, excluding the compacted regions read for it, which are
+  accounted for in `ImportCache.regionBytes`. This is used as the cost of the entry. -/
+  bytes       : Nat
+
+/--
+State of the import cache used by `lean --daemon`, which compiles many files in one process. While it is enabled,
+`importModules` reuses environments imported earlier for the same imports and trust level, and .olean files that
+were read before and have not been modified since.
+
+Evicting an entry only drops its environment. The compacted regions read while the cache is enabled are never freed,
+not even those of .olean files that have since been modified, as objects created by the initializers of imported
+modules may still point into them. They count towards `maxBytes`, which therefore is not a hard limit: once they
+exceed it, only the most recently used environment is kept.
+-/
+structure ImportCache where
+  /-- Maximum number of cached environments; the cache is disabled if this is `0`. -/
+  maxEntries  : Nat := 0
+  /-- Maximum of `regionBytes` plus the total `ImportCacheEntry.bytes` of the cached environments, or `0` for no
+  limit. -/
+  maxBytes    : Nat := 0
+  /-- Cached environments, least recently used first. -/
+  entries     : Array ImportCacheEntry := #[]
+  /-- The latest version of each .olean file read while the cache was enabled, with its modification time. -/
+  modules     : HashMap System.FilePath (IO.FS.SystemTime × ModuleData × CompactedRegion) := {}
+  /-- All compacted regions read while the cache was enabled, which are never freed. -/
+  regions     : HashSet USize := {}
+  /-- Total size of `regions`. -/
+  regionBytes : Nat := 0
+
+instance : Inhabited ImportCache := ⟨{}⟩
+
+namespace ImportCache
+
+def enabled (cache : ImportCache) : Bool :=
+  cache.maxEntries > 0
+
+/-- Evict least recently used entries until the limits of `cache` are satisfied. The most recent entry is kept. -/
+partial def trim (cache : ImportCache) : ImportCache :=
+  let bytes := cache.entries.foldl (· + ·.bytes) cache.regionBytes
+  if cache.entries.size > 1 &&
+      (cache.entries.size > cache.maxEntries || (cache.maxBytes > 0 && bytes > cache.maxBytes)) then
+    trim { cache with entries := cache.entries.eraseIdx 0 }
+  else
+    cache
+
+/-- Record the regions of `regions` not held by `cache` yet, and return their total size. -/
+def addRegions (cache : ImportCache) (regions : Array CompactedRegion) : ImportCache × Nat :=
+  regions.foldl (init := (cache, 0)) fun (cache, bytes) (r : USize) =>
+    if cache.regions.contains r then
+      (cache, bytes)
+    else
+      let sz := (CompactedRegion.size r).toNat
+      ({ cache with regions := cache.regions.insert r, regionBytes := cache.regionBytes + sz }, bytes + sz)
+
+end ImportCache
+
+builtin_initialize importCacheRef : IO.Ref ImportCache ← IO.mkRef {}
+
+/--
+Enable the import cache, keeping at most `maxEntries` environments with a total cost of at most `maxMegabytes`
+(`0` for no limit), or disable and clear it if `maxEntries` is `0`. The regions read so far stay recorded, as they
+may still be shared by environments imported while the cache was enabled.
+-/
+@[export lean_set_import_cache_limits]
+def setImportCacheLimits (maxEntries : Nat) (maxMegabytes : Nat) : IO Unit := do
+  if maxEntries == 0 then
+    importCacheRef.modify fun cache => { regions := cache.regions, regionBytes := cache.regionBytes }
+  else
+    importCacheRef.modify fun cache => { cache with maxEntries, maxBytes := maxMegabytes * 1024 * 1024 }.trim
+
+/--
+  Free compacted regions of imports. No live references to imported objects may exist at the time of invocation; in
+  particular, `env` should be the last reference to any `Environment` derived from these imports. -/
+@[noinline, export lean_environment_free_regions]
+unsafe def Environment.freeRegions (env : Environment) : IO Unit :=
+  /-
+    NOTE: This assumes `env` is not inferred as a borrowed parameter, and is freed after extracting the `header` field.
+    Otherwise, we would encounter undefined behavior when the constant map in `env`, which may reference objects in
+    compacted regions, is freed after the regions.
+
+    In the currently produced IR, we indeed see:
+    ```
+      def Lean.Environment.freeRegions (x_1 : obj) (x_2 : obj) : obj :=
+        let x_3 : obj := proj[3] x_1;
+        inc x_3;
+        dec x_1;
+        ...
+    ```
+
+    TODO: statically check for this. -/
+  -- regions read while the import cache was enabled may be shared with other environments, see `ImportCache`
+  env.header.regions.forM fun r => do
+    unless (← importCacheRef.get).regions.contains r do
+      CompactedRegion.free r
+
 partial def importModulesCore (imports : Array Import) : ImportStateM Unit := do
+  -- read all new direct imports in parallel, then import them in order
+  let cache ← importCacheRef.get
+  let mut pending : Array (Name × System.FilePath × IO.FS.SystemTime) := #[]
   for i in imports do
-    if i.runtimeOnly || (← get).moduleNameSet.contains i.module then
+    let s ← get
+    if i.runtimeOnly || s.moduleNameSet.contains i.module || s.prefetched.contains i.module ||
+        pending.any (·.1 == i.module) then
       continue
-    modify fun s => { s with moduleNameSet := s.moduleNameSet.insert i.module }
     let mFile ← findOLean i.module
     unless (← mFile.pathExists) do
       throw <| IO.userError s!"object file '{mFile}' of module {i.module} does not exist"
-    let (mod, region) ← readModuleData mFile
+    if cache.enabled then
+      let mtime := (← mFile.metadata).modified
+      if let some (mtime', d) := cache.modules.find? mFile then
+        if mtime == mtime' then
+          modify fun s => { s with prefetched := s.prefetched.insert i.module d }
+          continue
+        -- the file has been modified; its old region stays alive as it is still accounted in `regions`
+        importCacheRef.modify fun cache => { cache with modules := cache.modules.erase mFile }
+      pending := pending.push (i.module, mFile, mtime)
+    else
+      pending := pending.push (i.module, mFile, default)
+  if !pending.isEmpty then
+    let mods ← readModuleDataBatch (pending.map (·.2.1))
+    modify fun s => { s with
+      prefetched := (pending.zip mods).foldl (fun m ((n, _), d) => m.insert n d) s.prefetched
+    }
+    if cache.enabled then
+      let mut cache ← importCacheRef.get
+      for ((_, f, t), d) in pending.zip mods do
+        cache := { cache with modules := cache.modules.insert f (t, d) }
+      importCacheRef.set (cache.addRegions (mods.map (·.2))).1
+  for i in imports do
+    if i.runtimeOnly || (← get).moduleNameSet.contains i.module then
+      continue
+    modify fun s => { s with moduleNameSet := s.moduleNameSet.insert i.module }
+    let (mod, region) ← match (← get).prefetched.find? i.module with
+      | some d =>
+        modify fun s => { s with prefetched := s.prefetched.erase i.module }
+        pure d
+      | none => readModuleData (← findOLean i.module)
     importModulesCore mod.imports
     modify fun s => { s with
       moduleData  := s.moduleData.push mod
@@ -802,17 +932,8 @@ private def equivInfo (cinfo₁ cinfo₂ : ConstantInfo) : Bool := Id.run do
     && tval₁.levelParams == tval₂.levelParams
     && tval₁.all == tval₂.all
 
-/--
-  Construct environment from `importModulesCore` results.
-
-  If `leakEnv` is true, we mark the environment as persistent, which means it
-  will not be freed. We set this when the object would survive until the end of
-  the process anyway. In exchange, RC updates are avoided, which is especially
-  important when they would be atomic because the environment is shared across
-  threads (potentially, storing it in an `IO.Ref` is sufficient for marking it
-  as such). -/
-def finalizeImport (s : ImportState) (imports : Array Import) (opts : Options) (trustLevel : UInt32 := 0)
-    (leakEnv := false) : IO Environment := do
+/-- Build the mappings from constant names to module indices and constants of the modules imported into `s`. -/
+def mkImportedConstantMaps (s : ImportState) : IO (HashMap Name ModuleIdx × HashMap Name ConstantInfo) := do
   let numConsts := s.moduleData.foldl (init := 0) fun numConsts mod =>
     numConsts + mod.constants.size + mod.extraConstNames.size
   let mut const2ModIdx : HashMap Name ModuleIdx := mkHashMap (capacity := numConsts)
@@ -830,6 +951,20 @@ def finalizeImport (s : ImportState) (imports : Array Import) (opts : Options) (
       const2ModIdx := const2ModIdx.insert cname modIdx
     for cname in mod.extraConstNames do
       const2ModIdx := const2ModIdx.insert cname modIdx
+  return (const2ModIdx, constantMap)
+
+/--
+  Construct environment from `importModulesCore` results and the constant maps built from them by
+  `mkImportedConstantMaps`, which may also have been read from an import snapshot.
+
+  If `leakEnv` is true, we mark the environment as persistent, which means it
+  will not be freed. We set this when the object would survive until the end of
+  the process anyway. In exchange, RC updates are avoided, which is especially
+  important when they would be atomic because the environment is shared across
+  threads (potentially, storing it in an `IO.Ref` is sufficient for marking it
+  as such). -/
+def finalizeImportCore (s : ImportState) (const2ModIdx : HashMap Name ModuleIdx) (constantMap : HashMap Name ConstantInfo)
+    (imports : Array Import) (opts : Options) (trustLevel : UInt32 := 0) (leakEnv := false) : IO Environment := do
   let constants : ConstMap := SMap.fromHashMap constantMap false
   let exts ← mkInitialExtensionStates
   let mut env : Environment := {
@@ -866,15 +1001,143 @@ def finalizeImport (s : ImportState) (imports : Array Import) (opts : Options) (
     env := Runtime.markPersistent env
   pure env
 
+/-- Construct environment from `importModulesCore` results, see `finalizeImportCore`. -/
+def finalizeImport (s : ImportState) (imports : Array Import) (opts : Options) (trustLevel : UInt32 := 0)
+    (leakEnv := false) : IO Environment := do
+  let (const2ModIdx, constantMap) ← mkImportedConstantMaps s
+  finalizeImportCore s const2ModIdx constantMap imports opts trustLevel leakEnv
+
+/--
+The result of importing a set of modules, except for the environment extension states: the data of all imported modules
+and the constant maps built from them. `importModules` saves it as a single compacted file per import set if the
+environment variable `LEAN_IMPORT_SNAPSHOT_DIR` is set, and later maps that file instead of reading every .olean file
+and rebuilding the maps. Extension states are not included as they may contain closures, which cannot be compacted;
+they are still initialized from `moduleData`.
+-/
+structure ImportSnapshot where
+  /-- Direct imports the snapshot was created for. -/
+  imports      : Array Import
+  /-- Modification times of the .olean files of `moduleNames`. The snapshot is stale if any of them has changed. -/
+  oleanMTimes  : Array IO.FS.SystemTime
+  moduleNames  : Array Name
+  moduleData   : Array ModuleData
+  const2ModIdx : HashMap Name ModuleIdx
+  constantMap  : HashMap Name ConstantInfo
+
+@[extern "lean_save_import_snapshot"]
+opaque saveImportSnapshot (fname : @& System.FilePath) (snap : @& ImportSnapshot) : IO Unit
+@[extern "lean_read_import_snapshot"]
+opaque readImportSnapshot (fname : @& System.FilePath) : IO (ImportSnapshot × CompactedRegion)
+
+/-- Path of the import snapshot of `imports` in `dir`. It also depends on the Lean version. -/
+def importSnapshotPath (dir : System.FilePath) (imports : Array Import) : System.FilePath :=
+  let h := hash s!"{Lean.githash} {imports}"
+  dir / s!"{String.mk (Nat.toDigits 16 h.toNat)}.osnap"
+
+private def getOLeanMTimes (moduleNames : Array Name) : IO (Array IO.FS.SystemTime) :=
+  moduleNames.mapM fun mod => return (← (← findOLean mod).metadata).modified
+
+private unsafe def freeStaleSnapshotImpl (region : CompactedRegion) : IO Unit :=
+  region.free
+
+/-- Free the region of a snapshot that turned out to be stale; none of its objects may be used afterwards. -/
+@[implemented_by freeStaleSnapshotImpl]
+private opaque freeStaleSnapshot (region : CompactedRegion) : IO Unit
+
+/-- Read the import snapshot of `imports` from `dir`, unless it is missing, stale, or unreadable. -/
+def readImportSnapshot? (dir : System.FilePath) (imports : Array Import) :
+    IO (Option (ImportSnapshot × CompactedRegion)) := do
+  let fname := importSnapshotPath dir imports
+  unless (← fname.pathExists) do
+    return none
+  let (snap, region) ← match (← (readImportSnapshot fname).toBaseIO) with
+    | .ok r    => pure r
+    | .error _ => return none
+  let valid ← match (← (getOLeanMTimes snap.moduleNames).toBaseIO) with
+    | .ok mtimes => pure (snap.imports == imports && mtimes == snap.oleanMTimes)
+    | .error _   => pure false
+  if valid then
+    return some (snap, region)
+  freeStaleSnapshot region
+  return none
+
+/--
+Save the import snapshot of `imports` into `dir`. It is written to a temporary file unique to this call first and then
+renamed into place, so concurrent processes saving the same snapshot do not interfere, and readers either see the
+complete old or new snapshot.
+-/
+def writeImportSnapshot (dir : System.FilePath) (imports : Array Import) (s : ImportState)
+    (const2ModIdx : HashMap Name ModuleIdx) (constantMap : HashMap Name ConstantInfo) : IO Unit := do
+  IO.FS.createDirAll dir
+  saveImportSnapshot (importSnapshotPath dir imports) {
+    imports, const2ModIdx, constantMap
+    oleanMTimes := (← getOLeanMTimes s.moduleNames)
+    moduleNames := s.moduleNames
+    moduleData  := s.moduleData
+  }
+
+private def importModulesUncached (imports : Array Import) (opts : Options) (trustLevel : UInt32)
+    (leakEnv : Bool) : IO Environment :=
+  withImporting do
+    let snapshotDir? := (← IO.getEnv "LEAN_IMPORT_SNAPSHOT_DIR").filter (!·.isEmpty) |>.map System.FilePath.mk
+    if let some dir := snapshotDir? then
+      if let some (snap, region) ← readImportSnapshot? dir imports then
+        let s : ImportState := {
+          moduleNames := snap.moduleNames
+          moduleData  := snap.moduleData
+          regions     := #[region]
+        }
+        return (← finalizeImportCore (leakEnv := leakEnv) s snap.const2ModIdx snap.constantMap imports opts trustLevel)
+    let (_, s) ← importModulesCore imports |>.run
+    let (const2ModIdx, constantMap) ← mkImportedConstantMaps s
+    if let some dir := snapshotDir? then
+      -- a missing snapshot only makes later imports slower
+      try writeImportSnapshot dir imports s const2ModIdx constantMap catch _ => pure ()
+    finalizeImportCore (leakEnv := leakEnv) s const2ModIdx constantMap imports opts trustLevel
+
+/-- Like `importModulesUncached`, but using the import cache, see `ImportCache`. -/
+private def importModulesCached (imports : Array Import) (opts : Options) (trustLevel : UInt32) : IO Environment := do
+  let cache ← importCacheRef.get
+  if let some idx := cache.entries.findIdx? fun e => e.imports == imports && e.trustLevel == trustLevel then
+    let some e := cache.entries[idx]? | unreachable!
+    let cache := { cache with entries := cache.entries.eraseIdx idx }
+    let valid ← match (← (getOLeanMTimes e.env.header.moduleNames).toBaseIO) with
+      | .ok mtimes => pure (mtimes == e.oleanMTimes)
+      | .error _   => pure false
+    if valid then
+      importCacheRef.set { cache with entries := cache.entries.push e }
+      -- extensions may have been registered by modules imported since `e.env` was created
+      return (← ensureExtensionsArraySize e.env)
+    importCacheRef.set cache
+  let rss ← IO.getCurrentRSS
+  let regionBytes := (← importCacheRef.get).regionBytes
+  -- the environment must not be marked persistent, so that evicting it frees its heap objects
+  let env ← importModulesUncached imports opts trustLevel (leakEnv := false)
+  let rssGrowth := (← IO.getCurrentRSS) - rss
+  let oleanMTimes ← getOLeanMTimes env.header.moduleNames
+  importCacheRef.modify fun cache =>
+    -- regions not read by `importModulesCore`, e.g. that of an import snapshot
+    let (cache, _) := cache.addRegions env.header.regions
+    let bytes := rssGrowth - (cache.regionBytes - regionBytes)
+    { cache with entries := cache.entries.push { imports, trustLevel, oleanMTimes, env, bytes } }.trim
+  return env
+
+/--
+Import the given modules and construct their environment.
+
+If `leakEnv` is true, the environment is marked persistent, see `finalizeImportCore`. It is ignored while the import
+cache used by `lean --daemon` is enabled, see `ImportCache`.
+-/
 @[export lean_import_modules]
 def importModules (imports : Array Import) (opts : Options) (trustLevel : UInt32 := 0)
     (leakEnv := false) : IO Environment := profileitIO "import" opts do
   for imp in imports do
     if imp.module matches .anonymous then
       throw <| IO.userError "import failed, trying to import module with anonymous name"
-  withImporting do
-    let (_, s) ← importModulesCore imports |>.run
-    finalizeImport (leakEnv := leakEnv) s imports opts trustLevel
+  if (← importCacheRef.get).enabled then
+    importModulesCached imports opts trustLevel
+  else
+    importModulesUncached imports opts trustLevel leakEnv
 
 /--
   Create environment object from imports and free compacted regions after calling `act`. No live references to the
@@ -47,4 +47,5 @@ instance PShareCommonT.monadShareCommon [Monad m] : MonadShareCommon (PShareComm
 @[inline] def ShareCommonM.run : ShareCommonM α → α := ShareCommonT.run
 @[inline] def PShareCommonM.run : PShareCommonM α → α := PShareCommonT.run
 
-def shareCommon (a : α) : α := (withShareCommon a : ShareCommonM α).run
+/-- Returns a maximally shared version of `a`, see `ShareCommon.shareCommon'`. -/
+def shareCommon (a : α) : α := _root_.ShareCommon.shareCommon' a
@@ -855,6 +855,7 @@ LEAN_EXPORT lean_obj_res lean_byte_array_mk(lean_obj_arg a);
 LEAN_EXPORT lean_obj_res lean_byte_array_data(lean_obj_arg a);
 LEAN_EXPORT lean_obj_res lean_copy_byte_array(lean_obj_arg a);
 LEAN_EXPORT uint64_t lean_byte_array_hash(b_lean_obj_arg a);
+LEAN_EXPORT uint64_t lean_byte_array_fast_hash(b_lean_obj_arg a);
 
 static inline lean_obj_res lean_mk_empty_byte_array(b_lean_obj_arg capacity) {
     if (!lean_is_scalar(capacity)) lean_internal_panic_out_of_memory();
@@ -882,6 +883,10 @@ static inline uint8_t lean_byte_array_fget(b_lean_obj_arg a, b_lean_obj_arg i) {
 }
 
 LEAN_EXPORT lean_obj_res lean_byte_array_push(lean_obj_arg a, uint8_t b);
+LEAN_EXPORT lean_obj_res lean_byte_array_index_of(b_lean_obj_arg a, uint8_t b, b_lean_obj_arg start);
+LEAN_EXPORT uint8_t lean_byte_array_beq(b_lean_obj_arg a, b_lean_obj_arg b);
+LEAN_EXPORT uint8_t lean_byte_array_compare(b_lean_obj_arg a, b_lean_obj_arg b);
+LEAN_EXPORT lean_obj_res lean_byte_array_fill(lean_obj_arg a, uint8_t v, b_lean_obj_arg start, b_lean_obj_arg stop);
 
 static inline lean_object * lean_byte_array_uset(lean_obj_arg a, size_t i, uint8_t v) {
     lean_obj_res r;
@@ -947,6 +952,11 @@ static inline double lean_float_array_get(b_lean_obj_arg a, b_lean_obj_arg i) {
 }
 
 LEAN_EXPORT lean_obj_res lean_float_array_push(lean_obj_arg a, double d);
+LEAN_EXPORT double lean_float_array_sum(b_lean_obj_arg a);
+LEAN_EXPORT double lean_float_array_dot(b_lean_obj_arg a, b_lean_obj_arg b);
+LEAN_EXPORT lean_obj_res lean_float_array_add(lean_obj_arg a, b_lean_obj_arg b);
+LEAN_EXPORT lean_obj_res lean_float_array_mul(lean_obj_arg a, b_lean_obj_arg b);
+LEAN_EXPORT lean_obj_res lean_float_array_fill(lean_obj_arg a, double v, b_lean_obj_arg start, b_lean_obj_arg stop);
 
 static inline lean_obj_res lean_float_array_uset(lean_obj_arg a, size_t i, double d) {
     lean_obj_res r;
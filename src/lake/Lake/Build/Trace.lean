@@ -125,7 +125,7 @@ instance [ComputeHash α m] : ComputeTrace α m Hash := ⟨ComputeHash.computeHa
 instance : ComputeHash String Id := ⟨Hash.ofString⟩
 
 def computeFileHash (file : FilePath) : IO Hash :=
-  Hash.ofByteArray <$> IO.FS.readBinFile file
+  Hash.mk <$> IO.FS.hashFile file
 
 instance : ComputeHash FilePath IO := ⟨computeFileHash⟩
 
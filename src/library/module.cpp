@@ -13,6 +13,8 @@ Authors: Leonardo de Moura, Gabriel Ebner, Sebastian Ullrich
 #include <sstream>
 #include <fstream>
 #include <algorithm>
+#include <memory>
+#include <random>
 #include <sys/stat.h>
 #include "runtime/thread.h"
 #include "runtime/interrupt.h"
@@ -22,6 +24,7 @@ Authors: Leonardo de Moura, Gabriel Ebner, Sebastian Ullrich
 #include "runtime/compact.h"
 #include "runtime/buffer.h"
 #include "util/io.h"
+#include "util/lz4.h"
 #include "util/name_map.h"
 #include "library/module.h"
 #include "library/constants.h"
@@ -47,59 +50,316 @@ namespace lean {
 
 /** On-disk format of a .olean file. */
 struct olean_header {
-    // 5 bytes: magic number
+    // 5 bytes: magic number; `opool` for object pools and `osnap` for import snapshots
     char marker[5] = {'o', 'l', 'e', 'a', 'n'};
-    // 1 byte: version, currently always `1`
-    uint8_t version = 1;
+    // 1 byte: version, currently always `3`
+    uint8_t version = 3;
     // 42 bytes: build githash, padded with `\0` to the right
     char githash[42];
     // address at which the beginning of the file (including header) is attempted to be mmapped
     size_t base_addr;
-    // payload, a serialize Lean object graph; `size_t` has same alignment requirements as Lean objects
+    // size of the payload in bytes
+    size_t data_size;
+    // number of entries of the relocation table following the payload
+    size_t num_relocs;
+    // `0` for uncompressed files. Otherwise, payload and relocation table are split into blocks of `block_size` bytes
+    // (the last one may be shorter), each of which is compressed independently into an LZ4 block. The compressed blocks
+    // are preceded by a seek table of `size_t` offsets of the end of each compressed block, relative to the first block.
+    // A block that is stored with its uncompressed size was not compressed.
+    size_t block_size;
+    // For object pool files (marker `opool`, see `write_olean_pool`), the identifier of the pool. For .olean files, the
+    // identifier of the pool they refer to, or `0`.
+    size_t pool_id;
+    // number of entries of the pool relocation table following the relocation table
+    size_t num_pool_relocs;
+    // payload, a serialize Lean object graph; `size_t` has same alignment requirements as Lean objects.
+    // It is followed by the relocation table, the `size_t` offsets (relative to `data`) of all pointers within the
+    // payload in increasing order, which are used to relocate the payload if it cannot be mmapped at `base_addr`.
+    // The pool relocation table lists the offsets of all pointers into the object pool in the same way; they hold
+    // on-disk addresses of the pool and must be relocated if the pool cannot be mmapped at its base address.
     size_t data[];
 };
 // make sure we don't have any padding bytes, which also ensures `data` is properly aligned
-static_assert(sizeof(olean_header) == 5 + 1 + 42 + sizeof(size_t), "olean_header must be packed");
+static_assert(sizeof(olean_header) == 5 + 1 + 42 + 6 * sizeof(size_t), "olean_header must be packed");
 
-extern "C" LEAN_EXPORT object * lean_save_module_data(b_obj_arg fname, b_obj_arg mod, b_obj_arg mdata, object *) {
-    std::string olean_fn(string_cstr(fname));
+static char const g_olean_marker[5]    = {'o', 'l', 'e', 'a', 'n'};
+static char const g_pool_marker[5]     = {'o', 'p', 'o', 'o', 'l'};
+static char const g_snapshot_marker[5] = {'o', 's', 'n', 'a', 'p'};
+
+/* Uncompressed size of the blocks of compressed .olean files. */
+#define LEAN_OLEAN_BLOCK_SIZE 256*1024
+/* Maximum number of threads used for reading and writing .olean files. */
+#define LEAN_OLEAN_MAX_THREADS 8
+
+/* Run `f(0), ..., f(n - 1)` using up to `LEAN_OLEAN_MAX_THREADS` threads (including the current one). */
+static void parallel_for(size_t n, std::function<void(size_t)> const & f) {
+    atomic<size_t> next(0);
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next++) < n) {
+            f(i);
+        }
+    };
+    unsigned num_threads = static_cast<unsigned>(std::min(n, static_cast<size_t>(std::min(std::max(hardware_concurrency(), 1u), static_cast<unsigned>(LEAN_OLEAN_MAX_THREADS)))));
+    std::vector<std::unique_ptr<lthread>> threads;
+    for (unsigned t = 1; t < num_threads; t++)
+        threads.emplace_back(new lthread(worker));
+    worker();
+    for (auto & t : threads)
+        t->join();
+}
+
+/* Rough average number of objects per constant in the compacted data of a module; used to pre-size the hash tables of
+   the object compactor instead of growing them repeatedly. */
+#define LEAN_OLEAN_OBJECTS_PER_CONSTANT 64
+
+static size_t estimate_num_objects(b_obj_arg mdata) {
+    // `ModuleData.constants`
+    return array_size(cnstr_get(mdata, 2)) * LEAN_OLEAN_OBJECTS_PER_CONSTANT;
+}
+
+static size_t estimate_snapshot_num_objects(b_obj_arg snap) {
+    // `ImportSnapshot.moduleData`
+    b_obj_arg mods = cnstr_get(snap, 3);
+    size_t r = 0;
+    for (size_t i = 0; i < array_size(mods); i++)
+        r += estimate_num_objects(array_get(mods, i));
+    return r;
+}
+
+/* Estimated number of objects from which on module data is compacted using multiple threads. */
+#define LEAN_SAVE_MODULE_PAR_MIN_OBJECTS 128*1024
+
+/* Number of threads for `object_compactor::operator()`. Whether the object graph is split into chunks (`> 0`) must only
+   depend on the data so that .olean files are reproducible. */
+static unsigned compactor_threads(size_t num_objects) {
+    if (num_objects < LEAN_SAVE_MODULE_PAR_MIN_OBJECTS)
+        return 0;
+    return std::min(std::max(hardware_concurrency(), 1u), static_cast<unsigned>(LEAN_OLEAN_MAX_THREADS));
+}
+
+/* Derive the base address of the .olean file of module `mod`. */
+static size_t olean_base_addr(name const & mod) {
+    // Derive a base address that is uniformly distributed by deterministic, and should most likely
+    // work for `mmap` on all interesting platforms
+    // NOTE: an overlapping/non-compatible base address does not prevent the module from being imported,
+    // merely from using `mmap` for that
+
+    // Let's start with a hash of the module name. Note that while our string hash is a dubious 32-bit
+    // algorithm, the mixing of multiple `Name` parts seems to result in a nicely distributed 64-bit
+    // output
+    size_t base_addr = mod.hash();
+    // x86-64 user space is currently limited to the lower 47 bits
+    // https://en.wikipedia.org/wiki/X86-64#Virtual_address_space_details
+    // On Linux at least, the stack grows down from ~0x7fff... followed by shared libraries, so reserve
+    // a bit of space for them (0x7fff...-0x7f00... = 1TB)
+    base_addr = base_addr % 0x7f0000000000;
+    // `mmap` addresses must be page-aligned. The default (non-huge) page size on x86-64 is 4KB.
+    // `MapViewOfFileEx` addresses must be aligned to the "memory allocation granularity", which is 64KB.
+    base_addr = base_addr & ~((1LL<<16) - 1);
+    return base_addr;
+}
+
+/* The object pool named by the environment variable `LEAN_OLEAN_POOL`, see `write_olean_pool`. It is loaded on first
+   use and never released, as all modules written or read with it refer to it. */
+struct olean_pool {
+    object_pool * m_pool = nullptr;
+    size_t        m_id   = 0;
+    // reason why the configured pool could not be loaded
+    std::string   m_error;
+};
+static olean_pool const & get_olean_pool();
+
+/* Write payload and relocation table of `compactor` as compressed blocks, see `olean_header::block_size`. */
+static void write_compressed(std::ofstream & out, olean_header & header, object_compactor const & compactor) {
+    std::vector<size_t> const & relocs      = compactor.relocations();
+    std::vector<size_t> const & pool_relocs = compactor.pool_relocations();
+    std::vector<char> payload(compactor.size() + (relocs.size() + pool_relocs.size()) * sizeof(size_t));
+    memcpy(payload.data(), compactor.data(), compactor.size());
+    memcpy(payload.data() + compactor.size(), relocs.data(), relocs.size() * sizeof(size_t));
+    memcpy(payload.data() + compactor.size() + relocs.size() * sizeof(size_t), pool_relocs.data(), pool_relocs.size() * sizeof(size_t));
+    size_t block_size = LEAN_OLEAN_BLOCK_SIZE;
+    size_t num_blocks = (payload.size() + block_size - 1) / block_size;
+    std::vector<std::vector<char>> blocks(num_blocks);
+    parallel_for(num_blocks, [&](size_t i) {
+        char const * src = payload.data() + i * block_size;
+        size_t len = std::min(block_size, payload.size() - i * block_size);
+        std::vector<char> & block = blocks[i];
+        block.resize(lz4_compress_bound(len));
+        size_t n = lz4_compress_block(src, len, block.data(), block.size());
+        if (n == 0 || n >= len) {
+            block.assign(src, src + len);
+        } else {
+            block.resize(n);
+        }
+    });
+    std::vector<size_t> ends(num_blocks);
+    size_t end = 0;
+    for (size_t i = 0; i < num_blocks; i++) {
+        end += blocks[i].size();
+        ends[i] = end;
+    }
+    header.data_size       = compactor.size();
+    header.num_relocs      = relocs.size();
+    header.num_pool_relocs = pool_relocs.size();
+    header.block_size      = block_size;
+    out.write(reinterpret_cast<char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<char const *>(ends.data()), ends.size() * sizeof(size_t));
+    for (std::vector<char> const & block : blocks)
+        out.write(block.data(), block.size());
+}
+
+/* Compact `mdata` (of about `num_objects` objects) in memory, referring to `pool` if not null, and write it to
+   `olean_tmp_fn`, compressed if `compress` is true. */
+static std::string write_module_data_buffered(std::string const & olean_fn, std::string const & olean_tmp_fn,
+                                              olean_header & header, b_obj_arg mdata, size_t num_objects,
+                                              object_pool const * pool, bool compress) {
+    std::ofstream out(olean_tmp_fn, std::ios_base::binary);
+    if (out.fail()) {
+        return (sstream() << "failed to create file '" << olean_fn << "'").str();
+    }
+    object_compactor compactor(reinterpret_cast<void *>(header.base_addr + offsetof(olean_header, data)));
+    compactor.set_pool(pool);
+    compactor.reserve(num_objects);
+    compactor(mdata, compactor_threads(num_objects));
+    if (compress) {
+        write_compressed(out, header, compactor);
+    } else {
+        std::vector<size_t> const & relocs      = compactor.relocations();
+        std::vector<size_t> const & pool_relocs = compactor.pool_relocations();
+        header.data_size       = compactor.size();
+        header.num_relocs      = relocs.size();
+        header.num_pool_relocs = pool_relocs.size();
+        out.write(reinterpret_cast<char *>(&header), sizeof(header));
+        out.write(static_cast<char const *>(compactor.data()), compactor.size());
+        out.write(reinterpret_cast<char const *>(relocs.data()), relocs.size() * sizeof(size_t));
+        out.write(reinterpret_cast<char const *>(pool_relocs.data()), pool_relocs.size() * sizeof(size_t));
+    }
+    out.close();
+    if (out.fail()) {
+        return (sstream() << "failed to write '" << olean_fn << "'").str();
+    }
+    return std::string();
+}
+
+#ifndef LEAN_WINDOWS
+static bool pwrite_all(int fd, void const * data, size_t sz, off_t offset) {
+    char const * p = static_cast<char const *>(data);
+    while (sz > 0) {
+        ssize_t n = pwrite(fd, p, sz, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p      += n;
+        sz     -= n;
+        offset += n;
+    }
+    return true;
+}
+#endif
+
+#ifndef LEAN_WINDOWS
+/* Compact `mdata` directly into a shared mapping of `olean_tmp_fn`, so the compacted region is neither kept in
+   anonymous memory nor copied once more for writing. */
+static std::string write_module_data_mapped(std::string const & olean_fn, std::string const & olean_tmp_fn,
+                                            olean_header & header, b_obj_arg mdata, size_t num_objects,
+                                            object_pool const * pool) {
+    int fd = open(olean_tmp_fn.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+    if (fd == -1) {
+        return (sstream() << "failed to create file '" << olean_fn << "'").str();
+    }
+    bool ok;
+    size_t file_size;
+    try {
+        object_compactor compactor(reinterpret_cast<void *>(header.base_addr + offsetof(olean_header, data)), fd, sizeof(olean_header));
+        compactor.set_pool(pool);
+        compactor.reserve(num_objects);
+        compactor(mdata, compactor_threads(num_objects));
+        compactor.sync();
+        std::vector<size_t> const & relocs      = compactor.relocations();
+        std::vector<size_t> const & pool_relocs = compactor.pool_relocations();
+        header.data_size       = compactor.size();
+        header.num_relocs      = relocs.size();
+        header.num_pool_relocs = pool_relocs.size();
+        size_t relocs_offset = sizeof(olean_header) + header.data_size;
+        size_t pool_relocs_offset = relocs_offset + relocs.size() * sizeof(size_t);
+        file_size = pool_relocs_offset + pool_relocs.size() * sizeof(size_t);
+        ok = pwrite_all(fd, &header, sizeof(header), 0) &&
+             pwrite_all(fd, relocs.data(), relocs.size() * sizeof(size_t), relocs_offset) &&
+             pwrite_all(fd, pool_relocs.data(), pool_relocs.size() * sizeof(size_t), pool_relocs_offset);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    // the compactor grows the file in large steps
+    ok = ok && ftruncate(fd, file_size) == 0;
+    // `close` does not report errors of writing back the file
+    ok = ok && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    if (!ok) {
+        return (sstream() << "failed to write '" << olean_fn << "': " << errno << " " << strerror(errno)).str();
+    }
+    return std::string();
+}
+#endif
+
+/* Return a temporary file name next to `fn` that is unique to this call, so that concurrent writers of `fn`, such as
+   processes saving the same import snapshot, never write to the same temporary file. */
+static std::string mk_tmp_file_name(std::string const & fn) {
+    static atomic<unsigned> g_counter(0);
+#ifdef LEAN_WINDOWS
+    unsigned long pid = GetCurrentProcessId();
+#else
+    unsigned long pid = getpid();
+#endif
+    // the random part distinguishes processes on different hosts sharing a file system
+    std::random_device rd;
+    return (sstream() << fn << "." << pid << "." << g_counter++ << "." << std::hex << rd() << ".tmp").str();
+}
+
+/* Removes the temporary file of an unsuccessful write when going out of scope. */
+class tmp_file_remover {
+    std::string const & m_fn;
+public:
+    explicit tmp_file_remover(std::string const & fn):m_fn(fn) {}
+    ~tmp_file_remover() {
+        // fails harmlessly if the file has been renamed into place
+        std::remove(m_fn.c_str());
+    }
+};
+
+/* Write the compacted object graph `mdata` of about `num_objects` objects to `olean_fn`, using the given header marker
+   and base address. */
+static object * save_compacted_data(std::string const & olean_fn, char const * marker, size_t base_addr,
+                                    b_obj_arg mdata, size_t num_objects) {
     // we first write to a temp file and then move it to the correct path (possibly deleting an older file)
     // so that we neither expose partially-written files nor modify possibly memory-mapped files
-    std::string olean_tmp_fn = olean_fn + ".tmp";
+    std::string olean_tmp_fn = mk_tmp_file_name(olean_fn);
+    tmp_file_remover remover(olean_tmp_fn);
     try {
-        std::ofstream out(olean_tmp_fn, std::ios_base::binary);
-        if (out.fail()) {
-            return io_result_mk_error((sstream() << "failed to create file '" << olean_fn << "'").str());
-        }
-
-        // Derive a base address that is uniformly distributed by deterministic, and should most likely
-        // work for `mmap` on all interesting platforms
-        // NOTE: an overlapping/non-compatible base address does not prevent the module from being imported,
-        // merely from using `mmap` for that
-
-        // Let's start with a hash of the module name. Note that while our string hash is a dubious 32-bit
-        // algorithm, the mixing of multiple `Name` parts seems to result in a nicely distributed 64-bit
-        // output
-        size_t base_addr = name(mod, true).hash();
-        // x86-64 user space is currently limited to the lower 47 bits
-        // https://en.wikipedia.org/wiki/X86-64#Virtual_address_space_details
-        // On Linux at least, the stack grows down from ~0x7fff... followed by shared libraries, so reserve
-        // a bit of space for them (0x7fff...-0x7f00... = 1TB)
-        base_addr = base_addr % 0x7f0000000000;
-        // `mmap` addresses must be page-aligned. The default (non-huge) page size on x86-64 is 4KB.
-        // `MapViewOfFileEx` addresses must be aligned to the "memory allocation granularity", which is 64KB.
-        base_addr = base_addr & ~((1LL<<16) - 1);
-
-        object_compactor compactor(reinterpret_cast<void *>(base_addr + offsetof(olean_header, data)));
-        compactor(mdata);
-
+        olean_pool const & pool = get_olean_pool();
+        if (!pool.m_error.empty()) {
+            return io_result_mk_error(pool.m_error);
+        }
         // see/sync with file format description above
         olean_header header = {};
+        memcpy(header.marker, marker, sizeof(header.marker));
         header.base_addr = base_addr;
+        header.pool_id   = pool.m_id;
         strncpy(header.githash, LEAN_GITHASH, sizeof(header.githash));
-        out.write(reinterpret_cast<char *>(&header), sizeof(header));
-        out.write(static_cast<char const *>(compactor.data()), compactor.size());
-        out.close();
+        // Compressed files have to be produced from the complete compacted region in memory anyway.
+        bool compress = std::getenv("LEAN_OLEAN_COMPRESS") != nullptr;
+        std::string err;
+#ifdef LEAN_WINDOWS
+        err = write_module_data_buffered(olean_fn, olean_tmp_fn, header, mdata, num_objects, pool.m_pool, compress);
+#else
+        err = compress ? write_module_data_buffered(olean_fn, olean_tmp_fn, header, mdata, num_objects, pool.m_pool, true)
+                       : write_module_data_mapped(olean_fn, olean_tmp_fn, header, mdata, num_objects, pool.m_pool);
+#endif
+        if (!err.empty()) {
+            return io_result_mk_error(err);
+        }
         while (std::rename(olean_tmp_fn.c_str(), olean_fn.c_str()) != 0) {
 #ifdef LEAN_WINDOWS
             if (errno == EEXIST) {
@@ -126,12 +386,139 @@ extern "C" LEAN_EXPORT object * lean_save_module_data(b_obj_arg fname, b_obj_arg
     }
 }
 
-extern "C" LEAN_EXPORT object * lean_read_module_data(object * fname, object *) {
-    std::string olean_fn(string_cstr(fname));
+extern "C" LEAN_EXPORT object * lean_save_module_data(b_obj_arg fname, b_obj_arg mod, b_obj_arg mdata, object *) {
+    return save_compacted_data(string_cstr(fname), g_olean_marker, olean_base_addr(name(mod, true)), mdata,
+                               estimate_num_objects(mdata));
+}
+
+/*
+@[extern "lean_save_import_snapshot"]
+opaque saveImportSnapshot (fname : @& System.FilePath) (snap : @& ImportSnapshot) : IO Unit
+
+Import snapshots are written like .olean files, but with the marker `osnap` so that they cannot be confused with them. */
+extern "C" LEAN_EXPORT object * lean_save_import_snapshot(b_obj_arg fname, b_obj_arg snap, object *) {
+    return save_compacted_data(string_cstr(fname), g_snapshot_marker, olean_base_addr(name("_import_snapshot")), snap,
+                               estimate_snapshot_num_objects(snap));
+}
+
+/* Create the compacted region for a payload of `header.data_size` bytes at `buffer`, followed by the relocation table,
+   and read its root object. */
+static void mk_region(olean_header const & header, char * buffer, bool is_mmap, std::function<void()> free_data,
+                      compacted_region * & region_out, object * & mod_out) {
+    char * base_addr = reinterpret_cast<char *>(header.base_addr);
+    // the relocation table is only needed (and used) when the payload is not mapped at its base address
+    compacted_region * region =
+      new compacted_region(header.data_size, buffer, base_addr + sizeof(olean_header), is_mmap, free_data,
+                           reinterpret_cast<size_t const *>(buffer + header.data_size), header.num_relocs);
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+    // do not report as leak
+    __lsan_ignore_object(region);
+#endif
+#endif
+    mod_out    = region->read();
+    region_out = region;
+}
+
+/* Shift the references into the object pool of the payload at `buffer` by `pool_delta`, see `olean_header::pool_id`. */
+static void relocate_pool_refs(olean_header const & header, char * buffer, size_t pool_delta) {
+    if (pool_delta == 0)
+        return;
+    size_t const * pool_relocs = reinterpret_cast<size_t const *>(buffer + header.data_size) + header.num_relocs;
+    for (size_t i = 0; i < header.num_pool_relocs; i++) {
+        *reinterpret_cast<size_t *>(buffer + pool_relocs[i]) += pool_delta;
+    }
+}
+
+/*
+Read the rest of the compressed .olean file `in` of `size` bytes (see `olean_header::block_size`), and decompress it in
+parallel. If possible, it is decompressed into an anonymous mapping at the base address, which avoids relocation just
+like `mmap`ing an uncompressed file.
+*/
+static std::string read_compressed_module_data(std::string const & olean_fn, std::ifstream & in, size_t size, olean_header const & header,
+                                               size_t pool_delta, compacted_region * & region_out, object * & mod_out) {
+    size_t rest = size - sizeof(olean_header);
+    if (header.num_relocs > rest * 32 || header.num_pool_relocs > rest * 32 || header.data_size > rest * 256 ||
+        header.block_size % sizeof(size_t) != 0) {
+        return (sstream() << "failed to read file '" << olean_fn << "', invalid header").str();
+    }
+    size_t total      = header.data_size + (header.num_relocs + header.num_pool_relocs) * sizeof(size_t);
+    size_t num_blocks = (total + header.block_size - 1) / header.block_size;
+    if (num_blocks > rest / sizeof(size_t)) {
+        return (sstream() << "failed to read file '" << olean_fn << "', invalid header").str();
+    }
+    std::vector<size_t> ends(num_blocks);
+    std::vector<char> blocks(rest - num_blocks * sizeof(size_t));
+    if (!in.read(reinterpret_cast<char *>(ends.data()), num_blocks * sizeof(size_t)) || !in.read(blocks.data(), blocks.size())) {
+        return (sstream() << "failed to read file '" << olean_fn << "'").str();
+    }
+    for (size_t i = 0; i < num_blocks; i++) {
+        if (ends[i] < (i == 0 ? 0 : ends[i - 1]) || ends[i] > blocks.size()) {
+            return (sstream() << "failed to read file '" << olean_fn << "', invalid seek table").str();
+        }
+    }
+
+    char * base_addr = reinterpret_cast<char *>(header.base_addr);
+    char * buffer = nullptr;
+    bool is_mmap = false;
+    std::function<void()> free_data;
+#if defined(LEAN_MMAP) && !defined(LEAN_WINDOWS)
+    size_t map_size = sizeof(olean_header) + total;
+    char * map = static_cast<char *>(mmap(base_addr, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (map == base_addr) {
+        buffer    = map + sizeof(olean_header);
+        is_mmap   = true;
+        free_data = [=]() {
+            lean_always_assert(munmap(map, map_size) == 0);
+        };
+    } else if (map != MAP_FAILED) {
+        munmap(map, map_size);
+    }
+#endif
+    if (!buffer) {
+        buffer    = static_cast<char *>(malloc(total));
+        free_data = [=]() {
+            free(buffer);
+        };
+    }
+    atomic<bool> ok(true);
+    parallel_for(num_blocks, [&](size_t i) {
+        size_t begin = i == 0 ? 0 : ends[i - 1];
+        size_t len   = std::min(static_cast<size_t>(header.block_size), total - i * header.block_size);
+        char * dst   = buffer + i * header.block_size;
+        if (ends[i] - begin == len) {
+            memcpy(dst, blocks.data() + begin, len);
+        } else if (!lz4_decompress_block(blocks.data() + begin, ends[i] - begin, dst, len)) {
+            ok = false;
+        }
+    });
+    if (!ok) {
+        free_data();
+        return (sstream() << "failed to read file '" << olean_fn << "', corrupt block").str();
+    }
+    relocate_pool_refs(header, buffer, pool_delta);
+#if defined(LEAN_MMAP) && !defined(LEAN_WINDOWS)
+    if (is_mmap) {
+        // like the mapping of an uncompressed file
+        mprotect(map, map_size, PROT_READ);
+    }
+#endif
+    mk_region(header, buffer, is_mmap, free_data, region_out, mod_out);
+    return std::string();
+}
+
+/*
+Read the .olean file `olean_fn` (or the object pool or import snapshot file, depending on the expected header `marker`)
+into a compacted region, and store its header, the region, and the root object in `header`, `region_out`, and `mod_out`. Return an error message on failure,
+and the empty string otherwise.
+This function does not allocate Lean objects, so it can be used from any thread.
+*/
+static std::string read_module_data_core(std::string const & olean_fn, char const * marker, olean_header & header,
+                                         compacted_region * & region_out, object * & mod_out) {
     try {
         std::ifstream in(olean_fn, std::ios_base::binary);
         if (in.fail()) {
-            return io_result_mk_error((sstream() << "failed to open file '" << olean_fn << "'").str());
+            return (sstream() << "failed to open file '" << olean_fn << "'").str();
         }
         /* Get file size */
         in.seekg(0, in.end);
@@ -139,17 +526,42 @@ extern "C" LEAN_EXPORT object * lean_read_module_data(object * fname, object *)
         in.seekg(0);
 
         olean_header default_header = {};
-        olean_header header;
         if (!in.read(reinterpret_cast<char *>(&header), sizeof(header))) {
-            return io_result_mk_error((sstream() << "failed to read file '" << olean_fn << "', invalid header").str());
+            return (sstream() << "failed to read file '" << olean_fn << "', invalid header").str();
         }
-        if (memcmp(header.marker, default_header.marker, sizeof(header.marker)) != 0
+        if (memcmp(header.marker, marker, sizeof(header.marker)) != 0
             || header.version != default_header.version
 #ifdef LEAN_CHECK_OLEAN_VERSION
             || strncmp(header.githash, LEAN_GITHASH, sizeof(header.githash)) != 0
 #endif
         ) {
-            return io_result_mk_error((sstream() << "failed to read file '" << olean_fn << "', invalid header").str());
+            return (sstream() << "failed to read file '" << olean_fn << "', invalid header").str();
+        }
+        // references into the object pool have to be relocated if it is not mapped at its base address
+        size_t pool_delta = 0;
+        if (marker != g_pool_marker && header.pool_id != 0) {
+            olean_pool const & pool = get_olean_pool();
+            if (!pool.m_error.empty()) {
+                return pool.m_error;
+            }
+            if (!pool.m_pool) {
+                return (sstream() << "failed to read file '" << olean_fn << "', it refers to an object pool but LEAN_OLEAN_POOL is not set").str();
+            }
+            if (pool.m_id != header.pool_id) {
+                return (sstream() << "failed to read file '" << olean_fn << "', it was written with a different object pool "
+                                  << "than the one given by LEAN_OLEAN_POOL").str();
+            }
+            pool_delta = pool.m_pool->delta();
+        }
+        if (header.block_size != 0) {
+            return read_compressed_module_data(olean_fn, in, size, header, pool_delta, region_out, mod_out);
+        }
+        size_t rest = size - sizeof(olean_header);
+        if (header.data_size > rest
+            || (rest - header.data_size) % sizeof(size_t) != 0
+            || header.num_relocs > (rest - header.data_size) / sizeof(size_t)
+            || header.num_pool_relocs != (rest - header.data_size) / sizeof(size_t) - header.num_relocs) {
+            return (sstream() << "failed to read file '" << olean_fn << "', invalid header").str();
         }
         char * base_addr = reinterpret_cast<char *>(header.base_addr);
         char * buffer = nullptr;
@@ -159,11 +571,11 @@ extern "C" LEAN_EXPORT object * lean_read_module_data(object * fname, object *)
         // `FILE_SHARE_DELETE` is necessary to allow the file to (be marked to) be deleted while in use
         HANDLE h_olean_fn = CreateFile(olean_fn.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
         if (h_olean_fn == INVALID_HANDLE_VALUE) {
-            return io_result_mk_error((sstream() << "failed to open '" << olean_fn << "': " << GetLastError()).str());
+            return (sstream() << "failed to open '" << olean_fn << "': " << GetLastError()).str();
         }
         HANDLE h_map = CreateFileMapping(h_olean_fn, NULL, PAGE_READONLY, 0, 0, NULL);
         if (h_olean_fn == NULL) {
-            return io_result_mk_error((sstream() << "failed to map '" << olean_fn << "': " << GetLastError()).str());
+            return (sstream() << "failed to map '" << olean_fn << "': " << GetLastError()).str();
         }
         buffer = static_cast<char *>(MapViewOfFileEx(h_map, FILE_MAP_READ, 0, 0, 0, base_addr));
         free_data = [=]() {
@@ -176,10 +588,14 @@ extern "C" LEAN_EXPORT object * lean_read_module_data(object * fname, object *)
 #else
         int fd = open(olean_fn.c_str(), O_RDONLY);
         if (fd == -1) {
-            return io_result_mk_error((sstream() << "failed to open '" << olean_fn << "': " << strerror(errno)).str());
+            return (sstream() << "failed to open '" << olean_fn << "': " << strerror(errno)).str();
         }
 #ifdef LEAN_MMAP
         buffer = static_cast<char *>(mmap(base_addr, size, PROT_READ, MAP_PRIVATE, fd, 0));
+        if (buffer == base_addr) {
+            // start reading the file in the background; its pages are only touched once the module is used
+            madvise(buffer, size, MADV_WILLNEED);
+        }
 #endif
         close(fd);
         free_data = [=]() {
@@ -188,7 +604,7 @@ extern "C" LEAN_EXPORT object * lean_read_module_data(object * fname, object *)
             }
         };
 #endif
-        if (buffer && buffer == base_addr) {
+        if (buffer && buffer == base_addr && pool_delta == 0) {
             buffer += sizeof(olean_header);
             is_mmap = true;
         } else {
@@ -201,27 +617,305 @@ extern "C" LEAN_EXPORT object * lean_read_module_data(object * fname, object *)
             };
             in.read(buffer, size - sizeof(olean_header));
             if (!in) {
-                return io_result_mk_error((sstream() << "failed to read file '" << olean_fn << "'").str());
+                return (sstream() << "failed to read file '" << olean_fn << "'").str();
             }
         }
         in.close();
 
-        compacted_region * region =
-          new compacted_region(size - sizeof(olean_header), buffer, base_addr + sizeof(olean_header), is_mmap, free_data);
-#if defined(__has_feature)
-#if __has_feature(address_sanitizer)
-        // do not report as leak
-        __lsan_ignore_object(region);
-#endif
-#endif
-        object * mod = region->read();
-        object * mod_region = alloc_cnstr(0, 2, 0);
-        cnstr_set(mod_region, 0, mod);
-        cnstr_set(mod_region, 1, box_size_t(reinterpret_cast<size_t>(region)));
-        return io_result_mk_ok(mod_region);
+        relocate_pool_refs(header, buffer, pool_delta);
+        mk_region(header, buffer, is_mmap, free_data, region_out, mod_out);
+        return std::string();
     } catch (exception & ex) {
-        return io_result_mk_error((sstream() << "failed to read '" << olean_fn << "': " << ex.what()).str());
+        return (sstream() << "failed to read '" << olean_fn << "': " << ex.what()).str();
+    }
+}
+
+static olean_pool load_olean_pool() {
+    olean_pool pool;
+    char const * pool_fn = std::getenv("LEAN_OLEAN_POOL");
+    if (pool_fn == nullptr || *pool_fn == 0) {
+        return pool;
+    }
+    olean_header header;
+    compacted_region * region;
+    object * root;
+    std::string err = read_module_data_core(pool_fn, g_pool_marker, header, region, root);
+    if (!err.empty()) {
+        pool.m_error = (sstream() << "failed to load object pool: " << err).str();
+        return pool;
+    }
+    pool.m_pool = new object_pool(region->data(), header.data_size, reinterpret_cast<char *>(header.base_addr) + sizeof(olean_header));
+    pool.m_id   = header.pool_id;
+    return pool;
+}
+
+static olean_pool const & get_olean_pool() {
+    static olean_pool pool = load_olean_pool();
+    return pool;
+}
+
+/* Minimum number of modules an object has to occur in to be moved into an object pool. */
+#define LEAN_OLEAN_POOL_MIN_MODULES 2
+
+namespace {
+/*
+Identifies structurally equal objects of different modules for `write_olean_pool`. Only constructor objects, arrays,
+scalar arrays, and strings whose children are such objects as well can be moved into the pool, as these are the objects
+`object_compactor` shares.
+*/
+class olean_pool_builder {
+    struct entry {
+        object * m_obj;
+        unsigned m_last_module;
+        unsigned m_num_modules;
+    };
+    static constexpr size_t g_no_id = static_cast<size_t>(-1);
+    std::unordered_map<std::string, size_t> m_ids;
+    std::vector<entry> m_entries;
+    // identifiers of the objects of the current module, `g_no_id` for objects that cannot be moved into the pool
+    std::unordered_map<object *, size_t> m_obj_ids;
+
+    /* Append the child `c` to `key`, and return false if it cannot be moved into the pool. */
+    bool push_child(std::string & key, object * c) {
+        size_t v;
+        if (lean_is_scalar(c)) {
+            v = reinterpret_cast<size_t>(c);
+        } else {
+            size_t id = m_obj_ids.at(c);
+            if (id == g_no_id)
+                return false;
+            // scalars are odd
+            v = id << 1;
+        }
+        key.append(reinterpret_cast<char const *>(&v), sizeof(v));
+        return true;
+    }
+
+    /* Return the identifier of `o`, all of whose children have already been visited. */
+    size_t mk_id(object * o, unsigned module_idx) {
+        std::string key;
+        uint8 tag = lean_ptr_tag(o);
+        key.push_back(static_cast<char>(tag));
+        if (tag <= LeanMaxCtorTag) {
+            unsigned num_objs = lean_ctor_num_objs(o);
+            key.push_back(static_cast<char>(num_objs));
+            for (unsigned i = 0; i < num_objs; i++) {
+                if (!push_child(key, lean_ctor_get(o, i)))
+                    return g_no_id;
+            }
+            char const * scalars = reinterpret_cast<char const *>(lean_ctor_obj_cptr(o) + num_objs);
+            key.append(scalars, reinterpret_cast<char const *>(o) + lean_object_byte_size(o) - scalars);
+        } else if (tag == LeanArray) {
+            for (size_t i = 0; i < lean_array_size(o); i++) {
+                if (!push_child(key, lean_array_get_core(o, i)))
+                    return g_no_id;
+            }
+        } else if (tag == LeanScalarArray) {
+            key.push_back(static_cast<char>(lean_sarray_elem_size(o)));
+            key.append(reinterpret_cast<char const *>(lean_sarray_cptr(o)), lean_sarray_size(o) * lean_sarray_elem_size(o));
+        } else if (tag == LeanString) {
+            key.append(lean_string_cstr(o), lean_string_size(o));
+        } else {
+            return g_no_id;
+        }
+        auto it = m_ids.emplace(std::move(key), m_entries.size());
+        if (it.second) {
+            m_entries.push_back(entry { o, module_idx, 1 });
+        } else {
+            entry & e = m_entries[it.first->second];
+            if (e.m_last_module != module_idx) {
+                e.m_last_module = module_idx;
+                e.m_num_modules++;
+            }
+        }
+        return it.first->second;
+    }
+
+public:
+    /* Visit all objects reachable from `root`, the module data of the module with index `module_idx`. */
+    void add_module(object * root, unsigned module_idx) {
+        m_obj_ids.clear();
+        // objects and whether their children have been pushed already
+        std::vector<std::pair<object *, bool>> todo;
+        todo.emplace_back(root, false);
+        while (!todo.empty()) {
+            object * o = todo.back().first;
+            if (m_obj_ids.find(o) != m_obj_ids.end()) {
+                todo.pop_back();
+            } else if (todo.back().second) {
+                todo.pop_back();
+                m_obj_ids[o] = mk_id(o, module_idx);
+            } else {
+                todo.back().second = true;
+                auto push = [&](object * c) {
+                    if (!lean_is_scalar(c) && m_obj_ids.find(c) == m_obj_ids.end())
+                        todo.emplace_back(c, false);
+                };
+                uint8 tag = lean_ptr_tag(o);
+                if (tag <= LeanMaxCtorTag) {
+                    for (unsigned i = 0; i < lean_ctor_num_objs(o); i++)
+                        push(lean_ctor_get(o, i));
+                } else if (tag == LeanArray) {
+                    for (size_t i = 0; i < lean_array_size(o); i++)
+                        push(lean_array_get_core(o, i));
+                } else if (tag == LeanThunk) {
+                    push(lean_to_thunk(o)->m_value);
+                } else if (tag == LeanRef) {
+                    push(lean_to_ref(o)->m_value);
+                } else if (tag == LeanTask) {
+                    push(lean_to_task(o)->m_value);
+                }
+            }
+        }
+    }
+
+    /* Return a representative of each object that occurs in at least `min_modules` modules. */
+    std::vector<object *> shared_objects(unsigned min_modules) const {
+        std::vector<object *> r;
+        for (entry const & e : m_entries) {
+            if (e.m_num_modules >= min_modules)
+                r.push_back(e.m_obj);
+        }
+        return r;
+    }
+};
+}
+
+void write_olean_pool(std::string const & pool_fn, std::vector<std::string> const & olean_fns) {
+    std::vector<std::unique_ptr<compacted_region>> regions;
+    olean_pool_builder builder;
+    for (size_t i = 0; i < olean_fns.size(); i++) {
+        olean_header header;
+        compacted_region * region;
+        object * mod;
+        std::string err = read_module_data_core(olean_fns[i], g_olean_marker, header, region, mod);
+        if (!err.empty()) {
+            throw exception(err);
+        }
+        regions.emplace_back(region);
+        builder.add_module(mod, i);
+    }
+    std::vector<object *> objs = builder.shared_objects(LEAN_OLEAN_POOL_MIN_MODULES);
+    // the root of the pool is an array of all shared objects, so that they are all copied
+    object * root = alloc_array(objs.size(), objs.size());
+    for (size_t i = 0; i < objs.size(); i++)
+        array_set(root, i, objs[i]);
+
+    olean_header header = {};
+    memcpy(header.marker, g_pool_marker, sizeof(header.marker));
+    header.base_addr = olean_base_addr(name("_olean_pool"));
+    strncpy(header.githash, LEAN_GITHASH, sizeof(header.githash));
+    object_compactor compactor(reinterpret_cast<void *>(header.base_addr + offsetof(olean_header, data)));
+    compactor(root);
+    dec(root);
+    std::vector<size_t> const & relocs = compactor.relocations();
+    header.data_size  = compactor.size();
+    header.num_relocs = relocs.size();
+    header.pool_id    = std::max(hash_bytes(compactor.size(), static_cast<unsigned char const *>(compactor.data()), 31),
+                                 static_cast<uint64>(1));
+
+    std::string pool_tmp_fn = mk_tmp_file_name(pool_fn);
+    tmp_file_remover remover(pool_tmp_fn);
+    std::ofstream out(pool_tmp_fn, std::ios_base::binary);
+    if (out.fail()) {
+        throw exception(sstream() << "failed to create file '" << pool_fn << "'");
+    }
+    out.write(reinterpret_cast<char *>(&header), sizeof(header));
+    out.write(static_cast<char const *>(compactor.data()), compactor.size());
+    out.write(reinterpret_cast<char const *>(relocs.data()), relocs.size() * sizeof(size_t));
+    out.close();
+    if (out.fail() || std::rename(pool_tmp_fn.c_str(), pool_fn.c_str()) != 0) {
+        throw exception(sstream() << "failed to write '" << pool_fn << "'");
+    }
+}
+
+static object * mk_module_region(object * mod, compacted_region * region) {
+    object * mod_region = alloc_cnstr(0, 2, 0);
+    cnstr_set(mod_region, 0, mod);
+    cnstr_set(mod_region, 1, box_size_t(reinterpret_cast<size_t>(region)));
+    return mod_region;
+}
+
+extern "C" LEAN_EXPORT object * lean_read_module_data(object * fname, object *) {
+    olean_header header;
+    compacted_region * region;
+    object * mod;
+    std::string err = read_module_data_core(string_cstr(fname), g_olean_marker, header, region, mod);
+    if (!err.empty()) {
+        return io_result_mk_error(err);
+    }
+    return io_result_mk_ok(mk_module_region(mod, region));
+}
+
+/*
+@[extern "lean_read_import_snapshot"]
+opaque readImportSnapshot (fname : @& System.FilePath) : IO (ImportSnapshot × CompactedRegion) */
+extern "C" LEAN_EXPORT object * lean_read_import_snapshot(b_obj_arg fname, object *) {
+    olean_header header;
+    compacted_region * region;
+    object * snap;
+    std::string err = read_module_data_core(string_cstr(fname), g_snapshot_marker, header, region, snap);
+    if (!err.empty()) {
+        return io_result_mk_error(err);
+    }
+    return io_result_mk_ok(mk_module_region(snap, region));
+}
+
+/*
+@[extern "lean_read_module_data_batch"]
+opaque readModuleDataBatch (fnames : @& Array System.FilePath) : IO (Array (ModuleData × CompactedRegion))
+
+Like `lean_read_module_data`, but opens, maps (or reads), and relocates all given files in parallel. On failure,
+the error of the first failing file is returned and all regions are released again. */
+extern "C" LEAN_EXPORT object * lean_read_module_data_batch(b_obj_arg fnames, object *) {
+    size_t n = array_size(fnames);
+    std::vector<std::string> fns;
+    for (size_t i = 0; i < n; i++)
+        fns.push_back(string_cstr(array_get(fnames, i)));
+    std::vector<compacted_region *> regions(n, nullptr);
+    std::vector<object *> mods(n, nullptr);
+    std::vector<std::string> errs(n);
+    parallel_for(n, [&](size_t i) {
+        olean_header header;
+        errs[i] = read_module_data_core(fns[i], g_olean_marker, header, regions[i], mods[i]);
+    });
+    for (size_t i = 0; i < n; i++) {
+        if (!errs[i].empty()) {
+            for (compacted_region * region : regions)
+                delete region;
+            return io_result_mk_error(errs[i]);
+        }
+    }
+    object * r = alloc_array(n, n);
+    for (size_t i = 0; i < n; i++)
+        array_set(r, i, mk_module_region(mods[i], regions[i]));
+    return io_result_mk_ok(r);
+}
+
+/*
+@[extern "lean_lz4_compress_block"]
+opaque Internal.lz4CompressBlock (data : @& ByteArray) : ByteArray */
+extern "C" LEAN_EXPORT obj_res lean_lz4_compress_block(b_obj_arg data) {
+    size_t capacity = lz4_compress_bound(sarray_size(data));
+    object * r = alloc_sarray(1, 0, capacity);
+    size_t sz = lz4_compress_block(reinterpret_cast<char const *>(sarray_cptr(data)), sarray_size(data),
+                                   reinterpret_cast<char *>(sarray_cptr(r)), capacity);
+    lean_always_assert(sz > 0);
+    lean_to_sarray(r)->m_size = sz;
+    return r;
+}
+
+/*
+@[extern "lean_lz4_decompress_block"]
+opaque Internal.lz4DecompressBlock (block : @& ByteArray) (size : USize) : Option ByteArray */
+extern "C" LEAN_EXPORT obj_res lean_lz4_decompress_block(b_obj_arg block, usize size) {
+    object * r = alloc_sarray(1, size, size);
+    if (!lz4_decompress_block(reinterpret_cast<char const *>(sarray_cptr(block)), sarray_size(block),
+                              reinterpret_cast<char *>(sarray_cptr(r)), size)) {
+        dec(r);
+        return mk_option_none();
     }
+    return mk_option_some(r);
 }
 
 /*
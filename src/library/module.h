@@ -15,4 +15,10 @@ Authors: Leonardo de Moura, Gabriel Ebner, Sebastian Ullrich
 namespace lean {
 /** \brief Store module using \c env. */
 void write_module(environment const & env, std::string const & olean_fn);
+
+/** \brief Write an object pool containing the objects that occur in multiple of the given .olean files to \c pool_fn.
+
+    Modules written while the environment variable \c LEAN_OLEAN_POOL names the pool reference its objects instead of
+    storing copies of them, and can only be read with the same pool. */
+void write_olean_pool(std::string const & pool_fn, std::vector<std::string> const & olean_fns);
 }
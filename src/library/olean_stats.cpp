@@ -0,0 +1,259 @@
+/*
+Copyright (c) 2023 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "runtime/compact.h"
+#include "runtime/object_ref.h"
+#include "runtime/string_ref.h"
+#include "util/escaped.h"
+#include "util/io.h"
+#include "util/name.h"
+#include "library/olean_stats.h"
+
+/* Maximum number of entries in each of the ranked lists of the output. */
+#define LEAN_OLEAN_STATS_TOP 50
+
+namespace lean {
+extern "C" object * lean_read_module_data(object * fname, object *);
+
+namespace {
+struct obj_stats {
+    size_t m_objects = 0;
+    size_t m_bytes   = 0;
+    void add(size_t sz) { m_objects++; m_bytes += sz; }
+    void add(obj_stats const & s) { m_objects += s.m_objects; m_bytes += s.m_bytes; }
+};
+
+/* Constructor objects are grouped by tag, number of object fields, and total size. */
+typedef std::tuple<unsigned, unsigned, size_t> ctor_shape;
+
+static char const * g_kind_names[] = {
+    "ctor", "closure", "array", "structArray", "scalarArray", "string", "mpz", "thunk", "task", "ref", "external", "reserved"
+};
+constexpr unsigned g_num_kinds = sizeof(g_kind_names) / sizeof(g_kind_names[0]);
+
+static unsigned kind_of(object * o) {
+    unsigned tag = lean_ptr_tag(o);
+    return tag <= LeanMaxCtorTag ? 0 : tag - LeanMaxCtorTag;
+}
+
+/* Size of `o` in a compacted region, see `compacted_region::move`. */
+static size_t compacted_size(object * o) {
+    size_t sz  = lean_object_byte_size(o);
+    size_t rem = sz % sizeof(void*);
+    return rem == 0 ? sz : sz + sizeof(void*) - rem;
+}
+
+/* Walks the object graph of a single module. Every object is only counted once, and is attributed to the first
+   `walk` that reaches it. */
+class olean_walker {
+    std::unordered_set<object *> m_visited;
+    std::vector<object *>        m_todo;
+    void push(object * o) {
+        if (!lean_is_scalar(o) && m_visited.insert(o).second)
+            m_todo.push_back(o);
+    }
+public:
+    obj_stats                         m_kinds[g_num_kinds];
+    std::map<ctor_shape, obj_stats>   m_ctors;
+    std::vector<std::pair<std::string, size_t>> m_strings;
+
+    obj_stats walk(object * o) {
+        obj_stats r;
+        push(o);
+        while (!m_todo.empty()) {
+            object * curr = m_todo.back();
+            m_todo.pop_back();
+            size_t sz     = compacted_size(curr);
+            unsigned kind = kind_of(curr);
+            r.add(sz);
+            m_kinds[kind].add(sz);
+            if (kind == 0) {
+                unsigned num_objs = lean_ctor_num_objs(curr);
+                m_ctors[ctor_shape(lean_ptr_tag(curr), num_objs, sz)].add(sz);
+                for (unsigned i = 0; i < num_objs; i++)
+                    push(lean_ctor_get(curr, i));
+            } else {
+                switch (lean_ptr_tag(curr)) {
+                case LeanArray:
+                    for (size_t i = 0; i < lean_array_size(curr); i++)
+                        push(lean_array_get_core(curr, i));
+                    break;
+                case LeanString: m_strings.emplace_back(std::string(lean_string_cstr(curr), lean_string_size(curr) - 1), sz); break;
+                case LeanThunk:  push(lean_to_thunk(curr)->m_value); break;
+                case LeanRef:    push(lean_to_ref(curr)->m_value); break;
+                case LeanTask:   push(lean_to_task(curr)->m_value); break;
+                default:         break;
+                }
+            }
+        }
+        return r;
+    }
+};
+
+struct named_stats {
+    std::string m_name;
+    obj_stats   m_stats;
+};
+
+/* Sort by decreasing size, and by name for a deterministic output. */
+static void sort_by_size(std::vector<named_stats> & v) {
+    std::sort(v.begin(), v.end(), [](named_stats const & a, named_stats const & b) {
+        return a.m_stats.m_bytes != b.m_stats.m_bytes ? a.m_stats.m_bytes > b.m_stats.m_bytes : a.m_name < b.m_name;
+    });
+}
+
+static void print_stats(std::ostream & out, obj_stats const & s) {
+    out << "\"objects\": " << s.m_objects << ", \"bytes\": " << s.m_bytes;
+}
+
+static void print_named_stats(std::ostream & out, char const * indent, std::vector<named_stats> const & v) {
+    out << "[";
+    for (size_t i = 0; i < v.size() && i < LEAN_OLEAN_STATS_TOP; i++) {
+        out << (i == 0 ? "\n" : ",\n") << indent << "{\"name\": ";
+        out << json_escaped(v[i].m_name);
+        out << ", ";
+        print_stats(out, v[i].m_stats);
+        out << "}";
+    }
+    out << "]";
+}
+
+static size_t file_size(std::string const & fn) {
+    std::ifstream in(fn, std::ios_base::binary | std::ios_base::ate);
+    return in ? static_cast<size_t>(in.tellg()) : 0;
+}
+
+struct string_occurrences {
+    unsigned m_files = 0;
+    size_t   m_bytes = 0;
+};
+
+/* Print the statistics of a single .olean file, and record the strings it contains in `strings`. */
+static void print_file_stats(std::ostream & out, std::string const & fn,
+                             std::unordered_map<std::string, string_occurrences> & strings) {
+    string_ref fname(fn);
+    object_ref r = get_io_result<object_ref>(lean_read_module_data(fname.raw(), io_mk_world()));
+    compacted_region * region = reinterpret_cast<compacted_region *>(unbox_size_t(cnstr_get(r.raw(), 1)));
+    object * mdata       = cnstr_get(r.raw(), 0);
+    object * const_names = cnstr_get(mdata, 1);
+    object * constants   = cnstr_get(mdata, 2);
+    object * entries     = cnstr_get(mdata, 4);
+
+    olean_walker walker;
+    std::vector<named_stats> decls;
+    obj_stats decls_total;
+    for (size_t i = 0; i < array_size(constants); i++) {
+        obj_stats s = walker.walk(array_get(constants, i));
+        decls.push_back(named_stats { name(array_get(const_names, i), true).to_string(), s });
+        decls_total.add(s);
+    }
+    std::vector<named_stats> exts;
+    for (size_t i = 0; i < array_size(entries); i++) {
+        object * entry = array_get(entries, i);
+        exts.push_back(named_stats { name(cnstr_get(entry, 0), true).to_string(), walker.walk(entry) });
+    }
+    /* imports, constant names not shared with `constants`, and the arrays themselves */
+    obj_stats other = walker.walk(mdata);
+    obj_stats total = other;
+    total.add(decls_total);
+    for (named_stats const & e : exts)
+        total.add(e.m_stats);
+    sort_by_size(decls);
+    sort_by_size(exts);
+
+    out << "  {\"file\": ";
+    out << json_escaped(fn);
+    out << ", \"fileBytes\": " << file_size(fn) << ", ";
+    print_stats(out, total);
+    out << ",\n   \"kinds\": {";
+    bool first = true;
+    for (unsigned k = 0; k < g_num_kinds; k++) {
+        if (walker.m_kinds[k].m_objects == 0) continue;
+        out << (first ? "" : ", ") << "\"" << g_kind_names[k] << "\": {";
+        print_stats(out, walker.m_kinds[k]);
+        out << "}";
+        first = false;
+    }
+    out << "},\n   \"constructors\": [";
+    std::vector<std::pair<ctor_shape, obj_stats>> ctors(walker.m_ctors.begin(), walker.m_ctors.end());
+    std::stable_sort(ctors.begin(), ctors.end(), [](std::pair<ctor_shape, obj_stats> const & a, std::pair<ctor_shape, obj_stats> const & b) {
+        return a.second.m_bytes > b.second.m_bytes;
+    });
+    for (size_t i = 0; i < ctors.size() && i < LEAN_OLEAN_STATS_TOP; i++) {
+        out << (i == 0 ? "\n" : ",\n") << "     {\"tag\": " << std::get<0>(ctors[i].first)
+            << ", \"numObjs\": " << std::get<1>(ctors[i].first) << ", \"size\": " << std::get<2>(ctors[i].first) << ", ";
+        print_stats(out, ctors[i].second);
+        out << "}";
+    }
+    out << "],\n   \"declarations\": {\"count\": " << decls.size() << ", ";
+    print_stats(out, decls_total);
+    out << ", \"top\": ";
+    print_named_stats(out, "     ", decls);
+    out << "},\n   \"extensions\": ";
+    print_named_stats(out, "     ", exts);
+    out << ",\n   \"other\": {";
+    print_stats(out, other);
+    out << "}}";
+
+    std::unordered_set<std::string> seen;
+    for (auto const & s : walker.m_strings) {
+        if (seen.insert(s.first).second) {
+            string_occurrences & occ = strings[s.first];
+            occ.m_files++;
+            occ.m_bytes = s.second;
+        }
+    }
+    r = object_ref();
+    delete region;
+}
+}
+
+void print_olean_stats(std::ostream & res, std::vector<std::string> const & olean_fns) {
+    std::unordered_map<std::string, string_occurrences> strings;
+    /* only write the result once all files have been read successfully */
+    std::ostringstream out;
+    out << "{\"files\": [\n";
+    for (size_t i = 0; i < olean_fns.size(); i++) {
+        if (i > 0) out << ",\n";
+        print_file_stats(out, olean_fns[i], strings);
+    }
+    out << "],\n";
+
+    /* Strings stored in more than one file; the redundant copies could be shared by a cross-module pool. */
+    std::vector<std::pair<std::string, string_occurrences>> dups;
+    obj_stats redundant;
+    for (auto const & p : strings) {
+        if (p.second.m_files > 1) {
+            dups.push_back(p);
+            redundant.m_objects += p.second.m_files - 1;
+            redundant.m_bytes   += (p.second.m_files - 1) * p.second.m_bytes;
+        }
+    }
+    std::sort(dups.begin(), dups.end(), [](std::pair<std::string, string_occurrences> const & a,
+                                           std::pair<std::string, string_occurrences> const & b) {
+        size_t wa = (a.second.m_files - 1) * a.second.m_bytes;
+        size_t wb = (b.second.m_files - 1) * b.second.m_bytes;
+        return wa != wb ? wa > wb : a.first < b.first;
+    });
+    out << " \"duplicateStrings\": {\"count\": " << dups.size() << ", \"redundantObjects\": " << redundant.m_objects
+        << ", \"redundantBytes\": " << redundant.m_bytes << ", \"top\": [";
+    for (size_t i = 0; i < dups.size() && i < LEAN_OLEAN_STATS_TOP; i++) {
+        out << (i == 0 ? "\n" : ",\n") << "   {\"value\": ";
+        out << json_escaped(dups[i].first);
+        out << ", \"files\": " << dups[i].second.m_files << ", \"bytes\": " << dups[i].second.m_bytes << "}";
+    }
+    out << "]}}\n";
+    res << out.str();
+}
+}
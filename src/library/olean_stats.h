@@ -0,0 +1,17 @@
+/*
+Copyright (c) 2023 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace lean {
+/** \brief Print size and composition statistics of the given .olean files to \c out as a JSON object.
+
+    For each file, this reports the number of objects and bytes per object kind, the most common constructor shapes,
+    and the bytes contributed by each declaration and environment extension. Across all files, it reports the strings
+    stored in more than one of them. The output is deterministic so that it can be diffed between builds. */
+void print_olean_stats(std::ostream & out, std::vector<std::string> const & olean_fns);
+}
@@ -6,18 +6,49 @@ Author: Sebastian Ullrich
 */
 #include <string>
 #include <map>
+#include <utility>
+#include "runtime/alloc.h"
+#include "runtime/memory.h"
+#include "util/escaped.h"
 #include "library/time_task.h"
 #include "library/trace.h"
 
 namespace lean {
 
-static std::map<std::string, second_duration> * g_cum_times;
+struct profile_entry {
+    second_duration m_time {0};
+    uint64          m_heartbeats = 0;
+    uint64          m_count      = 0;
+    void add(second_duration time, uint64 heartbeats) {
+        m_time += time;
+        m_heartbeats += heartbeats;
+        m_count++;
+    }
+};
+
+/* times of the tasks displayed because of the `profiler` option */
+static std::map<std::string, profile_entry> * g_cum_times;
+/* times of all tasks by category, and by declaration and category, only used if `g_profiling_json` is set */
+static std::map<std::string, profile_entry> * g_json_times;
+static std::map<std::pair<std::string, std::string>, profile_entry> * g_decl_times;
 static mutex * g_cum_times_mutex;
+static bool g_profiling_json = false;
 LEAN_THREAD_PTR(time_task, g_current_time_task);
 
-void report_profiling_time(std::string const & category, second_duration time) {
+static void report_profiling_time(std::string const & category, name const & decl, second_duration time,
+                                  uint64 heartbeats, bool display) {
     lock_guard<mutex> _(*g_cum_times_mutex);
-    (*g_cum_times)[category] += time;
+    if (display)
+        (*g_cum_times)[category].add(time, heartbeats);
+    if (g_profiling_json) {
+        (*g_json_times)[category].add(time, heartbeats);
+        if (decl)
+            (*g_decl_times)[std::make_pair(decl.to_string(), category)].add(time, heartbeats);
+    }
+}
+
+void report_profiling_time(std::string const & category, second_duration time, bool display) {
+    report_profiling_time(category, name(), time, 0, display);
 }
 
 void display_cumulative_profiling_times(std::ostream & out) {
@@ -26,33 +57,79 @@ void display_cumulative_profiling_times(std::ostream & out) {
     sstream ss;
     ss << "cumulative profiling times:\n";
     for (auto const & p : *g_cum_times)
-        ss << "\t" << p.first << " " << display_profiling_time{p.second} << "\n";
+        ss << "\t" << p.first << " " << display_profiling_time{p.second.m_time} << "\n";
     // output atomically, like IO.print
     out << ss.str();
 }
 
+void enable_profiling_json() {
+    g_profiling_json = true;
+}
+
+static void write_profile_entry(std::ostream & out, profile_entry const & e) {
+    out << "\"seconds\": " << e.m_time.count() << ", \"heartbeats\": " << e.m_heartbeats << ", \"count\": " << e.m_count;
+}
+
+void write_profiling_json(std::ostream & out) {
+    lock_guard<mutex> _(*g_cum_times_mutex);
+    out << "{\"categories\": [";
+    bool first = true;
+    for (auto const & p : *g_json_times) {
+        out << (first ? "\n" : ",\n") << "  {\"name\": " << json_escaped(p.first) << ", ";
+        write_profile_entry(out, p.second);
+        out << "}";
+        first = false;
+    }
+    out << "],\n \"declarations\": [";
+    first = true;
+    for (auto const & p : *g_decl_times) {
+        out << (first ? "\n" : ",\n") << "  {\"name\": " << json_escaped(p.first.first)
+            << ", \"category\": " << json_escaped(p.first.second) << ", ";
+        write_profile_entry(out, p.second);
+        out << "}";
+        first = false;
+    }
+    alloc_counters c = get_alloc_counters();
+    out << "],\n \"peakRss\": " << get_peak_rss() << ",\n"
+        << " \"allocator\": {\"segments\": " << c.m_num_segments << ", \"pages\": " << c.m_num_pages
+        << ", \"recycledPages\": " << c.m_num_recycled_pages << ", \"alloc\": " << c.m_num_alloc
+        << ", \"smallAlloc\": " << c.m_num_small_alloc << ", \"dealloc\": " << c.m_num_dealloc
+        << ", \"smallDealloc\": " << c.m_num_small_dealloc << ", \"exports\": " << c.m_num_exports << "}}\n";
+}
+
 void initialize_time_task() {
     g_cum_times_mutex = new mutex;
-    g_cum_times = new std::map<std::string, second_duration>;
+    g_cum_times = new std::map<std::string, profile_entry>;
+    g_json_times = new std::map<std::string, profile_entry>;
+    g_decl_times = new std::map<std::pair<std::string, std::string>, profile_entry>;
 }
 
 void finalize_time_task() {
+    delete g_decl_times;
+    delete g_json_times;
     delete g_cum_times;
     delete g_cum_times_mutex;
 }
 
 time_task::time_task(std::string const & category, options const & opts, name decl) :
-        m_category(category) {
-    if (get_profiler(opts)) {
-        m_timeit = optional<xtimeit>(get_profiling_threshold(opts), [=](second_duration duration) mutable {
-            sstream ss;
-            ss << m_category;
-            if (decl)
-                ss << " of " << decl;
-            ss << " took " << display_profiling_time{duration} << "\n";
-            // output atomically, like IO.print
-            tout() << ss.str();
-        });
+        m_category(category), m_decl(decl) {
+    bool display = get_profiler(opts);
+    if (display || g_profiling_json) {
+        std::function<void(second_duration)> fn; // NOLINT
+        if (display) {
+            fn = [=](second_duration duration) mutable {
+                sstream ss;
+                ss << m_category;
+                if (decl)
+                    ss << " of " << decl;
+                ss << " took " << display_profiling_time{duration} << "\n";
+                // output atomically, like IO.print
+                tout() << ss.str();
+            };
+        }
+        m_display = display;
+        m_timeit = optional<xtimeit>(get_profiling_threshold(opts), fn);
+        m_start_heartbeats = get_num_heartbeats();
         m_parent_task = g_current_time_task;
         g_current_time_task = this;
     }
@@ -61,10 +138,14 @@ time_task::time_task(std::string const & category, options const & opts, name de
 time_task::~time_task() {
     if (m_timeit) {
         g_current_time_task = m_parent_task;
-        report_profiling_time(m_category, m_timeit->get_elapsed());
-        if (m_parent_task && m_parent_task->m_timeit)
+        uint64 heartbeats = get_num_heartbeats() - m_start_heartbeats;
+        report_profiling_time(m_category, m_decl, m_timeit->get_elapsed(), heartbeats - m_child_heartbeats,
+                              m_display);
+        if (m_parent_task && m_parent_task->m_timeit) {
             // report exclusive times
             m_parent_task->m_timeit->exclude_duration(m_timeit->get_elapsed_inclusive());
+            m_parent_task->m_child_heartbeats += heartbeats;
+        }
     }
 }
 
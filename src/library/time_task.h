@@ -11,14 +11,26 @@ Author: Sebastian Ullrich
 #include "util/message_definitions.h"
 
 namespace lean {
-void report_profiling_time(std::string const & category, second_duration time);
+/** \brief Report the time of a task not measured by `time_task`. If \c display is false, it is only recorded for
+    `write_profiling_json`. */
+void report_profiling_time(std::string const & category, second_duration time, bool display = true);
 void display_cumulative_profiling_times(std::ostream & out);
+/** \brief Record the times and heartbeats of all tasks for `write_profiling_json`, even where the `profiler` option
+    is not set. Per-declaration data is only recorded while this is enabled. */
+void enable_profiling_json();
+/** \brief Write the cumulative times and heartbeats per category and per declaration, the peak resident set size,
+    and the allocator counters to \c out as a JSON object. */
+void write_profiling_json(std::ostream & out);
 
 /** Measure time of some task and report it for the final cumulative profile. */
 class time_task {
     std::string     m_category;
+    name            m_decl;
     optional<xtimeit> m_timeit;
+    bool            m_display = false; // whether the `profiler` option is set
     time_task *     m_parent_task;
+    uint64          m_start_heartbeats;
+    uint64          m_child_heartbeats = 0; // heartbeats of nested tasks, which are excluded like their times
 public:
     time_task(std::string const & category, options const & opts, name decl = name());
     ~time_task();
@@ -8,6 +8,7 @@ Author: Leonardo de Moura
 #include <lean/lean.h>
 #include "runtime/thread.h"
 #include "runtime/debug.h"
+#include "runtime/int64.h"
 #include "runtime/alloc.h"
 
 #ifdef LEAN_RUNTIME_STATS
@@ -35,15 +36,16 @@ namespace lean {
 #ifdef LEAN_SMALL_ALLOCATOR
 
 namespace allocator {
+/* These are only updated when a segment or page is allocated or recycled, so we always maintain them. */
+static atomic<uint64> g_num_segments(0);
+static atomic<uint64> g_num_pages(0);
+static atomic<uint64> g_num_recycled_pages(0);
 #ifdef LEAN_RUNTIME_STATS
 static atomic<uint64> g_num_alloc(0);
 static atomic<uint64> g_num_small_alloc(0);
 static atomic<uint64> g_num_dealloc(0);
 static atomic<uint64> g_num_small_dealloc(0);
-static atomic<uint64> g_num_segments(0);
-static atomic<uint64> g_num_pages(0);
 static atomic<uint64> g_num_exports(0);
-static atomic<uint64> g_num_recycled_pages(0);
 struct alloc_stats {
     ~alloc_stats() {
         std::cerr << "num. alloc.:         " << g_num_alloc << "\n";
@@ -210,7 +212,7 @@ void page::push_free_obj(void * o) {
         heap * h = get_heap();
         unsigned slot_idx = m_header.m_slot_idx;
         if (this != h->m_curr_page[slot_idx]) {
-            LEAN_RUNTIME_STAT_CODE(g_num_recycled_pages++);
+            g_num_recycled_pages++;
             m_header.m_in_page_free_list = true;
             page_list_remove(h->m_curr_page[slot_idx], this);
             page_list_insert(h->m_page_free_list[slot_idx], this);
@@ -270,7 +272,7 @@ void heap::export_objs() {
 }
 
 void heap::alloc_segment() {
-    LEAN_RUNTIME_STAT_CODE(g_num_segments++);
+    g_num_segments++;
     segment * s = new segment();
     s->m_next   = m_curr_segment;
     m_curr_segment = s;
@@ -279,7 +281,7 @@ void heap::alloc_segment() {
 static page * alloc_page(heap * h, unsigned obj_size) {
     lean_assert(lean_align(obj_size, LEAN_OBJECT_SIZE_DELTA) == obj_size);
     segment * s = h->m_curr_segment;
-    LEAN_RUNTIME_STAT_CODE(g_num_pages++);
+    g_num_pages++;
     page * p    = new (s->m_next_page_mem) page();
     s->m_next_page_mem += LEAN_PAGE_SIZE;
     if (s->is_full()) {
@@ -488,4 +490,20 @@ uint64_t get_num_heartbeats() {
 #endif
 }
 
+alloc_counters get_alloc_counters() {
+    alloc_counters r;
+#ifdef LEAN_SMALL_ALLOCATOR
+    r.m_num_segments       = g_num_segments;
+    r.m_num_pages          = g_num_pages;
+    r.m_num_recycled_pages = g_num_recycled_pages;
+#ifdef LEAN_RUNTIME_STATS
+    r.m_num_alloc          = g_num_alloc;
+    r.m_num_small_alloc    = g_num_small_alloc;
+    r.m_num_dealloc        = g_num_dealloc;
+    r.m_num_small_dealloc  = g_num_small_dealloc;
+    r.m_num_exports        = g_num_exports;
+#endif
+#endif
+    return r;
+}
 }
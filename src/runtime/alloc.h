@@ -13,6 +13,20 @@ void init_thread_heap();
 void * alloc(size_t sz);
 void dealloc(void * o, size_t sz);
 uint64_t get_num_heartbeats();
+
+/* Process-wide counters of the small object allocator. They are all zero if it is disabled, and the ones below
+   `m_num_alloc` are only maintained if Lean was built with `RUNTIME_STATS=ON`. */
+struct alloc_counters {
+    uint64_t m_num_segments{0};
+    uint64_t m_num_pages{0};
+    uint64_t m_num_recycled_pages{0};
+    uint64_t m_num_alloc{0};
+    uint64_t m_num_small_alloc{0};
+    uint64_t m_num_dealloc{0};
+    uint64_t m_num_small_dealloc{0};
+    uint64_t m_num_exports{0};
+};
+alloc_counters get_alloc_counters();
 void initialize_alloc();
 void finalize_alloc();
 }
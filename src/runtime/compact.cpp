@@ -4,68 +4,221 @@ Released under Apache 2.0 license as described in the file LICENSE.
 
 Author: Leonardo de Moura
 */
-#include <unordered_set>
 #include <algorithm>
 #include <string>
 #include <vector>
 #include <cstring>
+#include <memory>
 #include <lean/lean.h>
 #include "runtime/hash.h"
+#include "runtime/thread.h"
+#include "runtime/exception.h"
+#include "runtime/sstream.h"
 #include "runtime/compact.h"
+#include "runtime/flat_hash_table.h"
 
 #ifndef LEAN_WINDOWS
 #include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
 #endif
 
 #define LEAN_COMPACTOR_INIT_SZ 1024*1024
-#define LEAN_MAX_SHARING_TABLE_INITIAL_SIZE 1024*1024
+// initial capacities of the hash tables of `object_compactor`, must be powers of two
+#define LEAN_OBJ_TABLE_INITIAL_SIZE 4096
+#define LEAN_MAX_SHARING_TABLE_INITIAL_SIZE 4096
+// minimum number of relocation table entries processed by each thread in `compacted_region::apply_relocations`
+#define LEAN_RELOC_MIN_PER_THREAD 256*1024
+// minimum number of subgraphs for `object_compactor::copy_in_parallel` to use multiple threads
+#define LEAN_PAR_COMPACT_MIN_ITEMS 64
+// number of chunks created by `object_compactor::copy_in_parallel`, independent of the number of threads so that the
+// result is reproducible
+#define LEAN_PAR_COMPACT_CHUNKS 64
 
 // uncomment to track the number of each kind of object in an .olean file
 // #define LEAN_TAG_COUNTERS
 
 namespace lean {
 
-struct max_sharing_key {
-    size_t m_offset;
-    size_t m_size;
-    max_sharing_key(size_t offset, size_t sz):m_offset(offset), m_size(sz) {}
+struct obj_table_entry {
+    object *      m_key   = nullptr;
+    object_offset m_value = nullptr;
+    bool empty() const { return m_key == nullptr; }
+    uint64 hash() const { return reinterpret_cast<size_t>(m_key); }
 };
 
-struct max_sharing_hash {
-    object_compactor * m;
-    max_sharing_hash(object_compactor * manager):m(manager) {}
-    unsigned operator()(max_sharing_key const & k) const {
-        return hash_str(k.m_size, reinterpret_cast<unsigned char const *>(m->m_begin) + k.m_offset, 17);
+struct object_compactor::obj_table : public flat_hash_table<obj_table_entry> {
+    obj_table():flat_hash_table(LEAN_OBJ_TABLE_INITIAL_SIZE) {}
+    object_offset const * find(object * o) const {
+        obj_table_entry const * e = flat_hash_table::find(reinterpret_cast<size_t>(o), [&](obj_table_entry const & e) { return e.m_key == o; });
+        return e ? &e->m_value : nullptr;
     }
 };
 
-struct max_sharing_eq {
-    object_compactor * m;
-    max_sharing_eq(object_compactor * manager):m(manager) {}
-    bool operator()(max_sharing_key const & k1, max_sharing_key const & k2) const {
-        if (k1.m_size != k2.m_size) return false;
-        return memcmp(reinterpret_cast<char*>(m->m_begin) + k1.m_offset, reinterpret_cast<char*>(m->m_begin) + k2.m_offset, k1.m_size) == 0;
-    }
+/* An object in the compacted region, identified by its offset and size; objects are never empty. */
+struct max_sharing_entry {
+    size_t m_offset = 0;
+    size_t m_size   = 0;
+    uint64 m_hash   = 0;
+    bool empty() const { return m_size == 0; }
+    uint64 hash() const { return m_hash; }
 };
 
+struct object_compactor::max_sharing_table : public flat_hash_table<max_sharing_entry> {
+    max_sharing_table():flat_hash_table(LEAN_MAX_SHARING_TABLE_INITIAL_SIZE) {}
+};
 
-struct object_compactor::max_sharing_table {
-    std::unordered_set<max_sharing_key, max_sharing_hash, max_sharing_eq> m_table;
-    max_sharing_table(object_compactor * manager):
-        m_table(LEAN_MAX_SHARING_TABLE_INITIAL_SIZE, max_sharing_hash(manager), max_sharing_eq(manager)) {
-    }
+struct object_pool::table : public flat_hash_table<max_sharing_entry> {
+    table():flat_hash_table(LEAN_MAX_SHARING_TABLE_INITIAL_SIZE) {}
 };
 
+/* Size of the compacted object `o`, including the limbs of `mpz` objects, see `compacted_region::fix_mpz`. */
+size_t object_pool::compacted_object_size(object * o) {
+    if (lean_ptr_tag(o) == LeanMPZ) {
+#ifdef LEAN_USE_GMP
+        return sizeof(mpz_object) + sizeof(mp_limb_t) * mpz_size(to_mpz(o)->m_value.m_val);
+#else
+        return sizeof(mpz_object) + sizeof(mpn_digit) * to_mpz(o)->m_value.m_size;
+#endif
+    }
+    return lean_object_byte_size(o);
+}
+
+object_pool::object_pool(void const * data, size_t sz, void const * base_addr):
+    m_table(new table()),
+    m_begin(static_cast<char const *>(data)),
+    m_end(static_cast<char const *>(data) + sz),
+    m_base_addr(static_cast<char const *>(base_addr)) {
+    // index the objects that `object_compactor::share` would share, skipping the root slot
+    for (size_t offset = sizeof(object_offset); offset < sz;) {
+        object * o   = reinterpret_cast<object *>(const_cast<char *>(m_begin) + offset);
+        size_t o_sz  = compacted_object_size(o);
+        uint8 tag    = lean_ptr_tag(o);
+        if (tag <= LeanMaxCtorTag || tag == LeanArray || tag == LeanScalarArray || tag == LeanString) {
+            max_sharing_entry e;
+            e.m_offset = offset;
+            e.m_size   = o_sz;
+            e.m_hash   = hash_bytes(o_sz, reinterpret_cast<unsigned char const *>(o), 17);
+            m_table->insert(e);
+        }
+        size_t rem = o_sz % sizeof(void*);
+        offset += rem == 0 ? o_sz : o_sz + sizeof(void*) - rem;
+    }
+}
+
+object_pool::~object_pool() {}
+
+object * object_pool::find(object const * o, size_t sz, uint64 h) const {
+    max_sharing_entry const * it = m_table->find(h, [&](max_sharing_entry const & e) {
+        return e.m_hash == h && e.m_size == sz && memcmp(m_begin + e.m_offset, o, sz) == 0;
+    });
+    return it ? reinterpret_cast<object *>(const_cast<char *>(m_begin) + it->m_offset) : nullptr;
+}
+
 object_compactor::object_compactor(void * base_addr):
-    m_max_sharing_table(new max_sharing_table(this)),
+    m_obj_table(new obj_table()),
+    m_max_sharing_table(new max_sharing_table()),
+    m_pool(nullptr),
     m_base_addr(base_addr),
     m_begin(malloc(LEAN_COMPACTOR_INIT_SZ)),
     m_end(m_begin),
-    m_capacity(static_cast<char*>(m_begin) + LEAN_COMPACTOR_INIT_SZ) {
+    m_capacity(static_cast<char*>(m_begin) + LEAN_COMPACTOR_INIT_SZ),
+    m_fd(-1),
+    m_file_offset(0) {
+}
+
+#ifndef LEAN_WINDOWS
+/* Resize the file `fd` to `file_offset + new_capacity` bytes and return a pointer to offset `file_offset` of a shared
+   mapping of it. `old_begin` is the result of the previous call for the same file (with `old_capacity`), if any. */
+static void * map_compactor_file(int fd, size_t file_offset, void * old_begin, size_t old_capacity, size_t new_capacity) {
+    // Allocate the new blocks now: writing to a hole of a shared mapping on a full disk raises SIGBUS instead of
+    // reporting an error.
+    size_t old_size = old_begin == nullptr ? 0 : file_offset + old_capacity;
+#if defined(__APPLE__)
+    int err = EOPNOTSUPP;
+#else
+    int err = posix_fallocate(fd, old_size, file_offset + new_capacity - old_size);
+#endif
+    if (err == EOPNOTSUPP || err == EINVAL) {
+        // the file system cannot allocate blocks in advance
+        if (ftruncate(fd, file_offset + new_capacity) != 0)
+            throw exception(sstream() << "failed to resize compacted region file: " << strerror(errno));
+    } else if (err != 0) {
+        throw exception(sstream() << "failed to resize compacted region file: " << strerror(err));
+    }
+    void * map;
+    if (old_begin == nullptr) {
+        map = mmap(nullptr, file_offset + new_capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    } else {
+        void * old_map = static_cast<char*>(old_begin) - file_offset;
+#ifdef __linux__
+        map = mremap(old_map, file_offset + old_capacity, file_offset + new_capacity, MREMAP_MAYMOVE);
+#else
+        lean_always_assert(munmap(old_map, file_offset + old_capacity) == 0);
+        map = mmap(nullptr, file_offset + new_capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+#endif
+    }
+    if (map == MAP_FAILED)
+        throw exception(sstream() << "failed to map compacted region file: " << strerror(errno));
+    return static_cast<char*>(map) + file_offset;
+}
+#endif
+
+object_compactor::object_compactor(void * base_addr, int fd, size_t file_offset):
+    m_obj_table(new obj_table()),
+    m_max_sharing_table(new max_sharing_table()),
+    m_pool(nullptr),
+    m_base_addr(base_addr),
+    m_fd(fd),
+    m_file_offset(file_offset) {
+#ifdef LEAN_WINDOWS
+    throw exception("writing compacted regions directly to files is not supported on this platform");
+#else
+    m_begin    = map_compactor_file(fd, file_offset, nullptr, 0, LEAN_COMPACTOR_INIT_SZ);
+    m_end      = m_begin;
+    m_capacity = static_cast<char*>(m_begin) + LEAN_COMPACTOR_INIT_SZ;
+#endif
 }
 
 object_compactor::~object_compactor() {
-    free(m_begin);
+    if (m_fd == -1) {
+        free(m_begin);
+    } else {
+#ifndef LEAN_WINDOWS
+        munmap(static_cast<char*>(m_begin) - m_file_offset, m_file_offset + capacity());
+#endif
+    }
+}
+
+void object_compactor::sync() {
+#ifndef LEAN_WINDOWS
+    if (m_fd != -1 && msync(static_cast<char*>(m_begin) - m_file_offset, m_file_offset + capacity(), MS_SYNC) != 0)
+        throw exception(sstream() << "failed to write compacted region file: " << strerror(errno));
+#endif
+}
+
+void object_compactor::reserve(size_t num_objects) {
+    m_obj_table->reserve(num_objects);
+    m_max_sharing_table->reserve(num_objects);
+}
+
+void object_compactor::grow(size_t new_capacity) {
+    size_t sz = size();
+    void * new_begin;
+    if (m_fd == -1) {
+        new_begin = malloc(new_capacity);
+        memcpy(new_begin, m_begin, sz);
+        free(m_begin);
+    } else {
+#ifdef LEAN_WINDOWS
+        lean_unreachable();
+#else
+        new_begin = map_compactor_file(m_fd, m_file_offset, m_begin, capacity(), new_capacity);
+#endif
+    }
+    m_begin    = new_begin;
+    m_end      = static_cast<char*>(new_begin) + sz;
+    m_capacity = static_cast<char*>(new_begin) + new_capacity;
 }
 
 /*
@@ -80,13 +233,7 @@ void * object_compactor::alloc(size_t sz) {
     if (rem != 0)
         sz = sz + sizeof(void*) - rem;
     while (static_cast<char*>(m_end) + sz > m_capacity) {
-        size_t new_capacity = capacity()*2;
-        void * new_begin = malloc(new_capacity);
-        memcpy(new_begin, m_begin, size());
-        m_end      = static_cast<char*>(new_begin) + size();
-        m_capacity = static_cast<char*>(new_begin) + new_capacity;
-        free(m_begin);
-        m_begin    = new_begin;
+        grow(capacity()*2);
     }
     void * r = m_end;
     memset(r, 0, sz);
@@ -95,33 +242,85 @@ void * object_compactor::alloc(size_t sz) {
     return r;
 }
 
-void object_compactor::save(object * o, object * new_o) {
-    lean_assert(m_begin <= new_o && new_o < m_end);
-    m_obj_table.insert(std::make_pair(o, reinterpret_cast<object_offset>(reinterpret_cast<char*>(new_o) - reinterpret_cast<char*>(m_begin) + reinterpret_cast<size_t>(m_base_addr))));
+/* Record that `field`, a word of the compacted region, stores a pointer into the region or the pool unless it holds a
+   scalar. */
+inline void object_compactor::add_reloc(void * field) {
+    lean_assert(m_begin <= field && field < m_end);
+    object * v = *static_cast<object **>(field);
+    if (lean_is_scalar(v))
+        return;
+    size_t offset = static_cast<char*>(field) - static_cast<char*>(m_begin);
+    if (m_pool && m_pool->contains(v))
+        m_pool_relocs.push_back(offset);
+    else
+        m_relocs.push_back(offset);
 }
 
-void object_compactor::save_max_sharing(object * o, object * new_o, size_t new_o_sz) {
-    max_sharing_key k(reinterpret_cast<char*>(new_o) - reinterpret_cast<char*>(m_begin), new_o_sz);
-    auto it = m_max_sharing_table->m_table.find(k);
-    if (it != m_max_sharing_table->m_table.end()) {
-        m_end = new_o;
+void object_compactor::save(object * o, object * new_o) {
+    obj_table_entry e;
+    e.m_key = o;
+    if (m_pool && m_pool->contains(new_o)) {
+        e.m_value = new_o;
+    } else {
+        lean_assert(m_begin <= new_o && new_o < m_end);
+        e.m_value = reinterpret_cast<object_offset>(reinterpret_cast<char*>(new_o) - reinterpret_cast<char*>(m_begin) + reinterpret_cast<size_t>(m_base_addr));
+    }
+    m_obj_table->insert(e);
+}
+
+/* Remove `new_o`, which must be the last allocated object, and its relocations. */
+void object_compactor::discard(object * new_o) {
+    size_t new_o_offset = reinterpret_cast<char*>(new_o) - static_cast<char*>(m_begin);
+    while (!m_relocs.empty() && m_relocs.back() >= new_o_offset)
+        m_relocs.pop_back();
+    while (!m_pool_relocs.empty() && m_pool_relocs.back() >= new_o_offset)
+        m_pool_relocs.pop_back();
+    m_end = new_o;
+}
+
+/* Return an object in the pool or the compacted region structurally equal to the `new_o_sz` bytes at `new_o`, which
+   must be the last allocated object. If there is none, `new_o` is kept and returned. */
+object * object_compactor::share(object * new_o, size_t new_o_sz) {
+    char const * begin  = static_cast<char const *>(m_begin);
+    size_t new_o_offset = reinterpret_cast<char*>(new_o) - begin;
+    uint64 h = hash_bytes(new_o_sz, reinterpret_cast<unsigned char const *>(new_o), 17);
+    if (m_pool) {
+        if (object * r = m_pool->find(new_o, new_o_sz, h)) {
+            discard(new_o);
+            return r;
+        }
+    }
+    max_sharing_entry const * it = m_max_sharing_table->find(h, [&](max_sharing_entry const & e) {
+        return e.m_hash == h && e.m_size == new_o_sz && memcmp(begin + e.m_offset, new_o, new_o_sz) == 0;
+    });
+    if (it) {
+        // the duplicate is always the last object
+        discard(new_o);
         new_o = reinterpret_cast<lean_object*>(reinterpret_cast<char*>(m_begin) + it->m_offset);
     } else {
-        m_max_sharing_table->m_table.insert(k);
+        max_sharing_entry e;
+        e.m_offset = new_o_offset;
+        e.m_size   = new_o_sz;
+        e.m_hash   = h;
+        m_max_sharing_table->insert(e);
     }
-    save(o, new_o);
+    return new_o;
+}
+
+void object_compactor::save_max_sharing(object * o, object * new_o, size_t new_o_sz) {
+    save(o, share(new_o, new_o_sz));
 }
 
 object_offset object_compactor::to_offset(object * o) {
-    if (lean_is_scalar(o)) {
+    if (lean_is_scalar(o) || (m_pool && m_pool->contains(o))) {
         return o;
     } else {
-        auto it = m_obj_table.find(o);
-        if (it == m_obj_table.end()) {
+        object_offset const * r = m_obj_table->find(o);
+        if (r == nullptr) {
             m_todo.push_back(o);
             return g_null_offset;
         } else {
-            return it->second;
+            return *r;
         }
     }
 }
@@ -191,8 +390,10 @@ bool object_compactor::insert_constructor(object * o) {
     }
 #endif
     object * new_o = copy_object(o);
-    for (unsigned i = 0; i < lean_ctor_num_objs(o); i++)
+    for (unsigned i = 0; i < lean_ctor_num_objs(o); i++) {
         lean_ctor_set(new_o, i, offsets[i]);
+        add_reloc(lean_ctor_obj_cptr(new_o) + i);
+    }
     save_max_sharing(o, new_o, lean_object_byte_size(o));
     return true;
 }
@@ -220,18 +421,25 @@ bool object_compactor::insert_array(object * o) {
     new_o->m_capacity = sz;
     for (size_t i = 0; i < sz; i++) {
         lean_array_set_core((lean_object*)new_o, i, offsets[i]);
+        add_reloc(new_o->m_data + i);
     }
     save_max_sharing(o, (lean_object*)new_o, obj_sz);
     return true;
 }
 
+/* Thrown by the compactors of `copy_in_parallel` on unevaluated thunks. */
+struct unevaluated_thunk {};
+
 bool object_compactor::insert_thunk(object * o) {
+    if (m_is_chunk && lean_to_thunk(o)->m_value == nullptr)
+        throw unevaluated_thunk();
     object * v = lean_thunk_get(o);
     object_offset c = to_offset(v);
     if (c == g_null_offset)
         return false;
     object * r = copy_object(o);
     lean_to_thunk(r)->m_value = c;
+    add_reloc(&lean_to_thunk(r)->m_value);
     save_max_sharing(o, r, lean_object_byte_size(o));
     return true;
 }
@@ -243,6 +451,7 @@ bool object_compactor::insert_ref(object * o) {
         return false;
     object * r = copy_object(o);
     lean_to_ref(r)->m_value = c;
+    add_reloc(&lean_to_ref(r)->m_value);
     save_max_sharing(o, r, lean_object_byte_size(o));
     return true;
 }
@@ -255,6 +464,7 @@ bool object_compactor::insert_task(object * o) {
     object * r = copy_object(o);
     lean_assert(lean_to_task(r)->m_imp == nullptr);
     lean_to_task(r)->m_value = c;
+    add_reloc(&lean_to_task(r)->m_value);
     save_max_sharing(o, r, lean_object_byte_size(o));
     return true;
 }
@@ -273,6 +483,7 @@ void object_compactor::insert_mpz(object * o) {
     memcpy(data, m._mp_d, data_sz);
     m._mp_d = reinterpret_cast<mp_limb_t *>(reinterpret_cast<char *>(data) - reinterpret_cast<char *>(m_begin) + reinterpret_cast<ptrdiff_t>(m_base_addr));
     m._mp_alloc = nlimbs;
+    add_reloc(&m._mp_d);
     save(o, (lean_object*)new_o);
 #else
     size_t data_sz = sizeof(mpn_digit) * to_mpz(o)->m_value.m_size;
@@ -283,6 +494,7 @@ void object_compactor::insert_mpz(object * o) {
     void * data = reinterpret_cast<char*>(new_o) + sizeof(mpz_object);
     memcpy(data, to_mpz(o)->m_value.m_digits, data_sz);
     new_o->m_value.m_digits = reinterpret_cast<mpn_digit *>(reinterpret_cast<char *>(data) - reinterpret_cast<char *>(m_begin) + reinterpret_cast<ptrdiff_t>(m_base_addr));
+    add_reloc(&new_o->m_value.m_digits);
     save(o, (lean_object*)new_o);
 #endif
 }
@@ -324,56 +536,243 @@ tag_counter_manager g_tag_counter_manager;
 
 #endif
 
-void object_compactor::operator()(object * o) {
+/* Copy `o` and all objects reachable from it that have not been copied yet. */
+void object_compactor::copy_graph(object * o) {
     lean_assert(m_todo.empty());
-    // allocate for root address, see end of function
-    alloc(sizeof(object_offset));
-    if (!lean_is_scalar(o)) {
-        m_todo.push_back(o);
-        while (!m_todo.empty()) {
-            object * curr = m_todo.back();
-            if (m_obj_table.find(curr) != m_obj_table.end()) {
-                m_todo.pop_back();
-                continue;
-            }
-            lean_assert(!lean_is_scalar(curr));
-            bool r = true;
+    m_todo.push_back(o);
+    while (!m_todo.empty()) {
+        object * curr = m_todo.back();
+        if (m_obj_table->find(curr) != nullptr) {
+            m_todo.pop_back();
+            continue;
+        }
+        lean_assert(!lean_is_scalar(curr));
+        bool r = true;
 #ifdef LEAN_TAG_COUNTERS
-            g_tag_counters[lean_ptr_tag(curr)]++;
+        g_tag_counters[lean_ptr_tag(curr)]++;
 #endif
-            switch (lean_ptr_tag(curr)) {
-            case LeanClosure:         lean_internal_panic("closures cannot be compacted. One possible cause of this error is trying to store a function in a persistent environment extension.");
-            case LeanArray:           r = insert_array(curr); break;
-            case LeanScalarArray:     insert_sarray(curr); break;
-            case LeanString:          insert_string(curr); break;
-            case LeanMPZ:             insert_mpz(curr); break;
-            case LeanThunk:           r = insert_thunk(curr); break;
-            case LeanTask:            r = insert_task(curr); break;
-            case LeanRef:             r = insert_ref(curr); break;
-            case LeanExternal:        lean_internal_panic("external objects cannot be compacted");
-            case LeanReserved:        lean_unreachable();
-            default:                  r = insert_constructor(curr); break;
+        switch (lean_ptr_tag(curr)) {
+        case LeanClosure:         lean_internal_panic("closures cannot be compacted. One possible cause of this error is trying to store a function in a persistent environment extension.");
+        case LeanArray:           r = insert_array(curr); break;
+        case LeanScalarArray:     insert_sarray(curr); break;
+        case LeanString:          insert_string(curr); break;
+        case LeanMPZ:             insert_mpz(curr); break;
+        case LeanThunk:           r = insert_thunk(curr); break;
+        case LeanTask:            r = insert_task(curr); break;
+        case LeanRef:             r = insert_ref(curr); break;
+        case LeanExternal:        lean_internal_panic("external objects cannot be compacted");
+        case LeanReserved:        lean_unreachable();
+        default:                  r = insert_constructor(curr); break;
+        }
+        if (r) m_todo.pop_back();
+    }
+    m_tmp.clear();
+}
+
+/*
+  Copy the objects of the compacted region of `chunk`, which must have been created with a null base address, to the end
+  of this region, preserving maximal sharing. Objects in a compacted region only point to objects at lower addresses,
+  so each object can be relocated after all its children have been moved. The first word (the header) of each object of
+  `chunk` is overwritten with the new address of the object, which makes `chunk` unusable afterwards.
+*/
+void object_compactor::merge_chunk(object_compactor & chunk) {
+    lean_assert(chunk.m_base_addr == nullptr);
+    char * chunk_begin = static_cast<char*>(chunk.m_begin);
+    size_t const * reloc     = chunk.m_relocs.data();
+    size_t const * reloc_end = reloc + chunk.m_relocs.size();
+    // references into the pool do not have to be changed, but must be recorded
+    size_t const * pool_reloc     = chunk.m_pool_relocs.data();
+    size_t const * pool_reloc_end = pool_reloc + chunk.m_pool_relocs.size();
+    size_t offset = sizeof(object_offset); // skip the root slot
+    while (offset < chunk.size()) {
+        object * src = reinterpret_cast<object*>(chunk_begin + offset);
+        size_t sz    = lean_object_byte_size(src);
+        size_t end   = offset + sz;
+        bool is_mpz  = lean_ptr_tag(src) == LeanMPZ;
+        object * dst = static_cast<object*>(alloc(sz));
+        memcpy(dst, src, sz);
+        size_t dst_addr = reinterpret_cast<char*>(dst) - static_cast<char*>(m_begin) + reinterpret_cast<size_t>(m_base_addr);
+        for (; reloc != reloc_end && *reloc < end; reloc++) {
+            size_t v = *reinterpret_cast<size_t*>(chunk_begin + *reloc);
+            size_t * field = reinterpret_cast<size_t*>(reinterpret_cast<char*>(dst) + (*reloc - offset));
+            if (offset <= v && v < end) {
+                // pointer into the object itself, i.e. the limbs of an `mpz`
+                *field = dst_addr + (v - offset);
+            } else {
+                lean_assert(v < offset);
+                *field = *reinterpret_cast<size_t*>(chunk_begin + v);
+            }
+            add_reloc(field);
+        }
+        for (; pool_reloc != pool_reloc_end && *pool_reloc < end; pool_reloc++)
+            m_pool_relocs.push_back(reinterpret_cast<char*>(dst) - static_cast<char*>(m_begin) + (*pool_reloc - offset));
+        // like the sequential compactor, we do not share `mpz` objects
+        object * r = is_mpz ? dst : share(dst, sz);
+        *reinterpret_cast<size_t*>(src) = reinterpret_cast<char*>(r) - static_cast<char*>(m_begin) + reinterpret_cast<size_t>(m_base_addr);
+        size_t rem = sz % sizeof(void*);
+        offset = rem == 0 ? end : end + sizeof(void*) - rem;
+    }
+}
+
+/*
+  Copy the larger part of the objects reachable from `o` using up to `num_threads` threads. The children of `o` (and the
+  elements of its array children) are distributed between a fixed number of chunks, which are compacted into private
+  regions by a pool of workers. The chunks are merged into this region in order as soon as they are done, and the
+  children are recorded as copied, so that a subsequent `copy_graph(o)` only has to copy the remaining spine.
+
+  Subgraphs reachable from multiple chunks are copied once per chunk but merged again by maximal sharing, so the result
+  is equivalent to (though not laid out exactly like) the one of the sequential compactor. As neither the partition nor
+  the merge order depends on `num_threads`, neither does the result. Chunks that reach an unevaluated thunk are
+  discarded, and their children are left to `copy_graph(o)` on the calling thread.
+*/
+void object_compactor::copy_in_parallel(object * o, unsigned num_threads) {
+    std::vector<object *> items;
+    auto add_item = [&](object * c) {
+        if (!lean_is_scalar(c))
+            items.push_back(c);
+    };
+    auto add_child = [&](object * c) {
+        if (!lean_is_scalar(c) && lean_ptr_tag(c) == LeanArray) {
+            for (size_t i = 0; i < lean_array_size(c); i++)
+                add_item(lean_array_get_core(c, i));
+        } else {
+            add_item(c);
+        }
+    };
+    if (lean_ptr_tag(o) == LeanArray) {
+        for (size_t i = 0; i < lean_array_size(o); i++)
+            add_child(lean_array_get_core(o, i));
+    } else if (lean_ptr_tag(o) <= LeanMaxCtorTag) {
+        for (unsigned i = 0; i < lean_ctor_num_objs(o); i++)
+            add_child(lean_ctor_get(o, i));
+    }
+    if (items.size() < LEAN_PAR_COMPACT_MIN_ITEMS)
+        return;
+
+    size_t num_chunks = std::min(items.size(), static_cast<size_t>(LEAN_PAR_COMPACT_CHUNKS));
+    std::vector<std::unique_ptr<object_compactor>> chunks(num_chunks);
+    std::vector<std::vector<object_offset>> roots(num_chunks);
+    std::vector<char> done(num_chunks, false);
+    mutex done_mutex;
+    condition_variable done_cv;
+    atomic<size_t> next(0);
+    // compact the next chunk that has not been claimed yet, return `false` if there is none
+    auto compact_next = [&]() {
+        size_t c = next++;
+        if (c >= num_chunks)
+            return false;
+        object_compactor * chunk = new object_compactor(nullptr);
+        chunks[c].reset(chunk);
+        chunk->m_is_chunk = true;
+        chunk->set_pool(m_pool);
+        // reserve the root slot so that no object is at offset 0 (see `merge_chunk`)
+        chunk->alloc(sizeof(object_offset));
+        try {
+            for (size_t i = c * items.size() / num_chunks; i < (c + 1) * items.size() / num_chunks; i++) {
+                chunk->copy_graph(items[i]);
+                roots[c].push_back(chunk->to_offset(items[i]));
             }
-            if (r) m_todo.pop_back();
+        } catch (unevaluated_thunk &) {
+            chunks[c].reset();
         }
-        m_tmp.clear();
+        unique_lock<mutex> lock(done_mutex);
+        done[c] = true;
+        done_cv.notify_all();
+        return true;
+    };
+    std::vector<std::unique_ptr<lthread>> threads;
+    for (unsigned t = 1; t < std::min(static_cast<size_t>(num_threads), num_chunks); t++)
+        threads.emplace_back(new lthread([&]() { while (compact_next()) {} }));
+
+    // stop claiming chunks and wait for the workers, which reference the locals of this function
+    auto join_workers = [&]() {
+        next.store(num_chunks);
+        for (auto & t : threads)
+            t->join();
+        threads.clear();
+    };
+    try {
+        for (size_t c = 0; c < num_chunks; c++) {
+            // help compacting the remaining chunks until chunk `c` is done
+            while (true) {
+                {
+                    unique_lock<mutex> lock(done_mutex);
+                    if (done[c])
+                        break;
+                }
+                if (!compact_next()) {
+                    unique_lock<mutex> lock(done_mutex);
+                    done_cv.wait(lock, [&]() { return done[c] != 0; });
+                    break;
+                }
+            }
+            if (!chunks[c])
+                continue;
+            merge_chunk(*chunks[c]);
+            char * chunk_begin = static_cast<char*>(chunks[c]->m_begin);
+            size_t first = c * items.size() / num_chunks;
+            for (size_t i = 0; i < roots[c].size(); i++) {
+                object * item = items[first + i];
+                object_offset root = roots[c][i];
+                if (m_obj_table->find(item) == nullptr) {
+                    obj_table_entry e;
+                    e.m_key   = item;
+                    e.m_value = m_pool && m_pool->contains(root) ? root : *reinterpret_cast<object_offset*>(chunk_begin + reinterpret_cast<size_t>(root));
+                    m_obj_table->insert(e);
+                }
+            }
+            // release the chunk as soon as possible
+            chunks[c].reset();
+        }
+    } catch (...) {
+        join_workers();
+        throw;
+    }
+    join_workers();
+}
+
+void object_compactor::operator()(object * o, unsigned num_threads) {
+    lean_assert(m_todo.empty());
+    // allocate for root address, see end of function
+    alloc(sizeof(object_offset));
+    if (!lean_is_scalar(o)) {
+        if (num_threads > 0)
+            copy_in_parallel(o, num_threads);
+        copy_graph(o);
     }
     *static_cast<object_offset *>(m_begin) = to_offset(o);
+    if (m_pool) {
+        lean_assert(!m_pool->contains(o));
+        // references into the pool and into the region can only be told apart if their address ranges are disjoint
+        size_t region_begin = reinterpret_cast<size_t>(m_base_addr);
+        size_t pool_begin   = reinterpret_cast<size_t>(m_pool->data());
+        if (region_begin < pool_begin + m_pool->size() && pool_begin < region_begin + size())
+            throw exception("failed to compact object graph, the object pool overlaps the base address of the region");
+        // store the on-disk addresses of pool objects
+        size_t delta = m_pool->delta();
+        for (size_t offset : m_pool_relocs)
+            *reinterpret_cast<size_t*>(static_cast<char*>(m_begin) + offset) -= delta;
+    }
 }
 
-compacted_region::compacted_region(size_t sz, void * data, void * base_addr, bool is_mmap, std::function<void()> free_data):
+compacted_region::compacted_region(size_t sz, void * data, void * base_addr, bool is_mmap, std::function<void()> free_data,
+                                   size_t const * relocs, size_t num_relocs):
     m_base_addr(base_addr),
     m_is_mmap(is_mmap),
     m_free_data(free_data),
     m_begin(data),
     m_next(data),
-    m_end(static_cast<char*>(data)+sz) {
+    m_end(static_cast<char*>(data)+sz),
+    m_relocs(relocs),
+    m_num_relocs(num_relocs) {
 }
 
 compacted_region::compacted_region(object_compactor const & c):
     m_begin(malloc(c.size())),
     m_next(m_begin),
-    m_end(static_cast<char*>(m_begin) + c.size()) {
+    m_end(static_cast<char*>(m_begin) + c.size()),
+    m_relocs(nullptr),
+    m_num_relocs(0) {
     memcpy(m_begin, c.data(), c.size());
 }
 
@@ -444,6 +843,34 @@ void compacted_region::fix_mpz(object * o) {
 #endif
 }
 
+/* Relocate the region using the relocation table: every entry is the offset of a word that must be shifted by the
+   distance between the actual and the expected base address. Large tables are split between multiple threads. */
+void compacted_region::apply_relocations() {
+    char * begin = static_cast<char*>(m_begin);
+    size_t delta = reinterpret_cast<size_t>(m_begin) - reinterpret_cast<size_t>(m_base_addr);
+    auto fix = [=](size_t const * it, size_t const * end) {
+        for (; it != end; it++) {
+            *reinterpret_cast<size_t*>(begin + *it) += delta;
+        }
+    };
+    size_t num_threads = std::min(static_cast<size_t>(std::max(hardware_concurrency(), 1u)),
+                                  m_num_relocs / LEAN_RELOC_MIN_PER_THREAD);
+    if (num_threads <= 1) {
+        fix(m_relocs, m_relocs + m_num_relocs);
+        return;
+    }
+    size_t chunk = (m_num_relocs + num_threads - 1) / num_threads;
+    std::vector<std::unique_ptr<lthread>> threads;
+    for (size_t t = 1; t < num_threads; t++) {
+        size_t const * it  = m_relocs + t * chunk;
+        size_t const * end = m_relocs + std::min(m_num_relocs, (t + 1) * chunk);
+        threads.emplace_back(new lthread([=]() { fix(it, end); }));
+    }
+    fix(m_relocs, m_relocs + std::min(m_num_relocs, chunk));
+    for (auto & t : threads)
+        t->join();
+}
+
 object * compacted_region::read() {
     if (m_next == m_end)
         return nullptr; /* all objects have been read */
@@ -457,6 +884,12 @@ object * compacted_region::read() {
     }
     lean_assert(!m_is_mmap);
 
+    if (m_relocs) {
+        apply_relocations();
+        m_next = m_end;
+        return root;
+    }
+
     while (m_next < m_end) {
         object * curr = reinterpret_cast<object*>(m_next);
         uint8 tag = lean_ptr_tag(curr);
@@ -484,6 +917,10 @@ extern "C" LEAN_EXPORT uint8 lean_compacted_region_is_memory_mapped(usize region
     return reinterpret_cast<compacted_region *>(region)->is_memory_mapped();
 }
 
+extern "C" LEAN_EXPORT usize lean_compacted_region_size(usize region) {
+    return reinterpret_cast<compacted_region *>(region)->size();
+}
+
 extern "C" LEAN_EXPORT obj_res lean_compacted_region_free(usize region, object *) {
     delete reinterpret_cast<compacted_region *>(region);
     return lean_io_result_mk_ok(lean_box(0));
@@ -6,21 +6,58 @@ Author: Leonardo de Moura
 */
 #pragma once
 #include <functional>
+#include <memory>
 #include <vector>
-#include <unordered_map>
 #include "runtime/object.h"
 
 namespace lean {
 typedef lean_object * object_offset;
 
+/* A compacted region whose objects are referenced by other compacted regions instead of being copied into them, so
+   that objects common to many regions (such as names and strings) are stored only once. See
+   `object_compactor::set_pool`. */
+class LEAN_EXPORT object_pool {
+    struct table;
+    std::unique_ptr<table> m_table;
+    char const * m_begin;
+    char const * m_end;
+    // on-disk address of `m_begin`, which is stored in the regions referring to the pool
+    char const * m_base_addr;
+    static size_t compacted_object_size(object * o);
+public:
+    /* Index the objects of the `sz` bytes of compacted region data at `data`, which must already have been read (and
+       relocated) and stay alive as long as the pool. `base_addr` is the on-disk base address of the data. */
+    object_pool(void const * data, size_t sz, void const * base_addr);
+    object_pool(object_pool const &) = delete;
+    ~object_pool();
+    bool contains(object const * o) const {
+        return m_begin <= reinterpret_cast<char const *>(o) && reinterpret_cast<char const *>(o) < m_end;
+    }
+    /* Return an object of the pool whose `sz` bytes are equal to the ones at `o`, given their hash `h`, or `nullptr`. */
+    object * find(object const * o, size_t sz, uint64 h) const;
+    void const * data() const { return m_begin; }
+    size_t size() const { return m_end - m_begin; }
+    /* Distance between the actual and the on-disk address of the pool. */
+    size_t delta() const { return reinterpret_cast<size_t>(m_begin) - reinterpret_cast<size_t>(m_base_addr); }
+};
+
 class LEAN_EXPORT object_compactor {
+    // open-addressing hash tables, see `compact.cpp`
+    struct obj_table;
     struct max_sharing_table;
-    friend struct max_sharing_hash;
-    friend struct max_sharing_eq;
-    std::unordered_map<object*, object_offset, std::hash<object*>, std::equal_to<object*>> m_obj_table;
+    // maps objects that have already been copied to their address in the compacted region
+    std::unique_ptr<obj_table> m_obj_table;
+    // structural sharing of the copied objects
     std::unique_ptr<max_sharing_table> m_max_sharing_table;
     std::vector<object*> m_todo;
     std::vector<object_offset> m_tmp;
+    // Offsets (relative to `m_begin`) of all words in the compacted region that hold pointers into the region,
+    // in increasing order. `compacted_region` uses them to relocate regions that could not be mapped at `m_base_addr`.
+    std::vector<size_t> m_relocs;
+    // Optional pool of objects that are referenced instead of copied. The offsets of all words that hold pointers into
+    // the pool are stored in `m_pool_relocs` instead of `m_relocs`.
+    object_pool const * m_pool;
+    std::vector<size_t> m_pool_relocs;
     // On-disk base address used for `mmap`ing compacted regions without relocations
     // References within the compacted region are rewritten by subtracting `m_begin` and adding `m_base_addr`
     // In the simplest case `base_addr == nullptr`, we get region-relative pointers
@@ -28,10 +65,21 @@ class LEAN_EXPORT object_compactor {
     void * m_begin;
     void * m_end;
     void * m_capacity;
+    // When `m_fd != -1`, the compacted region is not stored in `malloc`ed memory but in a shared mapping of the file
+    // `m_fd`, starting at offset `m_file_offset`; growing the region grows the file.
+    int m_fd;
+    size_t m_file_offset;
+    // Set for the private compactors of `copy_in_parallel`, which must not evaluate thunks: the closures of
+    // unevaluated thunks may share single-threaded objects with the rest of the graph.
+    bool m_is_chunk = false;
     size_t capacity() const { return static_cast<char*>(m_capacity) - static_cast<char*>(m_begin); }
+    void grow(size_t new_capacity);
     void save(object * o, object * new_o);
+    void discard(object * new_o);
+    object * share(object * new_o, size_t new_o_sz);
     void save_max_sharing(object * o, object * new_o, size_t new_o_sz);
     void * alloc(size_t sz);
+    void add_reloc(void * field);
     object_offset to_offset(object * o);
     void insert_terminator(object * o);
     object * copy_object(object * o);
@@ -43,16 +91,36 @@ class LEAN_EXPORT object_compactor {
     bool insert_task(object * o);
     bool insert_ref(object * o);
     void insert_mpz(object * o);
+    void copy_graph(object * o);
+    void merge_chunk(object_compactor & chunk);
+    void copy_in_parallel(object * o, unsigned num_threads);
 public:
     object_compactor(void * base_addr = nullptr);
+    /* Creates an object compactor that writes the compacted region directly into the file `fd` (opened for reading and
+       writing), starting at the offset `file_offset`, so that the region does not have to be kept in memory. The file
+       may end up larger than `file_offset + size()`; truncating and closing it is left to the caller. */
+    object_compactor(void * base_addr, int fd, size_t file_offset);
     object_compactor(object_compactor const &) = delete;
     object_compactor(object_compactor &&) = delete;
     ~object_compactor();
     object_compactor operator=(object_compactor const &) = delete;
     object_compactor operator=(object_compactor &&) = delete;
-    void operator()(object * o);
+    /* If the compactor writes to a file, write the compacted region back to it and throw an exception if that fails.
+       Errors of writing back the shared mapping are not reported otherwise. */
+    void sync();
+    /* Pre-size the internal tables for compacting about `num_objects` objects. */
+    void reserve(size_t num_objects);
+    /* Reference objects of `pool` instead of copying structurally equal objects. In the compacted region, these
+       references hold the on-disk addresses of the pool objects; their offsets are returned by `pool_relocations`. */
+    void set_pool(object_pool const * pool) { m_pool = pool; }
+    /* Compact `o` and all objects reachable from it. If `num_threads > 0`, the object graph is split into a fixed number
+       of chunks that are compacted using up to `num_threads` threads. The result does not depend on `num_threads`, and
+       is equivalent but not byte-identical to the one of `num_threads == 0`. */
+    void operator()(object * o, unsigned num_threads = 0);
     size_t size() const { return static_cast<char*>(m_end) - static_cast<char*>(m_begin); }
     void const * data() const { return m_begin; }
+    std::vector<size_t> const & relocations() const { return m_relocs; }
+    std::vector<size_t> const & pool_relocations() const { return m_pool_relocs; }
 };
 
 class LEAN_EXPORT compacted_region {
@@ -63,6 +131,9 @@ class LEAN_EXPORT compacted_region {
     void * m_begin;
     void * m_next;
     void * m_end;
+    // optional relocation table, see `object_compactor::m_relocs`
+    size_t const * m_relocs;
+    size_t m_num_relocs;
     void move(size_t d);
     void move(object * o);
     object * fix_object_ptr(object * o);
@@ -72,10 +143,14 @@ class LEAN_EXPORT compacted_region {
     void fix_ref(object * o);
     void fix_task(object * o);
     void fix_mpz(object * o);
+    void apply_relocations();
 public:
     /* Creates a compacted object region using the given region in memory.
-       This object takes ownership of the region. */
-    compacted_region(size_t sz, void * data, void * base_addr, bool is_mmap, std::function<void()> free_data);
+       This object takes ownership of the region. If `relocs` is not null, it must point to the `num_relocs` entries
+       of the region's relocation table (see `object_compactor::relocations`), which must stay alive as long as the
+       region. Relocation then becomes a flat pass over the table instead of a walk over all objects. */
+    compacted_region(size_t sz, void * data, void * base_addr, bool is_mmap, std::function<void()> free_data,
+                     size_t const * relocs = nullptr, size_t num_relocs = 0);
     /* Creates a compacted object region using the object_compactor current state.
        It creates a copy of the compacted region generated by the object compactor. */
     explicit compacted_region(object_compactor const & c);
@@ -86,5 +161,7 @@ public:
     compacted_region operator=(compacted_region &&) = delete;
     object * read();
     bool is_memory_mapped() const { return m_is_mmap; }
+    void const * data() const { return m_begin; }
+    size_t size() const { return static_cast<char *>(m_end) - static_cast<char *>(m_begin); }
 };
 }
@@ -0,0 +1,74 @@
+/*
+Copyright (c) 2023 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#pragma once
+#include <vector>
+#include "runtime/debug.h"
+#include "runtime/object.h"
+
+namespace lean {
+/*
+  Flat hash table with open addressing and linear probing, kept at most half full. `Entry` must be trivially copyable,
+  value-initialize to an empty slot, and provide `bool empty() const` and `uint64 hash() const`; the latter is only
+  used when growing the table, so entries should cache their hash if it is expensive to compute.
+*/
+template<typename Entry>
+class flat_hash_table {
+    std::vector<Entry> m_entries;
+    unsigned           m_shift; // 64 - log2(capacity)
+    size_t             m_size;
+
+    size_t capacity() const { return m_entries.size(); }
+    size_t slot(uint64 h) const { return (h * 0x9E3779B97F4A7C15ull) >> m_shift; }
+
+    void resize(size_t new_capacity) {
+        std::vector<Entry> old(new_capacity);
+        old.swap(m_entries);
+        m_shift = 64;
+        for (size_t c = new_capacity; c > 1; c >>= 1) m_shift--;
+        for (Entry const & e : old) {
+            if (!e.empty())
+                insert_fresh(e);
+        }
+    }
+
+    void insert_fresh(Entry const & e) {
+        size_t mask = capacity() - 1;
+        size_t i    = slot(e.hash());
+        while (!m_entries[i].empty())
+            i = (i + 1) & mask;
+        m_entries[i] = e;
+    }
+public:
+    explicit flat_hash_table(size_t initial_capacity):m_size(0) {
+        lean_assert((initial_capacity & (initial_capacity - 1)) == 0);
+        resize(initial_capacity);
+    }
+
+    /* Return the entry with hash `h` satisfying `eq`, if any. */
+    template<typename Eq> Entry const * find(uint64 h, Eq const & eq) const {
+        size_t mask = capacity() - 1;
+        for (size_t i = slot(h);; i = (i + 1) & mask) {
+            Entry const & e = m_entries[i];
+            if (e.empty()) return nullptr;
+            if (eq(e)) return &e;
+        }
+    }
+
+    /* Insert an entry that is not yet in the table. */
+    void insert(Entry const & e) {
+        if (2 * (m_size + 1) > capacity())
+            resize(2 * capacity());
+        insert_fresh(e);
+        m_size++;
+    }
+
+    void reserve(size_t n) {
+        size_t new_capacity = capacity();
+        while (new_capacity < 2 * n) new_capacity *= 2;
+        if (new_capacity != capacity())
+            resize(new_capacity);
+    }
+};
+}
@@ -4,6 +4,11 @@ Released under Apache 2.0 license as described in the file LICENSE.
 
 Author: Leonardo de Moura
 */
+#include <cstring>
+#include <algorithm>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "runtime/hash.h"
 
 namespace lean {
@@ -55,4 +60,310 @@ uint64 hash_str(size_t len, unsigned char const * str, uint64 init_value) {
     return MurmurHash64A(str, len, init_value);
 }
 
+hash_str_stream::hash_str_stream(size_t len, uint64 init_value):
+    m_h(init_value ^ (len * 0xc6a4a7935bd1e995)), m_len(len) {}
+
+void hash_str_stream::update(unsigned char const * str, size_t len) {
+    // same block loop as in `MurmurHash64A`, except that partial blocks are kept in `m_tail` until the next call
+    const uint64 m = 0xc6a4a7935bd1e995;
+    const int r = 47;
+    lean_assert(m_consumed + len <= m_len);
+    m_consumed += len;
+    auto mix = [&](unsigned char const * block) {
+        uint64 k;
+        memcpy(&k, block, 8);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        m_h ^= k;
+        m_h *= m;
+    };
+    if (m_tail_size > 0) {
+        size_t k = std::min(len, static_cast<size_t>(8 - m_tail_size));
+        memcpy(m_tail + m_tail_size, str, k);
+        m_tail_size += k;
+        str += k;
+        len -= k;
+        if (m_tail_size < 8)
+            return;
+        mix(m_tail);
+        m_tail_size = 0;
+    }
+    for (; len >= 8; str += 8, len -= 8)
+        mix(str);
+    memcpy(m_tail, str, len);
+    m_tail_size = len;
+}
+
+uint64 hash_str_stream::finish() {
+    const uint64 m = 0xc6a4a7935bd1e995;
+    const int r = 47;
+    lean_assert(m_consumed == m_len);
+    uint64 h = m_h;
+    if (m_tail_size > 0) {
+        for (unsigned i = m_tail_size; i-- > 0;)
+            h ^= uint64(m_tail[i]) << (8 * i);
+        h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+//-----------------------------------------------------------------------------
+// SHA-256 as specified in FIPS 180-4
+
+static const uint32_t g_sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t rotr32(uint32_t x, unsigned n) { return (x >> n) | (x << (32 - n)); }
+
+sha256::sha256() {
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(m_state, init, sizeof(m_state));
+}
+
+void sha256::compress(unsigned char const * block) {
+    uint32_t w[64];
+    for (unsigned i = 0; i < 16; i++)
+        w[i] = (uint32_t(block[4*i]) << 24) | (uint32_t(block[4*i+1]) << 16) | (uint32_t(block[4*i+2]) << 8) | block[4*i+3];
+    for (unsigned i = 16; i < 64; i++) {
+        uint32_t s0 = rotr32(w[i-15], 7) ^ rotr32(w[i-15], 18) ^ (w[i-15] >> 3);
+        uint32_t s1 = rotr32(w[i-2], 17) ^ rotr32(w[i-2], 19) ^ (w[i-2] >> 10);
+        w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+    uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+    uint32_t e = m_state[4], f = m_state[5], g = m_state[6], h = m_state[7];
+    for (unsigned i = 0; i < 64; i++) {
+        uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) + g_sha256_k[i] + w[i];
+        uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    m_state[0] += a; m_state[1] += b; m_state[2] += c; m_state[3] += d;
+    m_state[4] += e; m_state[5] += f; m_state[6] += g; m_state[7] += h;
+}
+
+void sha256::update(unsigned char const * str, size_t len) {
+    m_len += len;
+    if (m_buf_size > 0) {
+        size_t k = std::min(len, 64 - m_buf_size);
+        memcpy(m_buf + m_buf_size, str, k);
+        m_buf_size += k;
+        str += k;
+        len -= k;
+        if (m_buf_size < 64)
+            return;
+        compress(m_buf);
+        m_buf_size = 0;
+    }
+    for (; len >= 64; str += 64, len -= 64)
+        compress(str);
+    memcpy(m_buf, str, len);
+    m_buf_size = len;
+}
+
+void sha256::finish(unsigned char digest[32]) {
+    uint64 bits = m_len * 8;
+    unsigned char pad[72] = {0x80};
+    size_t pad_len = (m_buf_size < 56 ? 56 : 120) - m_buf_size;
+    for (unsigned i = 0; i < 8; i++)
+        pad[pad_len + i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+    update(pad, pad_len + 8);
+    lean_assert(m_buf_size == 0);
+    for (unsigned i = 0; i < 8; i++) {
+        digest[4*i]   = static_cast<unsigned char>(m_state[i] >> 24);
+        digest[4*i+1] = static_cast<unsigned char>(m_state[i] >> 16);
+        digest[4*i+2] = static_cast<unsigned char>(m_state[i] >> 8);
+        digest[4*i+3] = static_cast<unsigned char>(m_state[i]);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// `hash_bytes`: a wyhash-style hash for short and medium inputs, and an XXH3-style
+// striped accumulator (SSE2 when available) for long inputs.
+
+static inline uint64 read64(unsigned char const * p) { uint64 v; memcpy(&v, p, 8); return v; }
+static inline uint64 read32(unsigned char const * p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline uint64 read_small(unsigned char const * p, size_t k) {
+    return (uint64(p[0]) << 16) | (uint64(p[k >> 1]) << 8) | p[k - 1];
+}
+
+static inline void mum(uint64 & a, uint64 & b) {
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = a;
+    r *= b;
+    a = static_cast<uint64>(r);
+    b = static_cast<uint64>(r >> 64);
+#else
+    uint64 ha = a >> 32, hb = b >> 32, la = static_cast<uint32_t>(a), lb = static_cast<uint32_t>(b);
+    uint64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb, t = rl + (rm0 << 32);
+    uint64 c = t < rl;
+    uint64 lo = t + (rm1 << 32);
+    c += lo < t;
+    uint64 hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    a = lo;
+    b = hi;
+#endif
+}
+
+static inline uint64 mix(uint64 a, uint64 b) { mum(a, b); return a ^ b; }
+
+static const uint64 g_hash_secret[24] = {
+    0x0bd2db2e48789d20, 0x7c621bc543b550a8, 0xb27410639e13de46, 0xd3c4eb1714b569e5,
+    0x9fc8be2266edda39, 0x491e4aceebe4be30, 0x180afb1a9570beb0, 0xca454537878d2950,
+    0xa96a98c828045478, 0xa4a4b920c8e15bf5, 0xae09d92fba683111, 0x1defe04876a32064,
+    0x1b830cede5f3a95f, 0x5d45a31f3dd3297f, 0x1b37fd03b9ada18e, 0xa9cad3754033f149,
+    0x2bbe59b3c2df09d1, 0xc01f604b97fba984, 0xdad0325410c910f5, 0x0677e5dd8bdbadf9,
+    0x2bc9abfd44bc3b36, 0x08cf102312742cef, 0x495cf4650c95833d, 0x288961efe041bc37,
+};
+
+#define LEAN_HASH_STRIPE_LEN          64
+#define LEAN_HASH_STRIPES_PER_BLOCK   16
+#define LEAN_HASH_LONG_THRESHOLD      256
+
+/* State of the striped accumulator: eight 64-bit lanes. Each stripe of 64 bytes is mixed into the lanes using
+   only 32x32->64 multiplications, and the lanes are scrambled after every block of stripes. The SSE2 version
+   computes exactly the same values as the portable one. */
+#if defined(__SSE2__)
+struct hash_acc {
+    __m128i m_v[4];
+    explicit hash_acc(uint64 seed) {
+        __m128i s = _mm_set1_epi64x(static_cast<long long>(seed));
+        for (unsigned i = 0; i < 4; i++)
+            m_v[i] = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<__m128i const *>(g_hash_secret + 2*i)), s);
+    }
+    void accumulate(unsigned char const * p, uint64 const * key) {
+        for (unsigned i = 0; i < 4; i++) {
+            __m128i data = _mm_loadu_si128(reinterpret_cast<__m128i const *>(p + 16*i));
+            __m128i k    = _mm_xor_si128(data, _mm_loadu_si128(reinterpret_cast<__m128i const *>(key + 2*i)));
+            __m128i prod = _mm_mul_epu32(k, _mm_srli_epi64(k, 32));
+            __m128i swap = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+            m_v[i] = _mm_add_epi64(m_v[i], _mm_add_epi64(prod, swap));
+        }
+    }
+    void scramble() {
+        __m128i c = _mm_set1_epi32(0x9e3779b1);
+        for (unsigned i = 0; i < 4; i++) {
+            __m128i a = _mm_xor_si128(m_v[i], _mm_srli_epi64(m_v[i], 47));
+            a = _mm_xor_si128(a, _mm_loadu_si128(reinterpret_cast<__m128i const *>(g_hash_secret + 16 + 2*i)));
+            __m128i lo = _mm_mul_epu32(a, c);
+            __m128i hi = _mm_mul_epu32(_mm_srli_epi64(a, 32), c);
+            m_v[i] = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+        }
+    }
+    void get(uint64 * r) const {
+        for (unsigned i = 0; i < 4; i++)
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(r + 2*i), m_v[i]);
+    }
+};
+#else
+struct hash_acc {
+    uint64 m_v[8];
+    explicit hash_acc(uint64 seed) {
+        for (unsigned i = 0; i < 8; i++)
+            m_v[i] = g_hash_secret[i] ^ seed;
+    }
+    void accumulate(unsigned char const * p, uint64 const * key) {
+        uint64 data[8];
+        for (unsigned i = 0; i < 8; i++)
+            data[i] = read64(p + 8*i);
+        for (unsigned i = 0; i < 8; i++) {
+            uint64 k = data[i] ^ key[i];
+            m_v[i] += (k & 0xffffffff) * (k >> 32) + data[i ^ 1];
+        }
+    }
+    void scramble() {
+        for (unsigned i = 0; i < 8; i++) {
+            uint64 a = m_v[i];
+            a ^= a >> 47;
+            a ^= g_hash_secret[16 + i];
+            m_v[i] = a * 0x9e3779b1;
+        }
+    }
+    void get(uint64 * r) const {
+        memcpy(r, m_v, sizeof(m_v));
+    }
+};
+#endif
+
+static uint64 hash_bytes_long(size_t len, unsigned char const * p, uint64 seed) {
+    hash_acc acc(seed);
+    size_t const block_len = LEAN_HASH_STRIPE_LEN * LEAN_HASH_STRIPES_PER_BLOCK;
+    size_t nblocks = (len - 1) / block_len;
+    unsigned char const * it = p;
+    for (size_t b = 0; b < nblocks; b++) {
+        for (unsigned s = 0; s < LEAN_HASH_STRIPES_PER_BLOCK; s++)
+            acc.accumulate(it + s * LEAN_HASH_STRIPE_LEN, g_hash_secret + s);
+        acc.scramble();
+        it += block_len;
+    }
+    size_t nstripes = ((len - 1) - nblocks * block_len) / LEAN_HASH_STRIPE_LEN;
+    for (unsigned s = 0; s < nstripes; s++)
+        acc.accumulate(it + s * LEAN_HASH_STRIPE_LEN, g_hash_secret + s);
+    // last (possibly overlapping) stripe, with a key not used by regular stripes
+    acc.accumulate(p + len - LEAN_HASH_STRIPE_LEN, g_hash_secret + LEAN_HASH_STRIPES_PER_BLOCK);
+    uint64 lanes[8];
+    acc.get(lanes);
+    uint64 h = seed ^ (uint64(len) * 0x9e3779b185ebca87);
+    for (unsigned i = 0; i < 8; i += 2)
+        h += mix(lanes[i] ^ g_hash_secret[i + 8], lanes[i + 1] ^ g_hash_secret[i + 9]);
+    return mix(h ^ g_hash_secret[1], h ^ g_hash_secret[0]);
+}
+
+uint64 hash_bytes(size_t len, unsigned char const * p, uint64 seed) {
+    uint64 const s0 = g_hash_secret[0], s1 = g_hash_secret[1], s2 = g_hash_secret[2], s3 = g_hash_secret[3];
+    if (len > LEAN_HASH_LONG_THRESHOLD)
+        return hash_bytes_long(len, p, seed);
+    seed ^= mix(seed ^ s0, s1);
+    uint64 a, b;
+    if (len <= 16) {
+        if (len >= 4) {
+            size_t d = (len >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + d);
+            b = (read32(p + len - 4) << 32) | read32(p + len - 4 - d);
+        } else if (len > 0) {
+            a = read_small(p, len);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64 see1 = seed, see2 = seed;
+            do {
+                seed = mix(read64(p) ^ s1, read64(p + 8) ^ seed);
+                see1 = mix(read64(p + 16) ^ s2, read64(p + 24) ^ see1);
+                see2 = mix(read64(p + 32) ^ s3, read64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = mix(read64(p) ^ s1, read64(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = read64(p + i - 16);
+        b = read64(p + i - 8);
+    }
+    a ^= s1;
+    b ^= seed;
+    mum(a, b);
+    return mix(a ^ s0 ^ len, b ^ s1);
+}
+
 }
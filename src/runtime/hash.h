@@ -7,11 +7,45 @@ Author: Leonardo de Moura
 #pragma once
 #include "runtime/debug.h"
 #include "runtime/int64.h"
+#include <cstddef>
+#include <cstdint>
 
 namespace lean {
 
 uint64 hash_str(size_t len, unsigned char const * str, uint64 init_value);
 
+/* \brief Fast non-cryptographic hash for byte sequences, considerably faster than `hash_str` on long inputs.
+   `hash_str` backs `String.hash`, `ByteArray.hash` and `Name.hash`, whose values are stored in .olean files,
+   so it must remain unchanged; use `hash_bytes` for transient tables and fresh APIs instead. */
+uint64 hash_bytes(size_t len, unsigned char const * str, uint64 init_value);
+
+/* \brief Incremental version of `hash_str` for inputs whose total length `len` is known in advance.
+   Feeding exactly `len` bytes in arbitrary pieces to `update` makes `finish` return `hash_str(len, str, init_value)`. */
+class hash_str_stream {
+    uint64        m_h;
+    size_t        m_len;
+    size_t        m_consumed  = 0;
+    unsigned char m_tail[8];
+    unsigned      m_tail_size = 0;
+public:
+    hash_str_stream(size_t len, uint64 init_value);
+    void update(unsigned char const * str, size_t len);
+    uint64 finish();
+};
+
+/* \brief Incremental SHA-256 digest. */
+class sha256 {
+    uint32_t      m_state[8];
+    uint64        m_len      = 0;
+    unsigned char m_buf[64];
+    size_t        m_buf_size = 0;
+    void compress(unsigned char const * block);
+public:
+    sha256();
+    void update(unsigned char const * str, size_t len);
+    void finish(unsigned char digest[32]);
+};
+
 inline uint64 hash(uint64 h, uint64 k) {
     uint64 m = 0xc6a4a7935bd1e995;
     uint64 r = 47;
@@ -13,6 +13,8 @@ Authors: Leonardo de Moura, Sebastian Ullrich
 #elif defined(__APPLE__)
 #include <mach-o/dyld.h>
 #include <unistd.h>
+#include <copyfile.h>
+#include <sys/random.h>
 #else
 #if defined(LEAN_EMSCRIPTEN)
 #include <emscripten.h>
@@ -21,12 +23,21 @@ Authors: Leonardo de Moura, Sebastian Ullrich
 #include <unistd.h> // NOLINT
 #include <sys/mman.h>
 #include <sys/file.h>
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#include <linux/perf_event.h>
+#endif
 #ifndef LEAN_EMSCRIPTEN
 #include <sys/random.h>
 #endif
 #endif
 #ifndef LEAN_WINDOWS
 #include <csignal>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #endif
 #include <dirent.h>
 #include <fcntl.h>
@@ -38,6 +49,10 @@ Authors: Leonardo de Moura, Sebastian Ullrich
 #include <string>
 #include <cstdlib>
 #include <cctype>
+#include <climits>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
 #include <sys/stat.h>
 #include "util/io.h"
 #include "runtime/alloc.h"
@@ -46,6 +61,9 @@ Authors: Leonardo de Moura, Sebastian Ullrich
 #include "runtime/object.h"
 #include "runtime/thread.h"
 #include "runtime/allocprof.h"
+#include "runtime/memory.h"
+#include "runtime/buffer.h"
+#include "runtime/hash.h"
 
 #ifdef _MSC_VER
 #define S_ISDIR(mode) ((mode & _S_IFDIR) != 0)
@@ -88,19 +106,34 @@ static obj_res mk_file_not_found_error(b_obj_arg fname) {
 
 static lean_external_class * g_io_handle_external_class = nullptr;
 
+/* The external data of a `Handle`. */
+struct io_handle {
+    FILE *       m_fp;
+    /* Buffer installed by `Handle.setBufferSize`, which must outlive `m_fp`. */
+    char *       m_buffer = nullptr;
+    /* Whether any operation has been performed on the handle, after which `setvbuf` may not be called anymore. */
+    atomic<bool> m_used;
+    io_handle(FILE * fp, bool used):m_fp(fp), m_used(used) {}
+};
+
 static void io_handle_finalizer(void * h) {
     // There is no sensible way to handle errors here; in particular, we should
     // not panic as finalizing a handle that already is in an invalid state
     // (broken pipe etc.) should work and not terminate the process. The same
     // decision was made for `std::fs::File` in the Rust stdlib.
-    fclose(static_cast<FILE *>(h));
+    io_handle * hd = static_cast<io_handle *>(h);
+    fclose(hd->m_fp);
+    free(hd->m_buffer);
+    delete hd;
 }
 
 static void io_handle_foreach(void * /* mod */, b_obj_arg /* fn */) {
 }
 
 lean_object * io_wrap_handle(FILE *hfile) {
-    return lean_alloc_external(g_io_handle_external_class, hfile);
+    // the standard streams may already have been used outside of Lean
+    bool used = hfile == stdin || hfile == stdout || hfile == stderr;
+    return lean_alloc_external(g_io_handle_external_class, new io_handle(hfile, used));
 }
 
 extern "C" obj_res lean_stream_of_handle(obj_arg h);
@@ -152,7 +185,11 @@ extern "C" LEAN_EXPORT obj_res lean_get_set_stderr(obj_arg h, obj_arg /* w */) {
 }
 
 static FILE * io_get_handle(lean_object * hfile) {
-    return static_cast<FILE *>(lean_get_external_data(hfile));
+    io_handle * h = static_cast<io_handle *>(lean_get_external_data(hfile));
+    // avoid writing to the shared flag on every operation
+    if (!h->m_used.load())
+        h->m_used.store(true);
+    return h->m_fp;
 }
 
 extern "C" LEAN_EXPORT obj_res lean_decode_io_error(int errnum, b_obj_arg fname) {
@@ -461,37 +498,109 @@ extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_write(b_obj_arg h, b_obj_arg
     }
 }
 
+/* Lines larger than this are not kept in the thread-local line buffer after reading them. */
+#define LEAN_LINE_BUFFER_MAX_KEEP 1024*1024
+
+/* Thread-local buffer for reading lines, reused across calls so that reading a line does not allocate
+   anything but the resulting string. */
+struct line_buffer {
+    char * m_data     = nullptr;
+    size_t m_capacity = 0;
+    ~line_buffer() { free(m_data); }
+    void reserve(size_t cap) {
+        if (cap <= m_capacity)
+            return;
+        cap = std::max(cap, 2 * m_capacity);
+        char * data = static_cast<char *>(realloc(m_data, cap));
+        if (data == nullptr)
+            lean_internal_panic_out_of_memory();
+        m_data     = data;
+        m_capacity = cap;
+    }
+    void shrink() {
+        if (m_capacity > LEAN_LINE_BUFFER_MAX_KEEP) {
+            free(m_data);
+            m_data     = nullptr;
+            m_capacity = 0;
+        }
+    }
+};
+
+MK_THREAD_LOCAL_GET_DEF(line_buffer, get_line_buffer);
+
 /*
-  Handle.getLine : (@& Handle) → IO Unit
-  The line returned by `lean_io_prim_handle_get_line`
-  is truncated at the first '\0' character and the
-  rest of the line is discarded. */
+  Read text up to (including) the next line break into `buf`, and store its length in `n`.
+  `n` is `0` iff an end-of-file marker has been reached. Return `false` on error.
+
+  Where available, we use `getline`, which scans the stdio buffer using `memchr` and keeps NUL characters.
+  Otherwise, the line is truncated at the first NUL character and the rest of the line is discarded. */
+static bool read_line(FILE * fp, line_buffer & buf, size_t & n) {
+#if !defined(LEAN_WINDOWS)
+    ssize_t r = getline(&buf.m_data, &buf.m_capacity, fp);
+    if (r >= 0) {
+        n = r;
+        return true;
+    }
+#else
+    n = 0;
+    while (true) {
+        buf.reserve(n + 128);
+        size_t avail = buf.m_capacity - n;
+        if (std::fgets(buf.m_data + n, static_cast<int>(std::min(avail, static_cast<size_t>(INT_MAX))), fp) == nullptr)
+            break;
+        size_t k = strlen(buf.m_data + n);
+        n += k;
+        if (k < avail - 1 || buf.m_data[n - 1] == '\n')
+            return true;
+    }
+    if (n > 0)
+        return true;
+#endif
+    if (std::feof(fp)) {
+        clearerr(fp);
+        n = 0;
+        return true;
+    }
+    return false;
+}
+
+/* Handle.getLine : (@& Handle) → IO String */
 extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_get_line(b_obj_arg h, obj_arg /* w */) {
     FILE * fp = io_get_handle(h);
-    const int buf_sz = 64;
-    char buf_str[buf_sz]; // NOLINT
-    std::string result;
-    bool first = true;
-    while (true) {
-        char * out = std::fgets(buf_str, buf_sz, fp);
-        if (out != nullptr) {
-            if (strlen(buf_str) < buf_sz-1 || buf_str[buf_sz-2] == '\n') {
-                if (first) {
-                    return io_result_mk_ok(mk_string(out));
-                } else {
-                    result.append(out);
-                    return io_result_mk_ok(mk_string(result));
-                }
-            }
-            result.append(out);
-        } else if (std::feof(fp)) {
-            clearerr(fp);
-            return io_result_mk_ok(mk_string(result));
-        } else {
-            return io_result_mk_error(decode_io_error(errno, nullptr));
+    line_buffer & buf = get_line_buffer();
+    size_t n;
+    if (!read_line(fp, buf, n))
+        return io_result_mk_error(decode_io_error(errno, nullptr));
+    obj_res r = n == 0 ? mk_string("") : lean_mk_string_from_bytes(buf.m_data, n);
+    buf.shrink();
+    return io_result_mk_ok(r);
+}
+
+/* Handle.readLines : (@& Handle) → USize → IO (Array String) */
+extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_read_lines(b_obj_arg h, usize max_lines, obj_arg /* w */) {
+    FILE * fp = io_get_handle(h);
+    line_buffer & buf = get_line_buffer();
+    object * r = lean_alloc_array(0, std::min(max_lines, static_cast<usize>(256)));
+    for (usize i = 0; i < max_lines; i++) {
+        size_t n;
+        if (!read_line(fp, buf, n)) {
+            int errnum = errno;
+            lean_dec(r);
+            return io_result_mk_error(decode_io_error(errnum, nullptr));
         }
-        first = false;
+        if (n == 0)
+            break;
+        if (buf.m_data[n - 1] == '\n') {
+            n--;
+#if defined(LEAN_WINDOWS)
+            if (n > 0 && buf.m_data[n - 1] == '\r')
+                n--;
+#endif
+        }
+        r = lean_array_push(r, lean_mk_string_from_bytes(buf.m_data, n));
     }
+    buf.shrink();
+    return io_result_mk_ok(r);
 }
 
 /* Handle.putStr : (@& Handle) → (@& String) → IO Unit */
@@ -504,6 +613,266 @@ extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_put_str(b_obj_arg h, b_obj_ar
     }
 }
 
+/* Handle.setBufferSize : (@& Handle) → USize → IO Unit */
+extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_set_buffer_size(b_obj_arg h, usize size, obj_arg /* w */) {
+    io_handle * hd = static_cast<io_handle *>(lean_get_external_data(h));
+    // `setvbuf` may only be called once, before any other operation on the stream
+    if (hd->m_used.exchange(true))
+        return io_result_mk_error(lean_mk_io_user_error(
+            mk_string("Handle.setBufferSize must be called before any other operation on the handle")));
+    // `setvbuf` ignores the size when no buffer is given, so we allocate it ourselves
+    char * buf = nullptr;
+    if (size > 0) {
+        buf = static_cast<char *>(malloc(size));
+        if (buf == nullptr)
+            return io_result_mk_error(decode_io_error(ENOMEM, nullptr));
+    }
+    if (setvbuf(hd->m_fp, buf, size > 0 ? _IOFBF : _IONBF, size) != 0) {
+        int errnum = errno;
+        free(buf);
+        return io_result_mk_error(decode_io_error(errnum == 0 ? EINVAL : errnum, nullptr));
+    }
+    hd->m_buffer = buf;
+    return io_result_mk_ok(box(0));
+}
+
+/* Batches smaller than this are copied into the stdio buffer instead of being written using `writev`. */
+#define LEAN_WRITE_MANY_THRESHOLD 16*1024
+
+#if !defined(LEAN_WINDOWS)
+#if defined(IOV_MAX)
+#define LEAN_IOV_MAX IOV_MAX
+#else
+#define LEAN_IOV_MAX 1024
+#endif
+
+/* Write all of `iov[0..n)` to `fd`, retrying after partial writes. */
+static bool writev_all(int fd, struct iovec * iov, size_t n) {
+    while (n > 0) {
+        ssize_t w = writev(fd, iov, static_cast<int>(std::min(n, static_cast<size_t>(LEAN_IOV_MAX))));
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        size_t k = w;
+        while (n > 0 && k >= iov->iov_len) {
+            k -= iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = static_cast<char *>(iov->iov_base) + k;
+            iov->iov_len -= k;
+        }
+    }
+    return true;
+}
+#endif
+
+/* Write the byte ranges `get(elems[i])` for all `i` to `fp`, using a single vectored write for large batches. */
+template<typename Get>
+static obj_res io_handle_write_many(FILE * fp, b_obj_arg elems, Get get) {
+    size_t n = array_size(elems);
+    size_t total = 0;
+    for (size_t i = 0; i < n; i++)
+        total += get(array_get(elems, i)).second;
+#if !defined(LEAN_WINDOWS)
+    if (total >= LEAN_WRITE_MANY_THRESHOLD) {
+        if (std::fflush(fp) != 0)
+            return io_result_mk_error(decode_io_error(errno, nullptr));
+        int fd = fileno(fp);
+        buffer<struct iovec> iov;
+        for (size_t i = 0; i < n; i++) {
+            auto p = get(array_get(elems, i));
+            if (p.second > 0)
+                iov.push_back({const_cast<char *>(p.first), p.second});
+        }
+        if (!writev_all(fd, iov.data(), iov.size()))
+            return io_result_mk_error(decode_io_error(errno, nullptr));
+        // resynchronize the stdio position, which may have been cached, with the file descriptor
+        off_t pos = lseek(fd, 0, SEEK_CUR);
+        if (pos >= 0)
+            fseeko(fp, pos, SEEK_SET);
+        return io_result_mk_ok(box(0));
+    }
+#endif
+    for (size_t i = 0; i < n; i++) {
+        auto p = get(array_get(elems, i));
+        if (std::fwrite(p.first, 1, p.second, fp) != p.second)
+            return io_result_mk_error(decode_io_error(errno, nullptr));
+    }
+    return io_result_mk_ok(box(0));
+}
+
+/* Handle.writeMany : (@& Handle) → (@& Array ByteArray) → IO Unit */
+extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_write_many(b_obj_arg h, b_obj_arg bufs, obj_arg /* w */) {
+    return io_handle_write_many(io_get_handle(h), bufs, [](b_obj_arg b) {
+        return std::make_pair(reinterpret_cast<char const *>(lean_sarray_cptr(b)), static_cast<size_t>(lean_sarray_size(b)));
+    });
+}
+
+/* Handle.putStrMany : (@& Handle) → (@& Array String) → IO Unit */
+extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_put_str_many(b_obj_arg h, b_obj_arg strs, obj_arg /* w */) {
+    return io_handle_write_many(io_get_handle(h), strs, [](b_obj_arg s) {
+        return std::make_pair(lean_string_cstr(s), static_cast<size_t>(lean_string_size(s) - 1));
+    });
+}
+
+struct mapped_file {
+    uint8 * m_data;
+    size_t  m_size;
+    bool    m_mapped; // `m_data` was created by `mmap` rather than `malloc`
+};
+
+static lean_external_class * g_mapped_file_external_class = nullptr;
+
+static void mapped_file_finalizer(void * p) {
+    mapped_file * m = static_cast<mapped_file *>(p);
+#ifndef LEAN_WINDOWS
+    if (m->m_mapped) {
+        munmap(m->m_data, m->m_size);
+    } else {
+        free(m->m_data);
+    }
+#else
+    free(m->m_data);
+#endif
+    delete m;
+}
+
+static void mapped_file_foreach(void * /* mod */, b_obj_arg /* fn */) {
+}
+
+static mapped_file * to_mapped_file(b_obj_arg m) {
+    return static_cast<mapped_file *>(lean_get_external_data(m));
+}
+
+/* MappedFile.mk (fname : @& FilePath) : IO MappedFile */
+extern "C" LEAN_EXPORT obj_res lean_io_mapped_file_mk(b_obj_arg fname, obj_arg /* w */) {
+#ifdef LEAN_WINDOWS
+    int fd = open(lean_string_cstr(fname), O_RDONLY | O_BINARY | O_NOINHERIT);
+#else
+    int fd = open(lean_string_cstr(fname), O_RDONLY | O_CLOEXEC);
+#endif
+    if (fd == -1) {
+        return io_result_mk_error(decode_io_error(errno, fname));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int errnum = errno;
+        close(fd);
+        return io_result_mk_error(decode_io_error(errnum, fname));
+    }
+    if (!S_ISREG(st.st_mode)) {
+        close(fd);
+        return io_result_mk_error(decode_io_error(S_ISDIR(st.st_mode) ? EISDIR : EINVAL, fname));
+    }
+    size_t sz = st.st_size;
+    mapped_file * m = new mapped_file{nullptr, sz, false};
+    if (sz > 0) {
+#ifndef LEAN_WINDOWS
+        void * data = mmap(nullptr, sz, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            int errnum = errno;
+            close(fd);
+            delete m;
+            return io_result_mk_error(decode_io_error(errnum, fname));
+        }
+        m->m_data   = static_cast<uint8 *>(data);
+        m->m_mapped = true;
+#else
+        // no `mmap`, read the whole file instead
+        m->m_data = static_cast<uint8 *>(malloc(sz));
+        if (m->m_data == nullptr) {
+            close(fd);
+            delete m;
+            return io_result_mk_error(decode_io_error(ENOMEM, fname));
+        }
+        size_t n = 0;
+        while (n < sz) {
+            int r = read(fd, m->m_data + n, static_cast<unsigned>(std::min(sz - n, static_cast<size_t>(1u << 30))));
+            if (r <= 0) {
+                int errnum = r == 0 ? EIO : errno;
+                close(fd);
+                mapped_file_finalizer(m);
+                return io_result_mk_error(decode_io_error(errnum, fname));
+            }
+            n += r;
+        }
+#endif
+    }
+    // the mapping stays valid after closing the file descriptor
+    close(fd);
+    return io_result_mk_ok(lean_alloc_external(g_mapped_file_external_class, m));
+}
+
+/* MappedFile.size (m : @& MappedFile) : Nat */
+extern "C" LEAN_EXPORT obj_res lean_mapped_file_size(b_obj_arg m) {
+    return lean_usize_to_nat(to_mapped_file(m)->m_size);
+}
+
+/* MappedFile.uget (m : @& MappedFile) (i : USize) (h : i.toNat < m.size) : UInt8 */
+extern "C" LEAN_EXPORT uint8 lean_mapped_file_uget(b_obj_arg m, usize i) {
+    return to_mapped_file(m)->m_data[i];
+}
+
+/* MappedFile.get! (m : @& MappedFile) (i : @& Nat) : UInt8 */
+extern "C" LEAN_EXPORT uint8 lean_mapped_file_get(b_obj_arg m, b_obj_arg i) {
+    mapped_file * f = to_mapped_file(m);
+    size_t idx = clamp_index(i, f->m_size);
+    return idx < f->m_size ? f->m_data[idx] : 0;
+}
+
+/* MappedFile.extract (m : @& MappedFile) (start stop : @& Nat) : ByteArray */
+extern "C" LEAN_EXPORT obj_res lean_mapped_file_extract(b_obj_arg m, b_obj_arg o_start, b_obj_arg o_stop) {
+    mapped_file * f = to_mapped_file(m);
+    size_t start = clamp_index(o_start, f->m_size);
+    size_t stop  = clamp_index(o_stop, f->m_size);
+    size_t n     = start < stop ? stop - start : 0;
+    obj_res r    = lean_alloc_sarray(1, n, n);
+    if (n > 0)
+        memcpy(lean_sarray_cptr(r), f->m_data + start, n);
+    return r;
+}
+
+/* MappedFile.indexOf? (m : @& MappedFile) (b : UInt8) (start : @& Nat) : Option Nat */
+extern "C" LEAN_EXPORT obj_res lean_mapped_file_index_of(b_obj_arg m, uint8 b, b_obj_arg o_start) {
+    mapped_file * f = to_mapped_file(m);
+    size_t start = clamp_index(o_start, f->m_size);
+    void * r     = start < f->m_size ? memchr(f->m_data + start, b, f->m_size - start) : nullptr;
+    if (r == nullptr)
+        return mk_option_none();
+    return mk_option_some(lean_usize_to_nat(static_cast<uint8 *>(r) - f->m_data));
+}
+
+/* MappedFile.advise (m : @& MappedFile) (advice : Advice) (start stop : @& Nat) : IO Unit */
+extern "C" LEAN_EXPORT obj_res lean_io_mapped_file_advise(b_obj_arg m, uint8 advice, b_obj_arg o_start, b_obj_arg o_stop, obj_arg /* w */) {
+#ifndef LEAN_WINDOWS
+    mapped_file * f = to_mapped_file(m);
+    if (!f->m_mapped)
+        return io_result_mk_ok(box(0));
+    size_t page  = sysconf(_SC_PAGESIZE);
+    size_t start = clamp_index(o_start, f->m_size) / page * page;
+    size_t stop  = clamp_index(o_stop, f->m_size);
+    if (start >= stop)
+        return io_result_mk_ok(box(0));
+    int a;
+    switch (advice) {
+    case 0: a = MADV_NORMAL; break;      // normal
+    case 1: a = MADV_SEQUENTIAL; break;  // sequential
+    case 2: a = MADV_RANDOM; break;      // random
+    case 3: a = MADV_WILLNEED; break;    // willNeed
+    default: a = MADV_DONTNEED; break;   // dontNeed
+    }
+    if (madvise(f->m_data + start, stop - start, a) != 0)
+        return io_result_mk_error(decode_io_error(errno, nullptr));
+#else
+    (void)m; (void)advice; (void)o_start; (void)o_stop;
+#endif
+    return io_result_mk_ok(box(0));
+}
+
 /* monoMsNow : BaseIO Nat */
 extern "C" LEAN_EXPORT obj_res lean_io_mono_ms_now(obj_arg /* w */) {
     static_assert(sizeof(std::chrono::milliseconds::rep) <= sizeof(uint64), "size of std::chrono::nanoseconds::rep may not exceed 64");
@@ -520,25 +889,174 @@ extern "C" LEAN_EXPORT obj_res lean_io_mono_nanos_now(obj_arg /* w */) {
     return io_result_mk_ok(uint64_to_nat(tm.count()));
 }
 
-/* getRandomBytes (nBytes : USize) : IO ByteArray */
-extern "C" LEAN_EXPORT obj_res lean_io_get_random_bytes (size_t nbytes, obj_arg /* w */) {
-    // Adapted from https://github.com/rust-random/getrandom/blob/30308ae845b0bf3839e5a92120559eaf56048c28/src/
+/* CPU time consumed by the calling thread, in nanoseconds. */
+static uint64 thread_cpu_time_ns() {
+#if defined(LEAN_WINDOWS)
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+        return 0;
+    auto to_ns = [](FILETIME const & t) { return ((static_cast<uint64>(t.dwHighDateTime) << 32) | t.dwLowDateTime) * 100; };
+    return to_ns(kernel) + to_ns(user);
+#else
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        return 0;
+    return static_cast<uint64>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+}
 
-    if (nbytes == 0) return io_result_mk_ok(lean_alloc_sarray(1, 0, 0));
+#if defined(__linux__)
+/* Hardware counters of the calling thread, opened on first use. */
+struct perf_counters {
+    static constexpr unsigned num_events = 4;
+    int  m_fds[num_events];
+    bool m_hardware = false; // at least cycles and instructions are available
+
+    perf_counters() {
+        static const uint64 configs[num_events] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+        };
+        for (unsigned i = 0; i < num_events; i++) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size           = sizeof(attr);
+            attr.type           = PERF_TYPE_HARDWARE;
+            attr.config         = configs[i];
+            // user space only, which is permitted with the default `perf_event_paranoid` setting
+            attr.exclude_kernel = 1;
+            attr.exclude_hv     = 1;
+            // the kernel multiplexes counters when there are more events than hardware counters; these times are used
+            // to extrapolate the counts to the time the counter was enabled
+            attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            m_fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+        }
+        m_hardware = m_fds[0] >= 0 && m_fds[1] >= 0;
+    }
+    ~perf_counters() {
+        for (int fd : m_fds) {
+            if (fd >= 0)
+                close(fd);
+        }
+    }
+    /* Read counter `i`, scaled to account for multiplexing, and set `multiplexed` if it has not been running the
+       whole time it was enabled. */
+    uint64 read_counter(unsigned i, bool & multiplexed) const {
+        // value, time enabled, time running
+        uint64 v[3];
+        if (m_fds[i] < 0 || read(m_fds[i], v, sizeof(v)) != sizeof(v) || v[2] == 0)
+            return 0;
+        if (v[2] >= v[1])
+            return v[0];
+        multiplexed = true;
+        return static_cast<uint64>(static_cast<double>(v[0]) * static_cast<double>(v[1]) / static_cast<double>(v[2]));
+    }
+};
+MK_THREAD_LOCAL_GET_DEF(perf_counters, get_perf_counters);
+#endif
 
+/*
+structure PerfCounters where
+  cycles       : UInt64
+  instructions : UInt64
+  cacheMisses  : UInt64
+  branchMisses : UInt64
+  taskClock    : UInt64
+  hardware     : Bool
+  multiplexed  : Bool
+
+getPerfCounters : BaseIO PerfCounters
+*/
+extern "C" LEAN_EXPORT obj_res lean_io_get_perf_counters(obj_arg /* w */) {
+    object * r = alloc_cnstr(0, 0, 5 * sizeof(uint64) + 2 * sizeof(uint8));
+    bool hardware = false;
+    bool multiplexed = false;
+#if defined(__linux__)
+    perf_counters const & c = get_perf_counters();
+    hardware = c.m_hardware;
+    for (unsigned i = 0; i < perf_counters::num_events; i++)
+        cnstr_set_uint64(r, i * sizeof(uint64), c.read_counter(i, multiplexed));
+#else
+    for (unsigned i = 0; i < 4; i++)
+        cnstr_set_uint64(r, i * sizeof(uint64), 0);
+#endif
+    cnstr_set_uint64(r, 4 * sizeof(uint64), thread_cpu_time_ns());
+    cnstr_set_uint8(r, 5 * sizeof(uint64), hardware);
+    cnstr_set_uint8(r, 5 * sizeof(uint64) + sizeof(uint8), multiplexed);
+    return io_result_mk_ok(r);
+}
+
+/*
+Fill `dst` with `n` bytes from the system entropy source. Return `0` or an `errno` value.
+Adapted from https://github.com/rust-random/getrandom/blob/30308ae845b0bf3839e5a92120559eaf56048c28/src/
+*/
 #if !defined(LEAN_WINDOWS)
+static int system_random_bytes(uint8_t * dst, size_t n) {
+#if defined(__linux__) && defined(SYS_getrandom)
+    // `getrandom` avoids opening `/dev/urandom` on every call; it is called via `syscall` as the glibc wrapper is only
+    // available since 2.25
+    while (n > 0) {
+        long r = syscall(SYS_getrandom, dst, n, 0);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == ENOSYS)
+                break; // Linux < 3.17
+            return errno;
+        }
+        n   -= r;
+        dst += r;
+    }
+    if (n == 0)
+        return 0;
+#elif defined(__APPLE__)
+    // `getentropy` accepts at most 256 bytes per call
+    while (n > 0) {
+        size_t k = std::min(n, static_cast<size_t>(256));
+        if (getentropy(dst, k) != 0)
+            return errno;
+        n   -= k;
+        dst += k;
+    }
+    return 0;
+#endif
     int fd_urandom = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
     if (fd_urandom < 0) {
-        return io_result_mk_error(decode_io_error(errno, lean_mk_string("/dev/urandom")));
+        return errno;
     }
+    while (n > 0) {
+#if defined(LEAN_EMSCRIPTEN)
+        // `Crypto.getRandomValues` documents `dest` should be at most 65536 bytes.
+        size_t read_sz = std::min(n, static_cast<size_t>(65536));
+#else
+        size_t read_sz = n;
+#endif
+        ssize_t nread = read(fd_urandom, dst, read_sz);
+        if (nread < 0) {
+            if (errno != EINTR) {
+                int errnum = errno;
+                close(fd_urandom);
+                return errnum;
+            }
+        } else {
+            n   -= nread;
+            dst += nread;
+        }
+    }
+    close(fd_urandom);
+    return 0;
+}
 #endif
 
+/* getRandomBytes (nBytes : USize) : IO ByteArray */
+extern "C" LEAN_EXPORT obj_res lean_io_get_random_bytes (size_t nbytes, obj_arg /* w */) {
+    if (nbytes == 0) return io_result_mk_ok(lean_alloc_sarray(1, 0, 0));
+
     obj_res res = lean_alloc_sarray(1, 0, nbytes);
     size_t remain = nbytes;
     uint8_t *dst = lean_sarray_cptr(res);
 
-    while (remain > 0) {
 #if defined(LEAN_WINDOWS)
+    while (remain > 0) {
         // Prevent ULONG (32-bit) overflow
         size_t read_sz = std::min(remain, static_cast<size_t>(std::numeric_limits<uint32_t>::max()));
         NTSTATUS status = BCryptGenRandom(
@@ -553,34 +1071,135 @@ extern "C" LEAN_EXPORT obj_res lean_io_get_random_bytes (size_t nbytes, obj_arg
         }
         remain -= read_sz;
         dst += read_sz;
+    }
 #else
-    #if defined(LEAN_EMSCRIPTEN)
-        // `Crypto.getRandomValues` documents `dest` should be at most 65536 bytes.
-        size_t read_sz = std::min(remain, static_cast<size_t>(65536));
-    #else
-        size_t read_sz = remain;
-    #endif
-        ssize_t nread = read(fd_urandom, dst, read_sz);
-        if (nread < 0) {
-            if (errno != EINTR) {
-                close(fd_urandom);
-                dec_ref(res);
-                return io_result_mk_error(decode_io_error(errno, nullptr));
-            }
-        } else {
-            remain -= nread;
-            dst += nread;
-        }
+    if (int errnum = system_random_bytes(dst, remain)) {
+        dec_ref(res);
+        return io_result_mk_error(decode_io_error(errnum, nullptr));
+    }
+#endif
+
+    lean_sarray_set_size(res, nbytes);
+    return io_result_mk_ok(res);
+}
+
+/* Fill `dst` with `n` bytes from the system entropy source, panicking on failure. */
+static void seed_random_bytes(uint8_t * dst, size_t n) {
+#if defined(LEAN_WINDOWS)
+    if (!NT_SUCCESS(BCryptGenRandom(NULL, dst, static_cast<ULONG>(n), BCRYPT_USE_SYSTEM_PREFERRED_RNG)))
+        lean_internal_panic("failed to seed random number generator");
+#else
+    if (system_random_bytes(dst, n) != 0)
+        lean_internal_panic("failed to seed random number generator");
 #endif
+}
+
+static inline uint32_t rotl32(uint32_t x, unsigned n) { return (x << n) | (x >> (32 - n)); }
+
+#define LEAN_CHACHA_QUARTER_ROUND(a, b, c, d) \
+    a += b; d ^= a; d = rotl32(d, 16);       \
+    c += d; b ^= c; b = rotl32(b, 12);       \
+    a += b; d ^= a; d = rotl32(d, 8);        \
+    c += d; b ^= c; b = rotl32(b, 7);
+
+/* Write the ChaCha20 block for `key` and block counter `counter` (with a zero nonce) to `out`. */
+static void chacha20_block(uint32_t const key[8], uint64 counter, uint8_t out[64]) {
+    uint32_t in[16] = {
+        0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+        key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+        static_cast<uint32_t>(counter), static_cast<uint32_t>(counter >> 32), 0, 0
+    };
+    uint32_t x[16];
+    memcpy(x, in, sizeof(x));
+    for (unsigned i = 0; i < 10; i++) {
+        LEAN_CHACHA_QUARTER_ROUND(x[0], x[4], x[8],  x[12]);
+        LEAN_CHACHA_QUARTER_ROUND(x[1], x[5], x[9],  x[13]);
+        LEAN_CHACHA_QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+        LEAN_CHACHA_QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+        LEAN_CHACHA_QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+        LEAN_CHACHA_QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+        LEAN_CHACHA_QUARTER_ROUND(x[2], x[7], x[8],  x[13]);
+        LEAN_CHACHA_QUARTER_ROUND(x[3], x[4], x[9],  x[14]);
     }
+    for (unsigned i = 0; i < 16; i++) {
+        uint32_t v = x[i] + in[i];
+        out[4*i]   = static_cast<uint8_t>(v);
+        out[4*i+1] = static_cast<uint8_t>(v >> 8);
+        out[4*i+2] = static_cast<uint8_t>(v >> 16);
+        out[4*i+3] = static_cast<uint8_t>(v >> 24);
+    }
+}
+
+/* Amount of output after which a thread's generator is reseeded from the system entropy source. */
+#define LEAN_CHACHA_RESEED_BYTES (1024 * 1024)
 
+/*
+Per-thread ChaCha20 generator with "fast key erasure": every refill of the output buffer also replaces the key, and
+handed-out bytes are wiped from the buffer, so that a later compromise of the state does not reveal earlier output.
+*/
+struct chacha_rng {
+    static constexpr unsigned num_blocks = 16;
+    uint32_t m_key[8];
+    uint8_t  m_buf[64 * num_blocks];
+    size_t   m_avail     = 0; // unused bytes at the end of `m_buf`
+    size_t   m_until_reseed = 0;
 #if !defined(LEAN_WINDOWS)
-    close(fd_urandom);
+    pid_t    m_pid = 0; // reseed in forked children so that they do not repeat the output of the parent
 #endif
-    lean_sarray_set_size(res, nbytes);
+    ~chacha_rng() { memset(m_buf, 0, sizeof(m_buf)); memset(m_key, 0, sizeof(m_key)); }
+
+    void refill() {
+        if (m_until_reseed == 0) {
+            seed_random_bytes(reinterpret_cast<uint8_t *>(m_key), sizeof(m_key));
+            m_until_reseed = LEAN_CHACHA_RESEED_BYTES;
+        }
+        for (unsigned i = 0; i < num_blocks; i++)
+            chacha20_block(m_key, i, m_buf + 64 * i);
+        memcpy(m_key, m_buf, sizeof(m_key));
+        memset(m_buf, 0, sizeof(m_key));
+        m_avail = sizeof(m_buf) - sizeof(m_key);
+        m_until_reseed -= std::min(m_until_reseed, m_avail);
+    }
+
+    void fill(uint8_t * dst, size_t n) {
+#if !defined(LEAN_WINDOWS)
+        // checked before serving any bytes, as a forked child inherits the buffered output of the parent
+        if (m_pid != getpid()) {
+            m_pid = getpid();
+            memset(m_buf, 0, sizeof(m_buf));
+            m_avail        = 0;
+            m_until_reseed = 0;
+        }
+#endif
+        while (n > 0) {
+            if (m_avail == 0)
+                refill();
+            size_t k = std::min(n, m_avail);
+            uint8_t * src = m_buf + sizeof(m_buf) - m_avail;
+            memcpy(dst, src, k);
+            memset(src, 0, k);
+            m_avail -= k;
+            dst += k;
+            n -= k;
+        }
+    }
+};
+MK_THREAD_LOCAL_GET_DEF(chacha_rng, get_chacha_rng);
+
+/* getRandomBytesFast (nBytes : USize) : BaseIO ByteArray */
+extern "C" LEAN_EXPORT obj_res lean_io_get_random_bytes_fast(size_t nbytes, obj_arg /* w */) {
+    obj_res res = lean_alloc_sarray(1, nbytes, nbytes);
+    get_chacha_rng().fill(lean_sarray_cptr(res), nbytes);
     return io_result_mk_ok(res);
 }
 
+/* randUInt64 : BaseIO UInt64 */
+extern "C" LEAN_EXPORT obj_res lean_io_rand_uint64(obj_arg /* w */) {
+    uint64 r;
+    get_chacha_rng().fill(reinterpret_cast<uint8_t *>(&r), sizeof(r));
+    return io_result_mk_ok(lean_box_uint64(r));
+}
+
 /* timeit {α : Type} (msg : @& String) (fn : IO α) : IO α */
 extern "C" LEAN_EXPORT obj_res lean_io_timeit(b_obj_arg msg, obj_arg fn, obj_arg w) {
     auto start = std::chrono::steady_clock::now();
@@ -615,6 +1234,11 @@ extern "C" LEAN_EXPORT obj_res lean_io_get_num_heartbeats(obj_arg /* w */) {
     return io_result_mk_ok(lean_uint64_to_nat(get_num_heartbeats()));
 }
 
+/* getCurrentRSS : BaseIO Nat */
+extern "C" LEAN_EXPORT obj_res lean_io_get_current_rss(obj_arg /* w */) {
+    return io_result_mk_ok(lean_usize_to_nat(get_allocated_memory()));
+}
+
 extern "C" LEAN_EXPORT obj_res lean_io_getenv(b_obj_arg env_var, obj_arg) {
 #if defined(LEAN_EMSCRIPTEN)
     // HACK(WN): getenv doesn't seem to work in Emscripten even though it should
@@ -734,11 +1358,16 @@ static obj_res timespec_to_obj(timespec const & ts) {
     return o;
 }
 
-extern "C" LEAN_EXPORT obj_res lean_io_metadata(b_obj_arg fname, obj_arg) {
-    struct stat st;
-    if (stat(string_cstr(fname), &st) != 0) {
-        return io_result_mk_error(decode_io_error(errno, fname));
-    }
+static uint8 file_type_of_mode(mode_t mode) {
+    return S_ISDIR(mode) ? 0 :
+           S_ISREG(mode) ? 1 :
+#ifndef LEAN_WINDOWS
+           S_ISLNK(mode) ? 2 :
+#endif
+           3;
+}
+
+static obj_res stat_to_metadata(struct stat const & st) {
     object * mdata = alloc_cnstr(0, 2, sizeof(uint64) + sizeof(uint8));
 #ifdef __APPLE__
     cnstr_set(mdata, 0, timespec_to_obj(st.st_atimespec));
@@ -752,14 +1381,198 @@ extern "C" LEAN_EXPORT obj_res lean_io_metadata(b_obj_arg fname, obj_arg) {
     cnstr_set(mdata, 1, timespec_to_obj(st.st_mtim));
 #endif
     cnstr_set_uint64(mdata, 2 * sizeof(object *), st.st_size);
-    cnstr_set_uint8(mdata, 2 * sizeof(object *) + sizeof(uint64),
-                    S_ISDIR(st.st_mode) ? 0 :
-                    S_ISREG(st.st_mode) ? 1 :
+    cnstr_set_uint8(mdata, 2 * sizeof(object *) + sizeof(uint64), file_type_of_mode(st.st_mode));
+    return mdata;
+}
+
+extern "C" LEAN_EXPORT obj_res lean_io_metadata(b_obj_arg fname, obj_arg) {
+    struct stat st;
+    if (stat(string_cstr(fname), &st) != 0) {
+        return io_result_mk_error(decode_io_error(errno, fname));
+    }
+    return io_result_mk_ok(stat_to_metadata(st));
+}
+
+/*
+Recursive directory traversal for `FilePath.scanDir` and `FilePath.scanDirMetadata`, collecting all entries in a
+single pass without going back to Lean for each of them. On POSIX systems, directories are opened relative to
+their parent using `openat`, and entries are inspected using `d_type` or `fstatat` relative to the open directory,
+so the kernel never has to resolve full paths.
+*/
+class dir_scanner {
+    bool                     m_recursive;
+    bool                     m_follow_symlinks;
+    bool                     m_with_metadata;
+    std::vector<std::string> m_extensions;
+#ifndef LEAN_WINDOWS
+    std::vector<std::pair<dev_t, ino_t>> m_visited; // directories on the current path, to avoid symlink cycles
+#endif
+    object *                 m_result;
+
+    bool matches(char const * name) const {
+        if (m_extensions.empty())
+            return true;
+        // same as `FilePath.extension`: the part after the last dot, unless the name starts with it
+        char const * dot = strrchr(name, '.');
+        if (dot == nullptr || dot == name)
+            return false;
+        for (std::string const & ext : m_extensions) {
+            if (ext == dot + 1)
+                return true;
+        }
+        return false;
+    }
+
+    void push(std::string const & path, uint8 type, struct stat const * st) {
+        object * entry = alloc_cnstr(0, 2, 0);
+        cnstr_set(entry, 0, mk_string(path));
+        cnstr_set(entry, 1, m_with_metadata ? stat_to_metadata(*st) : box(type));
+        m_result = lean_array_push(m_result, entry);
+    }
+
+#ifndef LEAN_WINDOWS
+    static uint8 file_type_of_dirent(unsigned char d_type) {
+        switch (d_type) {
+        case DT_DIR: return 0;
+        case DT_REG: return 1;
+        case DT_LNK: return 2;
+        case DT_UNKNOWN: return 255;
+        default: return 3;
+        }
+    }
+
+    /* Scan the directory `fd` (which is taken ownership of) with path `path`. Return `0` or an `errno` value. */
+    int scan(int fd, std::string const & path) {
+        DIR * dp = fdopendir(fd);
+        if (dp == nullptr) {
+            int errnum = errno;
+            close(fd);
+            return errnum;
+        }
+        int errnum = 0;
+        while (dirent * entry = readdir(dp)) {
+            char const * name = entry->d_name;
+            if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+                continue;
+            std::string child = path + "/" + name;
+            uint8 type = file_type_of_dirent(entry->d_type);
+            struct stat st;
+            if (m_with_metadata || type == 255) {
+                if (fstatat(dirfd(dp), name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                    if (errno == ENOENT)
+                        continue; // entry vanished, ignore
+                    errnum = errno;
+                    break;
+                }
+                type = file_type_of_mode(st.st_mode);
+            }
+            bool descend = m_recursive && type == 0;
+            if (m_recursive && type == 2 && m_follow_symlinks) {
+                struct stat target;
+                descend = fstatat(dirfd(dp), name, &target, 0) == 0 && S_ISDIR(target.st_mode);
+            }
+            // with an extension filter, only matching non-directories are reported
+            if (type != 0 ? matches(name) : m_extensions.empty())
+                push(child, type, &st);
+            if (descend) {
+                int child_fd = openat(dirfd(dp), name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                if (child_fd < 0) {
+                    if (errno == ENOENT)
+                        continue;
+                    errnum = errno;
+                    break;
+                }
+                struct stat dst;
+                if (fstat(child_fd, &dst) != 0) {
+                    errnum = errno;
+                    close(child_fd);
+                    break;
+                }
+                auto id = std::make_pair(dst.st_dev, dst.st_ino);
+                if (std::find(m_visited.begin(), m_visited.end(), id) != m_visited.end()) {
+                    close(child_fd);
+                    continue;
+                }
+                m_visited.push_back(id);
+                errnum = scan(child_fd, child);
+                m_visited.pop_back();
+                if (errnum != 0)
+                    break;
+            }
+        }
+        closedir(dp);
+        return errnum;
+    }
+#else
+    int scan(std::string const & path) {
+        DIR * dp = opendir(path.c_str());
+        if (dp == nullptr)
+            return errno;
+        int errnum = 0;
+        while (dirent * entry = readdir(dp)) {
+            char const * name = entry->d_name;
+            if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+                continue;
+            std::string child = path + "\\" + name;
+            struct stat st;
+            if (stat(child.c_str(), &st) != 0) {
+                if (errno == ENOENT)
+                    continue;
+                errnum = errno;
+                break;
+            }
+            uint8 type = file_type_of_mode(st.st_mode);
+            if (type != 0 ? matches(name) : m_extensions.empty())
+                push(child, type, &st);
+            if (m_recursive && type == 0) {
+                errnum = scan(child);
+                if (errnum != 0)
+                    break;
+            }
+        }
+        closedir(dp);
+        return errnum;
+    }
+#endif
+
+public:
+    dir_scanner(bool recursive, bool follow_symlinks, bool with_metadata, b_obj_arg extensions):
+        m_recursive(recursive), m_follow_symlinks(follow_symlinks), m_with_metadata(with_metadata),
+        m_result(array_mk_empty()) {
+        for (size_t i = 0; i < array_size(extensions); i++)
+            m_extensions.push_back(string_cstr(array_get(extensions, i)));
+    }
+
+    obj_res operator()(b_obj_arg root) {
+        std::string path = string_cstr(root);
 #ifndef LEAN_WINDOWS
-                    S_ISLNK(st.st_mode) ? 2 :
+        int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        int errnum = fd < 0 ? errno : 0;
+        if (errnum == 0) {
+            struct stat st;
+            if (fstat(fd, &st) == 0)
+                m_visited.push_back(std::make_pair(st.st_dev, st.st_ino));
+            errnum = scan(fd, path);
+        }
+#else
+        int errnum = scan(path);
 #endif
-                    3);
-    return io_result_mk_ok(mdata);
+        if (errnum != 0) {
+            lean_dec(m_result);
+            return io_result_mk_error(decode_io_error(errnum, root));
+        }
+        return io_result_mk_ok(m_result);
+    }
+};
+
+/* FilePath.scanDir : @& FilePath → Bool → Bool → @& Array String → IO (Array (FilePath × FileType)) */
+extern "C" LEAN_EXPORT obj_res lean_io_scan_dir(b_obj_arg root, uint8 recursive, uint8 follow_symlinks, b_obj_arg extensions, obj_arg) {
+    return dir_scanner(recursive, follow_symlinks, false, extensions)(root);
+}
+
+/* FilePath.scanDirMetadata : @& FilePath → Bool → Bool → @& Array String → IO (Array (FilePath × Metadata)) */
+extern "C" LEAN_EXPORT obj_res lean_io_scan_dir_metadata(b_obj_arg root, uint8 recursive, uint8 follow_symlinks, b_obj_arg extensions, obj_arg) {
+    return dir_scanner(recursive, follow_symlinks, true, extensions)(root);
 }
 
 extern "C" LEAN_EXPORT obj_res lean_io_create_dir(b_obj_arg p, obj_arg) {
@@ -813,6 +1626,387 @@ extern "C" LEAN_EXPORT obj_res lean_io_remove_file(b_obj_arg fname, obj_arg) {
     }
 }
 
+/* Maximum number of bytes passed to a single `read`/`write` call; Windows only accepts `unsigned int` sizes. */
+#define LEAN_IO_MAX_CHUNK (1u << 30)
+
+static int open_for_reading(char const * fname) {
+#ifdef LEAN_WINDOWS
+    return open(fname, O_RDONLY | O_BINARY);
+#else
+    return open(fname, O_RDONLY | O_CLOEXEC);
+#endif
+}
+
+/* readBinFile : @& FilePath → IO ByteArray */
+extern "C" LEAN_EXPORT obj_res lean_io_read_bin_file(b_obj_arg fname, obj_arg) {
+    int fd = open_for_reading(string_cstr(fname));
+    if (fd < 0) {
+        return io_result_mk_error(decode_io_error(errno, fname));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int errnum = errno;
+        close(fd);
+        return io_result_mk_error(decode_io_error(errnum, fname));
+    }
+    // For regular files, we read everything into an array of the right size right away. Other files (pipes, `/proc`)
+    // may report a size of 0, so we always reserve one extra byte to detect EOF without reallocating.
+    size_t capacity = S_ISREG(st.st_mode) ? static_cast<size_t>(st.st_size) + 1 : 64 * 1024;
+    object * r = lean_alloc_sarray(1, 0, capacity);
+    size_t size = 0;
+    while (true) {
+        if (size == capacity) {
+            capacity *= 2;
+            object * r2 = lean_alloc_sarray(1, size, capacity);
+            memcpy(lean_sarray_cptr(r2), lean_sarray_cptr(r), size);
+            lean_dec(r);
+            r = r2;
+        }
+        size_t chunk = std::min(capacity - size, static_cast<size_t>(LEAN_IO_MAX_CHUNK));
+        auto n = read(fd, lean_sarray_cptr(r) + size, chunk);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            int errnum = errno;
+            close(fd);
+            lean_dec(r);
+            return io_result_mk_error(decode_io_error(errnum, fname));
+        }
+        if (n == 0)
+            break;
+        size += n;
+        lean_sarray_set_size(r, size);
+    }
+    close(fd);
+    return io_result_mk_ok(r);
+}
+
+/* Hash the contents of a byte array returned by `readBinFile`, consuming the `IO` result. */
+template<typename F>
+static obj_res hash_read_result(obj_arg r, F f) {
+    if (lean_io_result_is_error(r))
+        return r;
+    object * bytes = lean_io_result_get_value(r);
+    obj_res h = f(lean_sarray_cptr(bytes), lean_sarray_size(bytes));
+    lean_dec(r);
+    return io_result_mk_ok(h);
+}
+
+/* Size of the chunks in which files are read for hashing. */
+#define LEAN_HASH_FILE_CHUNK (1024 * 1024)
+
+/*
+Stream the file `fname` through `update` in chunks, after calling `begin` with its size.
+The size of a regular file is the one reported by `fstat`; other files such as pipes and FIFOs report no
+meaningful size, so they are read to EOF before calling `begin` and `update` on the whole contents.
+Return `0`, an `errno` value, or `-1` if the size of a regular file changed while reading it.
+*/
+template<typename Begin, typename Update>
+static int stream_file(char const * fname, Begin begin, Update update) {
+    int fd = open_for_reading(fname);
+    if (fd < 0)
+        return errno;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int errnum = errno;
+        close(fd);
+        return errnum;
+    }
+    bool regular = S_ISREG(st.st_mode);
+#if defined(POSIX_FADV_SEQUENTIAL)
+    if (regular)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    size_t size = st.st_size;
+    if (regular)
+        begin(size);
+    std::vector<unsigned char> contents;
+    buffer<unsigned char> buf;
+    buf.resize(LEAN_HASH_FILE_CHUNK);
+    size_t total = 0;
+    int errnum = 0;
+    while (true) {
+        auto n = read(fd, buf.data(), buf.size());
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            errnum = errno;
+            break;
+        }
+        if (n == 0) {
+            if (regular && total != size)
+                errnum = -1;
+            break;
+        }
+        if (!regular) {
+            contents.insert(contents.end(), buf.data(), buf.data() + n);
+            continue;
+        }
+        if (total + n > size) {
+            errnum = -1;
+            break;
+        }
+        total += n;
+        update(buf.data(), static_cast<size_t>(n));
+    }
+    close(fd);
+    if (!regular && errnum == 0) {
+        begin(contents.size());
+        update(contents.data(), contents.size());
+    }
+    return errnum;
+}
+
+/* hashFile : @& FilePath → IO UInt64 */
+extern "C" LEAN_EXPORT obj_res lean_io_hash_file(b_obj_arg fname, obj_arg) {
+    // the seed is the one used by `ByteArray.hash`, so that `hashFile` agrees with hashing the contents
+    hash_str_stream h(0, 11);
+    int errnum = stream_file(string_cstr(fname),
+        [&](size_t size) { h = hash_str_stream(size, 11); },
+        [&](unsigned char const * data, size_t n) { h.update(data, n); });
+    if (errnum == -1) {
+        // the regular file is being modified concurrently; fall back to hashing a snapshot
+        return hash_read_result(lean_io_read_bin_file(fname, box(0)), [](uint8 const * data, size_t n) {
+            return lean_box_uint64(hash_str(n, data, 11));
+        });
+    } else if (errnum != 0) {
+        return io_result_mk_error(decode_io_error(errnum, fname));
+    }
+    return io_result_mk_ok(lean_box_uint64(h.finish()));
+}
+
+/* fastHashFile : @& FilePath → IO UInt64 */
+extern "C" LEAN_EXPORT obj_res lean_io_fast_hash_file(b_obj_arg fname, obj_arg) {
+    // `hash_bytes` needs the whole input at once, which we get without copying by mapping the file
+#if !defined(LEAN_WINDOWS) && !defined(LEAN_EMSCRIPTEN)
+    int fd = open_for_reading(string_cstr(fname));
+    if (fd < 0) {
+        return io_result_mk_error(decode_io_error(errno, fname));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int errnum = errno;
+        close(fd);
+        return io_result_mk_error(decode_io_error(errnum, fname));
+    }
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        size_t size = st.st_size;
+        void * data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data != MAP_FAILED) {
+            madvise(data, size, MADV_SEQUENTIAL);
+            uint64 h = hash_bytes(size, static_cast<unsigned char const *>(data), 11);
+            munmap(data, size);
+            return io_result_mk_ok(lean_box_uint64(h));
+        }
+    } else {
+        close(fd);
+    }
+#endif
+    return hash_read_result(lean_io_read_bin_file(fname, box(0)), [](uint8 const * data, size_t n) {
+        return lean_box_uint64(hash_bytes(n, data, 11));
+    });
+}
+
+/* sha256File : @& FilePath → IO ByteArray */
+extern "C" LEAN_EXPORT obj_res lean_io_sha256_file(b_obj_arg fname, obj_arg) {
+    sha256 h;
+    int errnum = stream_file(string_cstr(fname),
+        [](size_t) {},
+        [&](unsigned char const * data, size_t n) { h.update(data, n); });
+    if (errnum == -1) {
+        return hash_read_result(lean_io_read_bin_file(fname, box(0)), [](uint8 const * data, size_t n) {
+            sha256 h;
+            h.update(data, n);
+            object * r = lean_alloc_sarray(1, 32, 32);
+            h.finish(lean_sarray_cptr(r));
+            return r;
+        });
+    } else if (errnum != 0) {
+        return io_result_mk_error(decode_io_error(errnum, fname));
+    }
+    object * r = lean_alloc_sarray(1, 32, 32);
+    h.finish(lean_sarray_cptr(r));
+    return io_result_mk_ok(r);
+}
+
+#if defined(__linux__)
+/* Copy the remaining contents of `in` to `out` within the kernel. Return `false` if that is not supported for this
+   pair of files, in which case nothing has been copied yet. */
+static bool copy_file_in_kernel(int in, int out, int & errnum) {
+    errnum = 0;
+#ifdef FICLONE
+    // share the data blocks (reflink) on file systems that support it, such as Btrfs and XFS
+    if (ioctl(out, FICLONE, in) == 0)
+        return true;
+#endif
+    bool first = true;
+#ifdef SYS_copy_file_range
+    // called via `syscall` as the glibc wrapper is only available since 2.27
+    while (true) {
+        ssize_t n = syscall(SYS_copy_file_range, in, nullptr, out, nullptr, static_cast<size_t>(LEAN_IO_MAX_CHUNK), 0u);
+        if (n < 0 && first && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP))
+            break;
+        // files of procfs, sysfs, FUSE, etc. may report a size of 0 and copy nothing although they are not empty
+        if (n == 0 && first)
+            return false;
+        first = false;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            errnum = errno;
+            return true;
+        }
+        if (n == 0)
+            return true;
+    }
+#endif
+    while (true) {
+        ssize_t n = sendfile(out, in, nullptr, LEAN_IO_MAX_CHUNK);
+        if ((n < 0 && first && (errno == ENOSYS || errno == EINVAL)) || (n == 0 && first))
+            return false;
+        first = false;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            errnum = errno;
+            return true;
+        }
+        if (n == 0)
+            return true;
+    }
+}
+#endif
+
+#if defined(LEAN_WINDOWS)
+/* The `errno` value corresponding to an error code of `CopyFile`, or `0` if there is none. */
+static int copy_file_error_to_errno(DWORD err) {
+    switch (err) {
+    case ERROR_FILE_NOT_FOUND: case ERROR_PATH_NOT_FOUND: case ERROR_INVALID_DRIVE: case ERROR_BAD_NETPATH:
+    case ERROR_BAD_NET_NAME:
+        return ENOENT;
+    case ERROR_ACCESS_DENIED: case ERROR_SHARING_VIOLATION: case ERROR_LOCK_VIOLATION:
+        return EACCES;
+    case ERROR_WRITE_PROTECT:
+        return EROFS;
+    case ERROR_DISK_FULL: case ERROR_HANDLE_DISK_FULL:
+        return ENOSPC;
+    case ERROR_NOT_ENOUGH_MEMORY: case ERROR_OUTOFMEMORY:
+        return ENOMEM;
+    case ERROR_TOO_MANY_OPEN_FILES:
+        return EMFILE;
+    case ERROR_FILE_EXISTS: case ERROR_ALREADY_EXISTS:
+        return EEXIST;
+    case ERROR_DIRECTORY:
+        return ENOTDIR;
+    case ERROR_FILENAME_EXCED_RANGE:
+        return ENAMETOOLONG;
+    case ERROR_INVALID_NAME:
+        return EINVAL;
+    case ERROR_NOT_SAME_DEVICE:
+        return EXDEV;
+    default:
+        return 0;
+    }
+}
+#endif
+
+/* copyFile : @& FilePath → @& FilePath → IO Unit */
+extern "C" LEAN_EXPORT obj_res lean_io_copy_file(b_obj_arg src, b_obj_arg dst, obj_arg) {
+#if defined(LEAN_WINDOWS)
+    if (!CopyFile(string_cstr(src), string_cstr(dst), FALSE)) {
+        DWORD err = GetLastError();
+        int errnum = copy_file_error_to_errno(err);
+        if (errnum == 0) {
+            return io_result_mk_error((sstream()
+                << "failed to copy '" << string_cstr(src) << "' to '" << string_cstr(dst) << "': " << err).str());
+        }
+        // `CopyFile` does not tell which of the files the error is about, so blame the source only if it is missing
+        b_obj_arg fname = GetFileAttributes(string_cstr(src)) == INVALID_FILE_ATTRIBUTES ? src : dst;
+        return io_result_mk_error(decode_io_error(errnum, fname));
+    }
+    return io_result_mk_ok(box(0));
+#else
+    int in = open_for_reading(string_cstr(src));
+    if (in < 0) {
+        return io_result_mk_error(decode_io_error(errno, src));
+    }
+    struct stat st;
+    if (fstat(in, &st) != 0) {
+        int errnum = errno;
+        close(in);
+        return io_result_mk_error(decode_io_error(errnum, src));
+    }
+    // truncate only after making sure that `dst` is not `src`, possibly via a link
+    int out = open(string_cstr(dst), O_WRONLY | O_CREAT | O_CLOEXEC, st.st_mode & 0777);
+    if (out < 0) {
+        int errnum = errno;
+        close(in);
+        return io_result_mk_error(decode_io_error(errnum, dst));
+    }
+    struct stat dst_st;
+    if (fstat(out, &dst_st) != 0) {
+        int errnum = errno;
+        close(in);
+        close(out);
+        return io_result_mk_error(decode_io_error(errnum, dst));
+    }
+    if (dst_st.st_dev == st.st_dev && dst_st.st_ino == st.st_ino) {
+        close(in);
+        close(out);
+        return io_result_mk_error((sstream()
+            << "failed to copy '" << string_cstr(src) << "' to '" << string_cstr(dst) << "', they are the same file").str());
+    }
+    if (ftruncate(out, 0) != 0) {
+        int errnum = errno;
+        close(in);
+        close(out);
+        return io_result_mk_error(decode_io_error(errnum, dst));
+    }
+    int errnum = 0;
+    bool done = false;
+#if defined(__linux__)
+    done = copy_file_in_kernel(in, out, errnum);
+#elif defined(__APPLE__)
+    // copies the data within the kernel; cloning is only available for the path-based `copyfile`
+    done = fcopyfile(in, out, nullptr, COPYFILE_DATA) == 0;
+#endif
+    if (!done) {
+        buffer<char> buf;
+        buf.resize(64 * 1024);
+        while (true) {
+            ssize_t n = read(in, buf.data(), buf.size());
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                errnum = n < 0 ? errno : 0;
+                break;
+            }
+            ssize_t written = 0;
+            while (written < n) {
+                ssize_t w = write(out, buf.data() + written, n - written);
+                if (w < 0 && errno == EINTR)
+                    continue;
+                if (w < 0) {
+                    errnum = errno;
+                    break;
+                }
+                written += w;
+            }
+            if (errnum != 0)
+                break;
+        }
+    }
+    close(in);
+    if (close(out) != 0 && errnum == 0)
+        errnum = errno;
+    if (errnum != 0) {
+        return io_result_mk_error(decode_io_error(errnum, dst));
+    }
+    return io_result_mk_ok(box(0));
+#endif
+}
+
 extern "C" LEAN_EXPORT obj_res lean_io_app_path(obj_arg) {
 #if defined(LEAN_WINDOWS)
     HMODULE hModule = GetModuleHandle(NULL);
@@ -1065,6 +2259,7 @@ void initialize_io() {
     g_io_error_nullptr_read = lean_mk_io_user_error(mk_string("null reference read"));
     mark_persistent(g_io_error_nullptr_read);
     g_io_handle_external_class = lean_register_external_class(io_handle_finalizer, io_handle_foreach);
+    g_mapped_file_external_class = lean_register_external_class(mapped_file_finalizer, mapped_file_foreach);
 #if defined(LEAN_WINDOWS)
     _setmode(_fileno(stdout), _O_BINARY);
     _setmode(_fileno(stderr), _O_BINARY);
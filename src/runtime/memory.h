@@ -15,4 +15,8 @@ LEAN_EXPORT void set_max_memory(size_t max);
 LEAN_EXPORT void set_max_memory_megabyte(unsigned max);
 LEAN_EXPORT void check_memory(char const * component_name);
 LEAN_EXPORT size_t get_allocated_memory();
+/** \brief Return the peak resident set size of the process in bytes, or 0 if it is not available */
+LEAN_EXPORT size_t get_peak_rss();
+/** \brief Return the current resident set size of the process in bytes, or 0 if it is not available */
+LEAN_EXPORT size_t get_current_rss();
 }
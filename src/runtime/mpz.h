@@ -24,6 +24,7 @@ namespace lean {
 class LEAN_EXPORT mpz {
     friend class object_compactor;
     friend class compacted_region;
+    friend class object_pool;
 #ifdef LEAN_USE_GMP
     mpz_t m_val;
     mpz(__mpz_struct const * v) { mpz_init_set(m_val, v); }
@@ -2108,6 +2108,46 @@ extern "C" LEAN_EXPORT uint64_t lean_byte_array_hash(b_obj_arg a) {
     return hash_str(lean_sarray_size(a), lean_sarray_cptr(a), 11);
 }
 
+extern "C" LEAN_EXPORT uint64_t lean_byte_array_fast_hash(b_obj_arg a) {
+    return hash_bytes(lean_sarray_size(a), lean_sarray_cptr(a), 11);
+}
+
+extern "C" LEAN_EXPORT obj_res lean_byte_array_index_of(b_obj_arg a, uint8 b, b_obj_arg o_start) {
+    size_t sz    = lean_sarray_size(a);
+    size_t start = clamp_index(o_start, sz);
+    uint8 * data = lean_sarray_cptr(a);
+    void * r     = start < sz ? memchr(data + start, b, sz - start) : nullptr;
+    if (r == nullptr)
+        return mk_option_none();
+    return mk_option_some(lean_usize_to_nat(static_cast<uint8 *>(r) - data));
+}
+
+extern "C" LEAN_EXPORT uint8 lean_byte_array_beq(b_obj_arg a, b_obj_arg b) {
+    size_t sz = lean_sarray_size(a);
+    return sz == lean_sarray_size(b) && memcmp(lean_sarray_cptr(a), lean_sarray_cptr(b), sz) == 0;
+}
+
+extern "C" LEAN_EXPORT uint8 lean_byte_array_compare(b_obj_arg a, b_obj_arg b) {
+    size_t asz = lean_sarray_size(a);
+    size_t bsz = lean_sarray_size(b);
+    int c = memcmp(lean_sarray_cptr(a), lean_sarray_cptr(b), std::min(asz, bsz));
+    if (c == 0)
+        c = asz < bsz ? -1 : (asz > bsz ? 1 : 0);
+    // `Ordering.lt`, `Ordering.eq`, `Ordering.gt`
+    return c < 0 ? 0 : (c == 0 ? 1 : 2);
+}
+
+extern "C" LEAN_EXPORT obj_res lean_byte_array_fill(obj_arg a, uint8 v, b_obj_arg o_start, b_obj_arg o_stop) {
+    size_t sz    = lean_sarray_size(a);
+    size_t start = clamp_index(o_start, sz);
+    size_t stop  = clamp_index(o_stop, sz);
+    if (start >= stop)
+        return a;
+    object * r = lean_sarray_ensure_exclusive(a);
+    memset(lean_sarray_cptr(r) + start, v, stop - start);
+    return r;
+}
+
 extern "C" LEAN_EXPORT obj_res lean_copy_float_array(obj_arg a) {
     return lean_copy_sarray(a, lean_sarray_capacity(a));
 }
@@ -2147,6 +2187,83 @@ extern "C" LEAN_EXPORT obj_res lean_float_array_push(obj_arg a, double d) {
     return r;
 }
 
+/* The reductions below use independent partial sums so that the compiler can vectorize them
+   without reassociating floating-point additions on its own (i.e., without `-ffast-math`). */
+#define LEAN_FLOAT_ARRAY_LANES 8
+
+extern "C" LEAN_EXPORT double lean_float_array_sum(b_obj_arg a) {
+    size_t n         = lean_sarray_size(a);
+    double const * x = lean_float_array_cptr(a);
+    double acc[LEAN_FLOAT_ARRAY_LANES] = {};
+    size_t i = 0;
+    for (; i + LEAN_FLOAT_ARRAY_LANES <= n; i += LEAN_FLOAT_ARRAY_LANES)
+        for (unsigned j = 0; j < LEAN_FLOAT_ARRAY_LANES; j++)
+            acc[j] += x[i + j];
+    double r = 0;
+    for (unsigned j = 0; j < LEAN_FLOAT_ARRAY_LANES; j++)
+        r += acc[j];
+    for (; i < n; i++)
+        r += x[i];
+    return r;
+}
+
+extern "C" LEAN_EXPORT double lean_float_array_dot(b_obj_arg a, b_obj_arg b) {
+    size_t n         = std::min(lean_sarray_size(a), lean_sarray_size(b));
+    double const * x = lean_float_array_cptr(a);
+    double const * y = lean_float_array_cptr(b);
+    double acc[LEAN_FLOAT_ARRAY_LANES] = {};
+    size_t i = 0;
+    for (; i + LEAN_FLOAT_ARRAY_LANES <= n; i += LEAN_FLOAT_ARRAY_LANES)
+        for (unsigned j = 0; j < LEAN_FLOAT_ARRAY_LANES; j++)
+            acc[j] += x[i + j] * y[i + j];
+    double r = 0;
+    for (unsigned j = 0; j < LEAN_FLOAT_ARRAY_LANES; j++)
+        r += acc[j];
+    for (; i < n; i++)
+        r += x[i] * y[i];
+    return r;
+}
+
+/* Element-wise `f` on the first `min(size(a), size(b))` elements, in place if `a` is exclusive. */
+template<typename F>
+static obj_res float_array_zip_with(obj_arg a, b_obj_arg b, F && f) {
+    size_t n = std::min(lean_sarray_size(a), lean_sarray_size(b));
+    object * r;
+    if (lean_is_exclusive(a)) {
+        r = a;
+        lean_sarray_set_size(r, n);
+    } else {
+        r = lean_alloc_sarray(sizeof(double), n, n); // NOLINT
+    }
+    double const * x = lean_float_array_cptr(a);
+    double const * y = lean_float_array_cptr(b);
+    double * dest    = lean_float_array_cptr(r);
+    for (size_t i = 0; i < n; i++)
+        dest[i] = f(x[i], y[i]);
+    if (r != a)
+        lean_dec(a);
+    return r;
+}
+
+extern "C" LEAN_EXPORT obj_res lean_float_array_add(obj_arg a, b_obj_arg b) {
+    return float_array_zip_with(a, b, [](double x, double y) { return x + y; });
+}
+
+extern "C" LEAN_EXPORT obj_res lean_float_array_mul(obj_arg a, b_obj_arg b) {
+    return float_array_zip_with(a, b, [](double x, double y) { return x * y; });
+}
+
+extern "C" LEAN_EXPORT obj_res lean_float_array_fill(obj_arg a, double v, b_obj_arg o_start, b_obj_arg o_stop) {
+    size_t sz    = lean_sarray_size(a);
+    size_t start = clamp_index(o_start, sz);
+    size_t stop  = clamp_index(o_stop, sz);
+    if (start >= stop)
+        return a;
+    object * r = lean_sarray_ensure_exclusive(a);
+    std::fill(lean_float_array_cptr(r) + start, lean_float_array_cptr(r) + stop, v);
+    return r;
+}
+
 // =======================================
 // Array functions for generated code
 
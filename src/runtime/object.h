@@ -6,6 +6,7 @@ Author: Leonardo de Moura
 */
 #pragma once
 #include <string>
+#include <algorithm>
 #include <lean/lean.h>
 #include "runtime/mpz.h"
 
@@ -41,6 +42,8 @@ inline external_object_class * register_external_object_class(external_object_fi
 inline bool is_scalar(object * o) { return lean_is_scalar(o); }
 inline object * box(size_t n) { return lean_box(n); }
 inline size_t unbox(object * o) { return lean_unbox(o); }
+/* Clamp the `Nat` index `n` to `[0, sz]`. */
+inline size_t clamp_index(b_obj_arg n, size_t sz) { return lean_is_scalar(n) ? std::min(lean_unbox(n), sz) : sz; }
 
 inline bool is_mt_heap_obj(object * o) { return lean_is_mt(o); }
 inline bool is_st_heap_obj(object * o) { return lean_is_st(o); }
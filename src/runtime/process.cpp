@@ -22,8 +22,16 @@ Author: Jared Roesch
 #else
 #include <unistd.h>
 #include <fcntl.h>
+#include <spawn.h>
+#include <poll.h>
 #include <sys/wait.h>
+#include <sys/syscall.h>
 #include <signal.h>
+#include <cstring>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
 #endif
 
 #include "runtime/object.h"
@@ -33,6 +41,7 @@ Author: Jared Roesch
 #include "runtime/option_ref.h"
 #include "runtime/pair_ref.h"
 #include "runtime/buffer.h"
+#include "runtime/thread.h"
 
 namespace lean {
 
@@ -73,6 +82,49 @@ extern "C" LEAN_EXPORT obj_res lean_io_process_child_wait(b_obj_arg, b_obj_arg c
     return lean_io_result_mk_ok(box_uint32(exit_code));
 }
 
+extern "C" LEAN_EXPORT obj_res lean_io_process_child_try_wait(b_obj_arg, b_obj_arg child, obj_arg) {
+    HANDLE h = static_cast<HANDLE>(lean_get_external_data(cnstr_get(child, 3)));
+    DWORD exit_code;
+    DWORD r = WaitForSingleObject(h, 0);
+    if (r == WAIT_TIMEOUT) {
+        return lean_io_result_mk_ok(mk_option_none());
+    } else if (r == WAIT_FAILED) {
+        return io_result_mk_error((sstream() << GetLastError()).str());
+    }
+    if (!GetExitCodeProcess(h, &exit_code)) {
+        return io_result_mk_error((sstream() << GetLastError()).str());
+    }
+    return lean_io_result_mk_ok(mk_option_some(box_uint32(exit_code)));
+}
+
+extern "C" LEAN_EXPORT obj_res lean_io_process_wait_any(b_obj_arg, b_obj_arg children, obj_arg) {
+    size_t n = array_size(children);
+    if (n == 0) {
+        return io_result_mk_error("waitAny: no child processes given");
+    }
+    buffer<HANDLE> hs;
+    for (size_t i = 0; i < n; i++)
+        hs.push_back(static_cast<HANDLE>(lean_get_external_data(cnstr_get(array_get(children, i), 3))));
+    // `WaitForMultipleObjects` supports at most `MAXIMUM_WAIT_OBJECTS` handles, so larger sets are polled in chunks
+    while (true) {
+        for (size_t i = 0; i < n; i += MAXIMUM_WAIT_OBJECTS) {
+            DWORD k = static_cast<DWORD>(n - i < MAXIMUM_WAIT_OBJECTS ? n - i : MAXIMUM_WAIT_OBJECTS);
+            DWORD r = WaitForMultipleObjects(k, hs.data() + i, FALSE, n <= MAXIMUM_WAIT_OBJECTS ? INFINITE : 0);
+            if (r == WAIT_FAILED) {
+                return io_result_mk_error((sstream() << GetLastError()).str());
+            } else if (r < WAIT_OBJECT_0 + k) {
+                size_t idx = i + (r - WAIT_OBJECT_0);
+                DWORD exit_code;
+                if (!GetExitCodeProcess(hs[idx], &exit_code)) {
+                    return io_result_mk_error((sstream() << GetLastError()).str());
+                }
+                return lean_io_result_mk_ok(mk_cnstr(0, box(idx), box_uint32(exit_code)).steal());
+            }
+        }
+        Sleep(1);
+    }
+}
+
 extern "C" LEAN_EXPORT obj_res lean_io_process_child_kill(b_obj_arg, b_obj_arg child, obj_arg) {
     HANDLE h = static_cast<HANDLE>(lean_get_external_data(cnstr_get(child, 3)));
     if (!TerminateProcess(h, 1)) {
@@ -257,25 +309,164 @@ extern "C" LEAN_EXPORT obj_res lean_io_process_get_pid(obj_arg) {
     return lean_io_result_mk_ok(box_uint32(getpid()));
 }
 
-extern "C" LEAN_EXPORT obj_res lean_io_process_child_wait(b_obj_arg, b_obj_arg child, obj_arg) {
+static pid_t child_pid(b_obj_arg child) {
     static_assert(sizeof(pid_t) == sizeof(uint32), "pid_t is expected to be a 32-bit type"); // NOLINT
-    pid_t pid = cnstr_get_uint32(child, 3 * sizeof(object *));
-    int status;
-    if (waitpid(pid, &status, 0) == -1) {
-        return io_result_mk_error(decode_io_error(errno, nullptr));
+    return cnstr_get_uint32(child, 3 * sizeof(object *));
+}
+
+#if defined(__linux__) && defined(SYS_pidfd_open)
+/* A pidfd, closed when the last `waitAny` polling it and the cache have dropped it. */
+struct pidfd {
+    int m_fd;
+    explicit pidfd(int fd):m_fd(fd) {}
+    ~pidfd() { close(m_fd); }
+};
+static mutex * g_pidfds_mutex = nullptr;
+// pidfds opened by `waitAny`, by pid
+static std::unordered_map<pid_t, std::shared_ptr<pidfd>> * g_pidfds = nullptr;
+// children that are being reaped by a blocking `waitpid`; their pid may be reused as soon as it returns, so no pidfd
+// may be cached for them
+static std::unordered_set<pid_t> * g_reaping = nullptr;
+#endif
+
+/* `waitpid`, which also drops the cached pidfd of `pid` (see `wait_any_pidfd`) if the child is reaped, as its pid may
+   be reused afterwards. */
+static pid_t reap_child(pid_t pid, int * status, int options) {
+#if defined(__linux__) && defined(SYS_pidfd_open)
+    unique_lock<mutex> lock(*g_pidfds_mutex);
+    if (options & WNOHANG) {
+        // whether the child is reaped is only known afterwards, so keep other threads from caching a reused pid
+        pid_t r = waitpid(pid, status, options);
+        if (r > 0)
+            g_pidfds->erase(pid);
+        return r;
     }
+    g_pidfds->erase(pid);
+    g_reaping->insert(pid);
+    lock.unlock();
+    pid_t r = waitpid(pid, status, options);
+    lock.lock();
+    g_reaping->erase(pid);
+    return r;
+#else
+    return waitpid(pid, status, options);
+#endif
+}
+
+static unsigned exit_code_of_status(int status) {
     if (WIFEXITED(status)) {
-        return lean_io_result_mk_ok(box_uint32(static_cast<unsigned>(WEXITSTATUS(status))));
+        return WEXITSTATUS(status);
     } else {
         lean_assert(WIFSIGNALED(status));
         // use bash's convention
-        return lean_io_result_mk_ok(box_uint32(128 + static_cast<unsigned>(WTERMSIG(status))));
+        return 128 + static_cast<unsigned>(WTERMSIG(status));
+    }
+}
+
+extern "C" LEAN_EXPORT obj_res lean_io_process_child_wait(b_obj_arg, b_obj_arg child, obj_arg) {
+    int status;
+    if (reap_child(child_pid(child), &status, 0) == -1) {
+        return io_result_mk_error(decode_io_error(errno, nullptr));
+    }
+    return lean_io_result_mk_ok(box_uint32(exit_code_of_status(status)));
+}
+
+extern "C" LEAN_EXPORT obj_res lean_io_process_child_try_wait(b_obj_arg, b_obj_arg child, obj_arg) {
+    int status;
+    pid_t r = reap_child(child_pid(child), &status, WNOHANG);
+    if (r == -1) {
+        return io_result_mk_error(decode_io_error(errno, nullptr));
+    } else if (r == 0) {
+        return lean_io_result_mk_ok(mk_option_none());
+    }
+    return lean_io_result_mk_ok(mk_option_some(box_uint32(exit_code_of_status(status))));
+}
+
+#if defined(__linux__) && defined(SYS_pidfd_open)
+/* Wait for any of the given processes using one pidfd each, which becomes readable when the process terminates.
+   Return `false` if pidfds are not supported (Linux < 5.3), and store the index of the process in `idx` otherwise.
+   The pidfds are cached in `g_pidfds`, so that a supervisor calling `waitAny` once per terminating child does not
+   open and close a pidfd for each of the remaining children every time. */
+static bool wait_any_pidfd(std::vector<pid_t> const & pids, size_t & idx, int & errnum) {
+    // keep the pidfds open while polling, even if their children are reaped concurrently
+    std::vector<std::shared_ptr<pidfd>> refs;
+    std::vector<pollfd> fds;
+    {
+        lock_guard<mutex> lock(*g_pidfds_mutex);
+        for (pid_t pid : pids) {
+            auto it = g_pidfds->find(pid);
+            if (it != g_pidfds->end()) {
+                refs.push_back(it->second);
+            } else {
+                int fd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+                if (fd < 0)
+                    return false;
+                refs.push_back(std::make_shared<pidfd>(fd));
+                if (g_reaping->count(pid) == 0)
+                    g_pidfds->insert({pid, refs.back()});
+            }
+            fds.push_back(pollfd{refs.back()->m_fd, POLLIN, 0});
+        }
+    }
+    while (true) {
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            errnum = errno;
+            idx = fds.size();
+            return true;
+        }
+        for (size_t i = 0; i < fds.size(); i++) {
+            if (fds[i].revents != 0) {
+                idx = i;
+                return true;
+            }
+        }
+    }
+}
+#endif
+
+extern "C" LEAN_EXPORT obj_res lean_io_process_wait_any(b_obj_arg, b_obj_arg children, obj_arg) {
+    size_t n = array_size(children);
+    if (n == 0) {
+        return io_result_mk_error(decode_io_error(EINVAL, nullptr));
+    }
+    std::vector<pid_t> pids;
+    for (size_t i = 0; i < n; i++)
+        pids.push_back(child_pid(array_get(children, i)));
+    int status;
+#if defined(__linux__) && defined(SYS_pidfd_open)
+    size_t idx;
+    int errnum = 0;
+    if (wait_any_pidfd(pids, idx, errnum)) {
+        if (idx == n) {
+            return io_result_mk_error(decode_io_error(errnum, nullptr));
+        }
+        if (reap_child(pids[idx], &status, 0) == -1) {
+            return io_result_mk_error(decode_io_error(errno, nullptr));
+        }
+        return lean_io_result_mk_ok(mk_cnstr(0, box(idx), box_uint32(exit_code_of_status(status))).steal());
+    }
+#endif
+    // Portable fallback: poll the children, backing off up to 10ms between rounds. We cannot use `waitid(P_ALL, ...)`
+    // as it would also report children that are not in the given set.
+    useconds_t delay = 50;
+    while (true) {
+        for (size_t i = 0; i < n; i++) {
+            pid_t r = reap_child(pids[i], &status, WNOHANG);
+            if (r == -1) {
+                return io_result_mk_error(decode_io_error(errno, nullptr));
+            } else if (r != 0) {
+                return lean_io_result_mk_ok(mk_cnstr(0, box(i), box_uint32(exit_code_of_status(status))).steal());
+            }
+        }
+        usleep(delay);
+        delay = std::min(2 * delay, static_cast<useconds_t>(10000));
     }
 }
 
 extern "C" LEAN_EXPORT obj_res lean_io_process_child_kill(b_obj_arg, b_obj_arg child, obj_arg) {
-    static_assert(sizeof(pid_t) == sizeof(uint32), "pid_t is expected to be a 32-bit type"); // NOLINT
-    pid_t pid = cnstr_get_uint32(child, 3 * sizeof(object *));
+    pid_t pid = child_pid(child);
     bool setsid = cnstr_get_uint8(child, 3 * sizeof(object *) + sizeof(pid_t));
     if ((setsid ? killpg(pid, SIGKILL) : kill(pid, SIGKILL)) == -1) {
         return io_result_mk_error(decode_io_error(errno, nullptr));
@@ -309,72 +500,168 @@ static optional<pipe> setup_stdio(stdio cfg) {
     lean_unreachable();
 }
 
-static obj_res spawn(string_ref const & proc_name, array_ref<string_ref> const & args, stdio stdin_mode, stdio stdout_mode,
-  stdio stderr_mode, option_ref<string_ref> const & cwd, array_ref<pair_ref<string_ref, option_ref<string_ref>>> const & env,
-  bool do_setsid) {
-    /* Setup stdio based on process configuration. */
-    auto stdin_pipe  = setup_stdio(stdin_mode);
-    auto stdout_pipe = setup_stdio(stdout_mode);
-    auto stderr_pipe = setup_stdio(stderr_mode);
+typedef array_ref<pair_ref<string_ref, option_ref<string_ref>>> env_mods;
+
+/* Set up the child process after `fork` and replace it with the external process. */
+[[noreturn]] static void exec_child(string_ref const & proc_name, array_ref<string_ref> const & args, stdio stdin_mode, stdio stdout_mode,
+  stdio stderr_mode, optional<pipe> const & stdin_pipe, optional<pipe> const & stdout_pipe, optional<pipe> const & stderr_pipe,
+  option_ref<string_ref> const & cwd, env_mods const & env, bool do_setsid) {
+    for (auto & entry : env) {
+        if (entry.snd()) {
+            setenv(entry.fst().data(), entry.snd().get()->data(), true);
+        } else {
+            unsetenv(entry.fst().data());
+        }
+    }
 
-    int pid = fork();
+    if (stdin_pipe) {
+        dup2(stdin_pipe->m_read_fd, STDIN_FILENO);
+        close(stdin_pipe->m_write_fd);
+    } else if (stdin_mode == stdio::NUL) {
+        int fd = open("/dev/null", O_RDONLY);
+        dup2(fd, STDIN_FILENO);
+    }
 
-    if (pid == 0) {
-        for (auto & entry : env) {
-            if (entry.snd()) {
-                setenv(entry.fst().data(), entry.snd().get()->data(), true);
-            } else {
-                unsetenv(entry.fst().data());
-            }
-        }
+    if (stdout_pipe) {
+        dup2(stdout_pipe->m_write_fd, STDOUT_FILENO);
+        close(stdout_pipe->m_read_fd);
+    } else if (stdout_mode == stdio::NUL) {
+        int fd = open("/dev/null", O_WRONLY);
+        dup2(fd, STDOUT_FILENO);
+    }
 
-        if (stdin_pipe) {
-            dup2(stdin_pipe->m_read_fd, STDIN_FILENO);
-            close(stdin_pipe->m_write_fd);
-        } else if (stdin_mode == stdio::NUL) {
-            int fd = open("/dev/null", O_RDONLY);
-            dup2(fd, STDIN_FILENO);
-        }
+    if (stderr_pipe) {
+        dup2(stderr_pipe->m_write_fd, STDERR_FILENO);
+        close(stderr_pipe->m_read_fd);
+    } else if (stderr_mode == stdio::NUL) {
+        int fd = open("/dev/null", O_WRONLY);
+        dup2(fd, STDERR_FILENO);
+    }
 
-        if (stdout_pipe) {
-            dup2(stdout_pipe->m_write_fd, STDOUT_FILENO);
-            close(stdout_pipe->m_read_fd);
-        } else if (stdout_mode == stdio::NUL) {
-            int fd = open("/dev/null", O_WRONLY);
-            dup2(fd, STDOUT_FILENO);
+    if (cwd) {
+        if (chdir(cwd.get()->data()) < 0) {
+            std::cerr << "could not change directory to " << cwd.get()->data() << std::endl;
+            exit(-1);
         }
+    }
 
-        if (stderr_pipe) {
-            dup2(stderr_pipe->m_write_fd, STDERR_FILENO);
-            close(stderr_pipe->m_read_fd);
-        } else if (stderr_mode == stdio::NUL) {
-            int fd = open("/dev/null", O_WRONLY);
-            dup2(fd, STDERR_FILENO);
-        }
+    if (do_setsid) {
+        lean_always_assert(setsid() >= 0);
+    }
 
-        if (cwd) {
-            if (chdir(cwd.get()->data()) < 0) {
-                std::cerr << "could not change directory to " << cwd.get()->data() << std::endl;
-                exit(-1);
-            }
-        }
+    buffer<char *> pargs;
+    pargs.push_back(strdup(proc_name.data()));
+    for (auto & arg : args)
+        pargs.push_back(strdup(arg.data()));
+    pargs.push_back(NULL);
+
+    execvp(pargs[0], pargs.data());
+    std::cerr << "could not execute external process '" << pargs[0] << "'" << std::endl;
+    exit(-1);
+}
+
+/* `posix_spawn` avoids copying the page tables of the parent process, which dominates the cost of `fork`
+   for processes with a large heap. We need `posix_spawn_file_actions_addchdir_np` for `cwd`. */
+#if defined(__GLIBC__) && defined(__GLIBC_PREREQ)
+#if __GLIBC_PREREQ(2, 29)
+#define LEAN_POSIX_SPAWN
+#endif
+#endif
 
-        if (do_setsid) {
-            lean_always_assert(setsid() >= 0);
+#if defined(LEAN_POSIX_SPAWN)
+extern "C" char ** environ;
+
+/* Try to start the external process using `posix_spawnp`, and return its pid or `-1` on failure. In the latter case,
+   the caller falls back to `fork`, which preserves the behavior on errors such as a missing executable or working
+   directory (an error message on stderr and exit code 255 instead of an exception). */
+static pid_t try_posix_spawn(string_ref const & proc_name, array_ref<string_ref> const & args, stdio stdin_mode, stdio stdout_mode,
+  stdio stderr_mode, optional<pipe> const & stdin_pipe, optional<pipe> const & stdout_pipe, optional<pipe> const & stderr_pipe,
+  option_ref<string_ref> const & cwd, env_mods const & env, bool do_setsid) {
+    // `posix_spawnp` searches the parent's `PATH`, while `execvp` after `setenv` searches the updated one
+    for (auto & entry : env) {
+        if (strcmp(entry.fst().data(), "PATH") == 0)
+            return -1;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    if (posix_spawn_file_actions_init(&actions) != 0)
+        return -1;
+    if (posix_spawnattr_init(&attr) != 0) {
+        posix_spawn_file_actions_destroy(&actions);
+        return -1;
+    }
+    bool ok = true;
+    auto setup_fd = [&](optional<pipe> const & p, stdio mode, int fd, bool in) {
+        if (p) {
+            ok = ok && posix_spawn_file_actions_adddup2(&actions, in ? p->m_read_fd : p->m_write_fd, fd) == 0;
+        } else if (mode == stdio::NUL) {
+            ok = ok && posix_spawn_file_actions_addopen(&actions, fd, "/dev/null", in ? O_RDONLY : O_WRONLY, 0) == 0;
+        }
+    };
+    setup_fd(stdin_pipe, stdin_mode, STDIN_FILENO, true);
+    setup_fd(stdout_pipe, stdout_mode, STDOUT_FILENO, false);
+    setup_fd(stderr_pipe, stderr_mode, STDERR_FILENO, false);
+    if (cwd)
+        ok = ok && posix_spawn_file_actions_addchdir_np(&actions, cwd.get()->data()) == 0;
+    if (do_setsid)
+        ok = ok && posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID) == 0;
+
+    // the environment of the child: ours, with the given variables replaced or removed
+    std::vector<std::string> env_strs;
+    for (char ** e = environ; *e != nullptr; e++)
+        env_strs.push_back(*e);
+    for (auto & entry : env) {
+        std::string prefix = std::string(entry.fst().data()) + "=";
+        for (auto it = env_strs.begin(); it != env_strs.end();) {
+            if (it->compare(0, prefix.size(), prefix) == 0)
+                it = env_strs.erase(it);
+            else
+                ++it;
         }
+        if (entry.snd())
+            env_strs.push_back(prefix + entry.snd().get()->data());
+    }
+    std::vector<char *> envp;
+    for (auto & e : env_strs)
+        envp.push_back(const_cast<char *>(e.c_str()));
+    envp.push_back(nullptr);
+
+    std::vector<char *> argv;
+    argv.push_back(const_cast<char *>(proc_name.data()));
+    for (auto & arg : args)
+        argv.push_back(const_cast<char *>(arg.data()));
+    argv.push_back(nullptr);
+
+    pid_t pid = -1;
+    if (ok && posix_spawnp(&pid, argv[0], &actions, &attr, argv.data(), envp.data()) != 0)
+        pid = -1;
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return pid;
+}
+#endif
 
-        buffer<char *> pargs;
-        pargs.push_back(strdup(proc_name.data()));
-        for (auto & arg : args)
-            pargs.push_back(strdup(arg.data()));
-        pargs.push_back(NULL);
+static obj_res spawn(string_ref const & proc_name, array_ref<string_ref> const & args, stdio stdin_mode, stdio stdout_mode,
+  stdio stderr_mode, option_ref<string_ref> const & cwd, env_mods const & env, bool do_setsid) {
+    /* Setup stdio based on process configuration. */
+    auto stdin_pipe  = setup_stdio(stdin_mode);
+    auto stdout_pipe = setup_stdio(stdout_mode);
+    auto stderr_pipe = setup_stdio(stderr_mode);
 
-        if (execvp(pargs[0], pargs.data()) < 0) {
-            std::cerr << "could not execute external process '" << pargs[0] << "'" << std::endl;
-            exit(-1);
+    pid_t pid = -1;
+#if defined(LEAN_POSIX_SPAWN)
+    pid = try_posix_spawn(proc_name, args, stdin_mode, stdout_mode, stderr_mode, stdin_pipe, stdout_pipe, stderr_pipe,
+                          cwd, env, do_setsid);
+#endif
+    if (pid == -1) {
+        pid = fork();
+        if (pid == 0) {
+            exec_child(proc_name, args, stdin_mode, stdout_mode, stderr_mode, stdin_pipe, stdout_pipe, stderr_pipe,
+                       cwd, env, do_setsid);
+        } else if (pid == -1) {
+            throw errno;
         }
-    } else if (pid == -1) {
-        throw errno;
     }
 
     object * parent_stdin  = box(0);
@@ -410,8 +697,20 @@ extern "C" LEAN_EXPORT obj_res lean_io_process_child_take_stdin(b_obj_arg, obj_a
     return lean_io_result_mk_ok(r.steal());
 }
 
-void initialize_process() {}
-void finalize_process() {}
+void initialize_process() {
+#if defined(__linux__) && defined(SYS_pidfd_open)
+    g_pidfds_mutex = new mutex();
+    g_pidfds       = new std::unordered_map<pid_t, std::shared_ptr<pidfd>>();
+    g_reaping      = new std::unordered_set<pid_t>();
+#endif
+}
+void finalize_process() {
+#if defined(__linux__) && defined(SYS_pidfd_open)
+    delete g_reaping;
+    delete g_pidfds;
+    delete g_pidfds_mutex;
+#endif
+}
 
 #endif
 
@@ -4,10 +4,24 @@ Released under Apache 2.0 license as described in the file LICENSE.
 
 Author: Leonardo de Moura
 */
+#include <algorithm>
+#include <memory>
+#include <unordered_set>
 #include <vector>
 #include <cstring>
 #include "runtime/object.h"
 #include "runtime/hash.h"
+#include "runtime/thread.h"
+#include "runtime/flat_hash_table.h"
+
+// number of shards of the concurrent set used by `lean_sharecommon_par`
+#define LEAN_PAR_SHARECOMMON_SHARDS 256
+// number of subgraphs per thread created by `lean_sharecommon_par`, for load balancing
+#define LEAN_PAR_SHARECOMMON_CHUNKS_PER_THREAD 16
+// minimum number of subgraphs for `lean_sharecommon_par` to use multiple threads
+#define LEAN_PAR_SHARECOMMON_MIN_ITEMS 32
+// maximum depth of the spine in `lean_sharecommon_par`, which bounds the work on long lists
+#define LEAN_PAR_SHARECOMMON_MAX_DEPTH 64
 
 namespace lean {
 
@@ -33,7 +47,7 @@ extern "C" LEAN_EXPORT uint64_t lean_sharecommon_hash(b_obj_arg o) {
     // hash relevant parts of the header
     unsigned init = hash(lean_ptr_tag(o), lean_ptr_other(o));
     // hash body
-    return hash_str(sz - header_sz, reinterpret_cast<unsigned char const *>(o) + header_sz, init);
+    return hash_bytes(sz - header_sz, reinterpret_cast<unsigned char const *>(o) + header_sz, init);
 }
 
 static obj_res mk_pair(obj_arg a, obj_arg b) {
@@ -268,4 +282,363 @@ public:
 extern "C" LEAN_EXPORT obj_res lean_state_sharecommon(b_obj_arg tc, obj_arg s, obj_arg a) {
     return sharecommon_fn(tc, s)(a);
 }
+
+
+/* An object in a set of maximally shared objects. */
+struct sharecommon_set_entry {
+    object * m_obj  = nullptr;
+    uint64   m_hash = 0;
+    bool empty() const { return m_obj == nullptr; }
+    uint64 hash() const { return m_hash; }
+};
+
+/* Set of maximally shared objects of a single `sharecommon_quick_fn`. It owns a reference to each of them. */
+class sharecommon_local_set {
+    flat_hash_table<sharecommon_set_entry> m_table;
+    std::vector<lean_object*>              m_owned;
+public:
+    sharecommon_local_set():m_table(1024) {}
+
+    ~sharecommon_local_set() {
+        for (lean_object * o : m_owned)
+            lean_dec(o);
+    }
+
+    /* Return the object equivalent to `o` (with `lean_sharecommon_hash(o) == h`) in the set. If there is none,
+       insert the object created by `mk()` instead, which must be equivalent to `o`. */
+    template<typename Mk> object * find_or_insert(b_obj_arg o, uint64 h, Mk const & mk) {
+        sharecommon_set_entry const * e = m_table.find(h, [&](sharecommon_set_entry const & e) {
+            return e.m_hash == h && lean_sharecommon_eq(e.m_obj, o);
+        });
+        if (e)
+            return e->m_obj;
+        sharecommon_set_entry n;
+        n.m_obj  = mk();
+        n.m_hash = h;
+        m_table.insert(n);
+        m_owned.push_back(n.m_obj);
+        return n.m_obj;
+    }
+};
+
+/*
+  Set of maximally shared objects used concurrently by several `sharecommon_quick_fn` workers, see
+  `lean_sharecommon_par`. It is split into shards, each protected by its own mutex. New objects are marked as
+  multi-threaded before they become visible to other workers.
+*/
+class sharecommon_concurrent_set {
+    struct shard {
+        mutex                           m_mutex;
+        sharecommon_local_set           m_set;
+    };
+    std::unique_ptr<shard[]> m_shards;
+public:
+    sharecommon_concurrent_set():m_shards(new shard[LEAN_PAR_SHARECOMMON_SHARDS]) {}
+
+    template<typename Mk> object * find_or_insert(b_obj_arg o, uint64 h, Mk const & mk) {
+        shard & s = m_shards[h % LEAN_PAR_SHARECOMMON_SHARDS];
+        lock_guard<mutex> lock(s.m_mutex);
+        return s.m_set.find_or_insert(o, h, [&]() {
+            object * r = mk();
+            lean_mark_mt(r);
+            return r;
+        });
+    }
+};
+
+/*
+  Like `sharecommon_fn` with a fresh state, but the maps and sets are native open-addressing tables instead of the
+  `StateFactory` ones, which are only accessible through closures. Objects whose children are already maximally shared
+  (and which do not have unused capacity) are reused instead of copied. The maximally shared objects are stored in
+  `Set`, which may be shared with other `sharecommon_quick_fn` objects.
+*/
+template<typename Set>
+class sharecommon_quick_fn {
+    struct cache_entry {
+        object * m_key   = nullptr;
+        object * m_value = nullptr;
+        bool empty() const { return m_key == nullptr; }
+        uint64 hash() const { return reinterpret_cast<size_t>(m_key); }
+    };
+    Set &                        m_set;
+    // maps visited objects to their maximally shared representation in `m_set`
+    flat_hash_table<cache_entry> m_cache;
+    std::vector<lean_object*>    m_children;
+    std::vector<lean_object*>    m_todo;
+    std::vector<uint64>          m_scratch;
+
+    object * find_cached(b_obj_arg a) const {
+        cache_entry const * e = m_cache.find(reinterpret_cast<size_t>(a), [&](cache_entry const & e) { return e.m_key == a; });
+        return e ? e->m_value : nullptr;
+    }
+
+    bool push_child(b_obj_arg a) {
+        if (lean_is_scalar(a)) {
+            m_children.push_back(a);
+            return true;
+        }
+        switch (lean_ptr_tag(a)) {
+        case LeanReserved:
+            lean_unreachable();
+        // We do not maximize sharing for the following kinds of objects
+        case LeanMPZ:      case LeanThunk:
+        case LeanTask:     case LeanRef:
+        case LeanExternal: case LeanClosure:
+            m_children.push_back(a);
+            return true;
+        default:
+            break;
+        }
+        if (object * r = find_cached(a)) {
+            m_children.push_back(r);
+            return true;
+        }
+        m_todo.push_back(a);
+        return false;
+    }
+
+    void cache(b_obj_arg a, b_obj_arg r) {
+        lean_assert(m_todo.size() > 0);
+        lean_assert(m_todo.back() == a);
+        m_todo.pop_back();
+        cache_entry c;
+        c.m_key   = a;
+        c.m_value = r;
+        m_cache.insert(c);
+    }
+
+    /* `a` itself is maximally shared unless we already have an equivalent object. */
+    void save_self(b_obj_arg a) {
+        cache(a, m_set.find_or_insert(a, lean_sharecommon_hash(a), [&]() { lean_inc(a); return a; }));
+    }
+
+    /* Record the maximally shared representation of `a`, which is `new_a` unless we already have an equivalent object. */
+    void save(b_obj_arg a, obj_arg new_a) {
+        object * r = m_set.find_or_insert(new_a, lean_sharecommon_hash(new_a), [&]() { return new_a; });
+        if (r != new_a)
+            lean_dec(new_a);
+        cache(a, r);
+    }
+
+    void visit_array(b_obj_arg a) {
+        m_children.clear();
+        bool missing_children = false;
+        bool unchanged = true;
+        size_t sz = array_size(a);
+        for (size_t i = 0; i < sz; i++) {
+            if (!push_child(lean_array_get_core(a, i))) {
+                missing_children = true;
+            } else if (m_children.back() != lean_array_get_core(a, i)) {
+                unchanged = false;
+            }
+        }
+        if (missing_children)
+            return;
+        if (unchanged && lean_array_capacity(a) == sz) {
+            save_self(a);
+            return;
+        }
+        lean_array_object * new_a = (lean_array_object*)lean_alloc_array(sz, sz);
+        for (size_t i = 0; i < sz; i++) {
+            lean_inc(m_children[i]);
+            lean_array_set_core((lean_object*)new_a, i, m_children[i]);
+        }
+        save(a, (lean_object*)new_a);
+    }
+
+    void visit_sarray(b_obj_arg a) {
+        size_t sz        = lean_sarray_size(a);
+        unsigned elem_sz = lean_sarray_elem_size(a);
+        if (lean_sarray_capacity(a) == sz) {
+            save_self(a);
+            return;
+        }
+        lean_sarray_object * new_a = (lean_sarray_object*)lean_alloc_sarray(elem_sz, sz, sz);
+        memcpy(new_a->m_data, lean_to_sarray(a)->m_data, elem_sz*sz);
+        save(a, (lean_object*)new_a);
+    }
+
+    void visit_string(b_obj_arg a) {
+        size_t sz     = lean_string_size(a);
+        size_t len    = lean_string_len(a);
+        if (lean_string_capacity(a) == sz) {
+            save_self(a);
+            return;
+        }
+        lean_string_object * new_a = (lean_string_object*)lean_alloc_string(sz, sz, len);
+        memcpy(new_a->m_data, lean_to_string(a)->m_data, sz);
+        save(a, (lean_object*)new_a);
+    }
+
+    void visit_ctor(b_obj_arg a) {
+        m_children.clear();
+        unsigned num_objs  = lean_ctor_num_objs(a);
+        bool missing_child = false;
+        bool unchanged     = true;
+        for (unsigned i = 0; i < num_objs; i++) {
+            if (!push_child(lean_ctor_get(a, i))) {
+                missing_child = true;
+            } else if (m_children.back() != lean_ctor_get(a, i)) {
+                unchanged = false;
+            }
+        }
+        if (missing_child)
+            return;
+        if (unchanged) {
+            save_self(a);
+            return;
+        }
+        unsigned tag           = lean_ptr_tag(a);
+        unsigned sz            = lean_object_byte_size(a);
+        unsigned scalar_offset = sizeof(lean_object) + num_objs*sizeof(void*);
+        unsigned scalar_sz     = sz - scalar_offset;
+        /* Most visited objects turn out to have an equivalent shared object, so we first build the new object in a
+           scratch buffer, and only allocate it if it is really new. */
+        m_scratch.resize((sz + sizeof(uint64) - 1) / sizeof(uint64));
+        lean_object * tmp = reinterpret_cast<lean_object*>(m_scratch.data());
+        lean_set_non_heap_header(tmp, sz, tag, num_objs);
+        memcpy(lean_ctor_obj_cptr(tmp), m_children.data(), num_objs*sizeof(void*));
+        memcpy(reinterpret_cast<char*>(tmp) + scalar_offset, reinterpret_cast<char*>(a) + scalar_offset, scalar_sz);
+        cache(a, m_set.find_or_insert(tmp, lean_sharecommon_hash(tmp), [&]() {
+            lean_object * new_a = lean_alloc_ctor(tag, num_objs, scalar_sz);
+            for (unsigned i = 0; i < num_objs; i++)
+                lean_inc(m_children[i]);
+            memcpy(reinterpret_cast<char*>(new_a) + sizeof(lean_object), reinterpret_cast<char*>(tmp) + sizeof(lean_object),
+                   sz - sizeof(lean_object));
+            return new_a;
+        }));
+    }
+
+public:
+    explicit sharecommon_quick_fn(Set & s):m_set(s), m_cache(1024) {}
+
+    /* Record that `r`, an object of `m_set`, is the maximally shared representation of `a`. */
+    void add_cached(b_obj_arg a, b_obj_arg r) {
+        if (!find_cached(a)) {
+            m_todo.push_back(a);
+            cache(a, r);
+        }
+    }
+
+    /* Return the maximally shared representation of `a`. The result is borrowed from `m_set` or `a`. */
+    b_obj_res visit(b_obj_arg a) {
+        m_children.clear();
+        if (push_child(a))
+            return m_children.back();
+        while (!m_todo.empty()) {
+            b_obj_arg curr = m_todo.back();
+            if (find_cached(curr)) {
+                // pushed again by another parent before it was visited
+                m_todo.pop_back();
+                continue;
+            }
+            switch (lean_ptr_tag(curr)) {
+            case LeanArray:           visit_array(curr); break;
+            case LeanScalarArray:     visit_sarray(curr); break;
+            case LeanString:          visit_string(curr); break;
+            default:                  visit_ctor(curr); break;
+            }
+        }
+        object * r = find_cached(a);
+        lean_assert(r);
+        return r;
+    }
+};
+
+// def ShareCommon.shareCommon' (a : @& α) : α
+extern "C" LEAN_EXPORT obj_res lean_sharecommon_quick(b_obj_arg a) {
+    sharecommon_local_set s;
+    object * r = sharecommon_quick_fn<sharecommon_local_set>(s).visit(a);
+    lean_inc(r);
+    return r;
+}
+
+static bool is_shareable(b_obj_arg o) {
+    if (lean_is_scalar(o))
+        return false;
+    uint8 tag = lean_ptr_tag(o);
+    return tag <= LeanMaxCtorTag || tag == LeanArray || tag == LeanScalarArray || tag == LeanString;
+}
+
+/*
+  Split the graph reachable from `a` into independent subgraphs: starting at `a`, objects are repeatedly replaced by
+  their children until there are at least `min_items` of them. The objects above the returned ones are the "spine".
+*/
+static std::vector<object*> sharecommon_par_items(b_obj_arg a, size_t min_items) {
+    std::vector<object*> items;
+    items.push_back(a);
+    for (unsigned depth = 0; depth < LEAN_PAR_SHARECOMMON_MAX_DEPTH && items.size() < min_items; depth++) {
+        std::vector<object*> next;
+        std::unordered_set<object*> visited;
+        bool expanded = false;
+        auto add = [&](object * c) {
+            if (is_shareable(c) && visited.insert(c).second)
+                next.push_back(c);
+        };
+        for (object * o : items) {
+            if (lean_ptr_tag(o) == LeanArray && lean_array_size(o) > 0) {
+                for (size_t i = 0; i < lean_array_size(o); i++)
+                    add(lean_array_get_core(o, i));
+                expanded = true;
+            } else if (lean_ptr_tag(o) <= LeanMaxCtorTag && lean_ctor_num_objs(o) > 0) {
+                for (unsigned i = 0; i < lean_ctor_num_objs(o); i++)
+                    add(lean_ctor_get(o, i));
+                expanded = true;
+            } else {
+                add(o);
+            }
+        }
+        if (!expanded)
+            break;
+        items.swap(next);
+    }
+    return items;
+}
+
+/*
+  Parallel version of `lean_sharecommon_quick`. Independent subgraphs are processed bottom-up by up to `num_threads`
+  workers with private pointer caches, but a single concurrent set of maximally shared objects. Subgraphs reachable
+  from several items may be visited more than once, but end up as the same objects. Finally, the spine above the items
+  is processed on the current thread.
+
+  Since every object is canonicalized in the same set, the result is maximally shared, and its shape does not depend
+  on `num_threads` or on scheduling. Only which of several equivalent input objects is reused may differ.
+*/
+extern "C" LEAN_EXPORT obj_res lean_sharecommon_par(b_obj_arg a, uint32 num_threads) {
+    if (num_threads == 0)
+        num_threads = std::max(hardware_concurrency(), 1u);
+    if (num_threads == 1 || !is_shareable(a))
+        return lean_sharecommon_quick(a);
+    std::vector<object*> items = sharecommon_par_items(a, static_cast<size_t>(num_threads) * LEAN_PAR_SHARECOMMON_CHUNKS_PER_THREAD);
+    if (items.size() < LEAN_PAR_SHARECOMMON_MIN_ITEMS)
+        return lean_sharecommon_quick(a);
+    // objects of `a` may be reused by any worker
+    lean_mark_mt(a);
+
+    sharecommon_concurrent_set s;
+    size_t num_chunks = std::min(items.size(), static_cast<size_t>(num_threads) * LEAN_PAR_SHARECOMMON_CHUNKS_PER_THREAD);
+    std::vector<object*> results(items.size());
+    atomic<size_t> next(0);
+    auto worker = [&]() {
+        size_t c;
+        while ((c = next++) < num_chunks) {
+            sharecommon_quick_fn<sharecommon_concurrent_set> fn(s);
+            for (size_t i = c * items.size() / num_chunks; i < (c + 1) * items.size() / num_chunks; i++)
+                results[i] = fn.visit(items[i]);
+        }
+    };
+    std::vector<std::unique_ptr<lthread>> threads;
+    for (unsigned t = 1; t < std::min(static_cast<size_t>(num_threads), num_chunks); t++)
+        threads.emplace_back(new lthread(worker));
+    worker();
+    for (auto & t : threads)
+        t->join();
+
+    sharecommon_quick_fn<sharecommon_concurrent_set> fn(s);
+    for (size_t i = 0; i < items.size(); i++)
+        fn.add_cached(items[i], results[i]);
+    object * r = fn.visit(a);
+    lean_inc(r);
+    return r;
+}
 };
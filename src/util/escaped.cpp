@@ -40,4 +40,19 @@ std::ostream & operator<<(std::ostream & out, escaped const & s) {
     return out;
 }
 
+std::ostream & operator<<(std::ostream & out, json_escaped const & s) {
+    static char const * hex = "0123456789abcdef";
+    out << '"';
+    for (unsigned char c : s.m_str) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (c < 0x20) {
+            out << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+    return out;
+}
 }
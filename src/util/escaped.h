@@ -7,6 +7,7 @@ Author: Leonardo de Moura
 #pragma once
 
 #include <iostream>
+#include <string>
 
 namespace lean {
 /**
@@ -22,4 +23,12 @@ public:
     escaped(char const * str, bool trim_nl = false, unsigned indent = 0):m_str(str), m_trim_nl(trim_nl), m_indent(indent) {}
     friend std::ostream & operator<<(std::ostream & out, escaped const & s);
 };
+
+/** \brief Helper class for printing strings as JSON string literals, including the quotes. */
+class json_escaped {
+    std::string const & m_str;
+public:
+    explicit json_escaped(std::string const & str):m_str(str) {}
+    friend std::ostream & operator<<(std::ostream & out, json_escaped const & s);
+};
 }
@@ -0,0 +1,155 @@
+/*
+Copyright (c) 2023 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#include <cstring>
+#include <vector>
+#include <cstdint>
+#include "util/lz4.h"
+
+/* Constraints of the LZ4 block format: a match is at least 4 bytes long and at most 65535 bytes back, the last 5 bytes
+   are always literals, and the last match must start at least 12 bytes before the end of the block. */
+#define LZ4_MIN_MATCH      4
+#define LZ4_MAX_OFFSET     65535
+#define LZ4_LAST_LITERALS  5
+#define LZ4_MF_LIMIT       12
+#define LZ4_HASH_LOG       16
+
+namespace lean {
+static inline uint32_t read32(char const * p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash4(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ4_HASH_LOG);
+}
+
+static inline void write_length(char *& op, size_t len) {
+    while (len >= 255) {
+        *op++ = static_cast<char>(255);
+        len -= 255;
+    }
+    *op++ = static_cast<char>(len);
+}
+
+/* Append a sequence of `lit_len` literals followed by a match of `match_len` bytes at distance `offset`, or only the
+   literals if `match_len == 0`. */
+static bool emit_sequence(char *& op, char * oend, char const * lit, size_t lit_len, size_t offset, size_t match_len) {
+    size_t need = 1 + lit_len / 255 + 1 + lit_len + 2 + match_len / 255 + 1;
+    if (static_cast<size_t>(oend - op) < need)
+        return false;
+    unsigned char * token = reinterpret_cast<unsigned char *>(op++);
+    if (lit_len >= 15) {
+        *token = 15 << 4;
+        write_length(op, lit_len - 15);
+    } else {
+        *token = static_cast<unsigned char>(lit_len << 4);
+    }
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (match_len > 0) {
+        *op++ = static_cast<char>(offset & 0xff);
+        *op++ = static_cast<char>(offset >> 8);
+        size_t ml = match_len - LZ4_MIN_MATCH;
+        if (ml >= 15) {
+            *token |= 15;
+            write_length(op, ml - 15);
+        } else {
+            *token |= static_cast<unsigned char>(ml);
+        }
+    }
+    return true;
+}
+
+size_t lz4_compress_block(char const * src, size_t src_size, char * dst, size_t dst_capacity) {
+    char * op   = dst;
+    char * oend = dst + dst_capacity;
+    size_t anchor = 0;
+    if (src_size > LZ4_MF_LIMIT) {
+        std::vector<uint32_t> table(1u << LZ4_HASH_LOG, 0);
+        size_t limit       = src_size - LZ4_MF_LIMIT;
+        size_t match_limit = src_size - LZ4_LAST_LITERALS;
+        size_t ip = 0;
+        while (ip < limit) {
+            uint32_t seq = read32(src + ip);
+            uint32_t h   = hash4(seq);
+            size_t ref = table[h];
+            table[h]   = static_cast<uint32_t>(ip);
+            if (ref < ip && ip - ref <= LZ4_MAX_OFFSET && read32(src + ref) == seq) {
+                while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+                    ip--;
+                    ref--;
+                }
+                size_t len = LZ4_MIN_MATCH;
+                while (ip + len < match_limit && src[ip + len] == src[ref + len])
+                    len++;
+                if (!emit_sequence(op, oend, src + anchor, ip - anchor, ip - ref, len))
+                    return 0;
+                ip    += len;
+                anchor = ip;
+            } else {
+                ip++;
+            }
+        }
+    }
+    if (!emit_sequence(op, oend, src + anchor, src_size - anchor, 0, 0))
+        return 0;
+    return op - dst;
+}
+
+bool lz4_decompress_block(char const * src, size_t src_size, char * dst, size_t dst_size) {
+    unsigned char const * ip   = reinterpret_cast<unsigned char const *>(src);
+    unsigned char const * iend = ip + src_size;
+    char * op   = dst;
+    char * oend = dst + dst_size;
+    while (ip < iend) {
+        unsigned token = *ip++;
+        size_t lit_len = token >> 4;
+        if (lit_len == 15) {
+            unsigned b;
+            do {
+                if (ip == iend) return false;
+                b = *ip++;
+                lit_len += b;
+            } while (b == 255);
+        }
+        if (static_cast<size_t>(iend - ip) < lit_len || static_cast<size_t>(oend - op) < lit_len)
+            return false;
+        memcpy(op, ip, lit_len);
+        op += lit_len;
+        ip += lit_len;
+        if (ip == iend)
+            return op == oend; // the last sequence has no match
+        if (iend - ip < 2)
+            return false;
+        size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > static_cast<size_t>(op - dst))
+            return false;
+        size_t match_len = token & 15;
+        if (match_len == 15) {
+            unsigned b;
+            do {
+                if (ip == iend) return false;
+                b = *ip++;
+                match_len += b;
+            } while (b == 255);
+        }
+        match_len += LZ4_MIN_MATCH;
+        if (static_cast<size_t>(oend - op) < match_len)
+            return false;
+        char const * match = op - offset;
+        if (offset >= match_len) {
+            memcpy(op, match, match_len);
+            op += match_len;
+        } else {
+            // overlapping copy, which repeats the last `offset` bytes
+            for (size_t i = 0; i < match_len; i++)
+                *op++ = match[i];
+        }
+    }
+    return false;
+}
+}
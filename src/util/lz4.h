@@ -0,0 +1,19 @@
+/*
+Copyright (c) 2023 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Minimal implementation of the LZ4 block format, used for compressed .olean files.
+*/
+#pragma once
+#include <cstddef>
+
+namespace lean {
+/* Upper bound on the size of the compressed form of `src_size` bytes. */
+inline size_t lz4_compress_bound(size_t src_size) { return src_size + src_size / 255 + 16; }
+/* Compress `src_size` bytes at `src` into a single LZ4 block at `dst`. Return the size of the block, or `0` if it does
+   not fit into `dst_capacity` bytes. */
+size_t lz4_compress_block(char const * src, size_t src_size, char * dst, size_t dst_capacity);
+/* Decompress the LZ4 block of `src_size` bytes at `src`, which must decompress to exactly `dst_size` bytes, into `dst`.
+   Return `false` if the block is malformed. */
+bool lz4_decompress_block(char const * src, size_t src_size, char * dst, size_t dst_size);
+}
@@ -9,6 +9,7 @@ Author: Leonardo de Moura
 #include <signal.h>
 #include <cctype>
 #include <cstdlib>
+#include <sstream>
 #include <string>
 #include <utility>
 #include <vector>
@@ -31,6 +32,7 @@ Author: Leonardo de Moura
 #include "kernel/kernel_exception.h"
 #include "library/formatter.h"
 #include "library/module.h"
+#include "library/olean_stats.h"
 #include "library/time_task.h"
 #include "library/compiler/ir.h"
 #include "library/trace.h"
@@ -160,6 +162,9 @@ using namespace lean; // NOLINT
 #ifndef LEAN_SERVER_DEFAULT_MAX_MEMORY
 #define LEAN_SERVER_DEFAULT_MAX_MEMORY 1024
 #endif
+#ifndef LEAN_DAEMON_DEFAULT_CACHE_ENTRIES
+#define LEAN_DAEMON_DEFAULT_CACHE_ENTRIES 8
+#endif
 #ifndef LEAN_DEFAULT_MAX_MEMORY
 #define LEAN_DEFAULT_MAX_MEMORY 0
 #endif
@@ -218,9 +223,19 @@ static void display_help(std::ostream & out) {
     std::cout << "  --plugin=file      load and initialize Lean shared library for registering linters etc.\n";
     std::cout << "  --load-dynlib=file load shared library to make its symbols available to the interpreter\n";
     std::cout << "  --deps             just print dependencies of a Lean input\n";
+    std::cout << "  --olean-stats      print size and composition statistics of the given .olean files as JSON\n";
+    std::cout << "  --daemon[=num]     compile the files requested on stdin, one request per line, keeping the imports of\n"
+              << "                     up to num (default: " << LEAN_DAEMON_DEFAULT_CACHE_ENTRIES << ") import sets loaded between requests\n";
+    std::cout << "  --daemon-memory=num maximum memory used by the imports cached by --daemon (in megabytes); not a hard\n"
+              << "                     limit: the .olean files read stay mapped for the lifetime of the daemon and\n"
+              << "                     count towards it\n";
+    std::cout << "  --olean-pool=file  write an object pool of the objects shared by the given .olean files,\n"
+              << "                     to be referenced by .olean files written with LEAN_OLEAN_POOL=file\n";
     std::cout << "  --print-prefix     print the installation prefix for Lean and exit\n";
     std::cout << "  --print-libdir     print the installation directory for Lean's built-in libraries and exit\n";
     std::cout << "  --profile          display elaboration/type checking time for each definition/theorem\n";
+    std::cout << "  --profile-json=file  write elaboration/type checking times per category and per definition/theorem,\n"
+              << "                     heartbeats, peak memory usage, and allocator counters to file as JSON\n";
     std::cout << "  --stats            display environment statistics\n";
     DEBUG_CODE(
     std::cout << "  --debug=tag        enable assertions with the given tag\n";
@@ -243,10 +258,15 @@ static struct option g_long_options[] = {
     {"memory",       required_argument, 0, 'M'},
     {"trust",        required_argument, 0, 't'},
     {"profile",      no_argument,       0, 'P'},
+    {"profile-json", required_argument, 0, 'Z'},
     {"stats",        no_argument,       0, 'a'},
     {"quiet",        no_argument,       0, 'q'},
     {"deps",         no_argument,       0, 'd'},
     {"deps-json",    no_argument,       0, 'J'},
+    {"olean-stats",  no_argument,       0, 'O'},
+    {"olean-pool",   required_argument, 0, 'Q'},
+    {"daemon",       optional_argument, 0, 'X'},
+    {"daemon-memory", required_argument, 0, 'Y'},
     {"timeout",      optional_argument, 0, 'T'},
     {"c",            optional_argument, 0, 'c'},
     {"bc",           optional_argument, 0, 'b'},
@@ -431,6 +451,106 @@ void check_optarg(char const * option_name) {
 }
 
 extern "C" object * lean_enable_initializer_execution(object * w);
+extern "C" object * lean_set_import_cache_limits(object * max_entries, object * max_megabytes, object * w);
+
+/* Split a `--daemon` request into its tab-separated arguments. */
+static std::vector<std::string> split_daemon_request(std::string const & line) {
+    std::vector<std::string> args;
+    std::istringstream in(line);
+    std::string arg;
+    while (std::getline(in, arg, '\t')) {
+        if (!arg.empty())
+            args.push_back(arg);
+    }
+    return args;
+}
+
+/* Compile a single file requested from `lean --daemon`, see `run_daemon`. Return the exit code `lean` would have
+   returned for the same arguments. */
+static int run_daemon_request(std::vector<std::string> const & args, options const & opts, unsigned trust_lvl,
+                              optional<std::string> root_dir) {
+    optional<std::string> mod_fn;
+    optional<std::string> olean_fn;
+    optional<std::string> ilean_fn;
+    optional<std::string> c_output;
+    for (size_t i = 0; i < args.size(); i++) {
+        if ((args[i] == "-o" || args[i] == "-i" || args[i] == "-c" || args[i] == "-R") && i + 1 < args.size()) {
+            std::string const & val = args[++i];
+            switch (args[i - 1][1]) {
+            case 'o': olean_fn = val; break;
+            case 'i': ilean_fn = val; break;
+            case 'c': c_output = val; break;
+            default:  root_dir = val; break;
+            }
+        } else if (args[i][0] != '-' && !mod_fn) {
+            mod_fn = args[i];
+        } else {
+            std::cerr << "invalid daemon request argument '" << args[i] << "'\n";
+            return 1;
+        }
+    }
+    if (!mod_fn) {
+        std::cerr << "Expected exactly one file name\n";
+        return 1;
+    }
+    std::string contents = read_file(*mod_fn);
+    optional<name> main_module_name = module_name_of_file(*mod_fn, root_dir, /* optional */ !olean_fn && !c_output);
+    if (!main_module_name)
+        main_module_name = name("_stdin");
+    pair_ref<environment, object_ref> r = run_new_frontend(contents, opts, *mod_fn, *main_module_name, trust_lvl, ilean_fn);
+    environment env = r.fst();
+    bool ok = unbox(r.snd().raw());
+    if (olean_fn && ok) {
+        time_task t(".olean serialization", opts);
+        write_module(env, *olean_fn);
+    }
+    if (c_output && ok) {
+        std::ofstream out(*c_output, std::ios_base::binary);
+        if (out.fail()) {
+            std::cerr << "failed to create '" << *c_output << "'\n";
+            return 1;
+        }
+        time_task _("C code generation", opts);
+        out << lean::ir::emit_c(env, *main_module_name).data();
+    }
+    return ok ? 0 : 1;
+}
+
+/* Compile the files requested on stdin until it is closed. Each request is a line of tab-separated arguments: the
+   input file, and optionally `-o`, `-i`, `-c`, and `-R` followed by their values as for a single `lean` invocation.
+   The remaining options are fixed for all requests. After the messages of a request, a line `{"exitCode": n}` is
+   printed to stdout. Imports are cached between requests, see `Lean.ImportCache`. */
+static int run_daemon(options const & opts, unsigned trust_lvl, optional<std::string> const & root_dir,
+                      unsigned max_cache_entries, unsigned max_cache_megabytes) {
+    consume_io_result(lean_set_import_cache_limits(lean_unsigned_to_nat(max_cache_entries),
+                                                   lean_unsigned_to_nat(max_cache_megabytes), io_mk_world()));
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        std::vector<std::string> args = split_daemon_request(line);
+        if (args.empty())
+            continue;
+        int ret = 1;
+        try {
+            ret = run_daemon_request(args, opts, trust_lvl, root_dir);
+        } catch (lean::throwable & ex) {
+            std::cerr << ex.what() << "\n";
+        } catch (std::bad_alloc & ex) {
+            std::cerr << "out of memory" << std::endl;
+        }
+        std::cout << "{\"exitCode\": " << ret << "}" << std::endl;
+    }
+    return 0;
+}
+
+static bool write_profiling_json_file(std::string const & fn) {
+    std::ofstream out(fn);
+    if (out.fail()) {
+        std::cerr << "failed to create '" << fn << "'\n";
+        return false;
+    }
+    write_profiling_json(out);
+    return true;
+}
 
 extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
 #ifdef LEAN_EMSCRIPTEN
@@ -465,7 +585,13 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
     unsigned trust_lvl = LEAN_BELIEVER_TRUST_LEVEL + 1;
     bool only_deps = false;
     bool deps_json = false;
+    bool olean_stats = false;
+    optional<std::string> olean_pool_fn;
+    bool daemon = false;
+    unsigned daemon_cache_entries = LEAN_DAEMON_DEFAULT_CACHE_ENTRIES;
+    unsigned daemon_cache_megabytes = 0;
     bool stats = false;
+    optional<std::string> profile_json_fn;
     // 0 = don't run server, 1 = watchdog, 2 = worker
     int run_server = 0;
     unsigned num_threads    = 0;
@@ -570,6 +696,21 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
                 only_deps = true;
                 deps_json = true;
                 break;
+            case 'O':
+                olean_stats = true;
+                break;
+            case 'Q':
+                olean_pool_fn = optarg;
+                break;
+            case 'X':
+                daemon = true;
+                if (optarg)
+                    daemon_cache_entries = static_cast<unsigned>(atoi(optarg));
+                break;
+            case 'Y':
+                check_optarg("daemon-memory");
+                daemon_cache_megabytes = static_cast<unsigned>(atoi(optarg));
+                break;
             case 'a':
                 stats = true;
                 break;
@@ -592,6 +733,11 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
             case 'P':
                 opts = opts.update("profiler", true);
                 break;
+            case 'Z':
+                check_optarg("profile-json");
+                profile_json_fn = optarg;
+                enable_profiling_json();
+                break;
 #if defined(LEAN_DEBUG)
             case 'B':
                 check_optarg("B");
@@ -640,8 +786,8 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
         set_max_heartbeat_thousands(timeout);
     }
 
-    if (get_profiler(opts)) {
-        report_profiling_time("initialization", init_time);
+    if (get_profiler(opts) || profile_json_fn) {
+        report_profiling_time("initialization", init_time, get_profiler(opts));
     }
 
     environment env(trust_lvl);
@@ -657,6 +803,13 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
         else if (run_server == 2)
             return run_server_worker(opts);
 
+        if (daemon) {
+            int ret = run_daemon(opts, trust_lvl, root_dir, daemon_cache_entries, daemon_cache_megabytes);
+            if (profile_json_fn && !write_profiling_json_file(*profile_json_fn))
+                return 1;
+            return ret;
+        }
+
         if (only_deps && deps_json) {
             buffer<string_ref> fns;
             if (use_stdin) {
@@ -673,6 +826,24 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
             return 0;
         }
 
+        if (olean_stats) {
+            std::vector<std::string> fns;
+            for (int i = optind; i < argc; i++) {
+                fns.push_back(argv[i]);
+            }
+            print_olean_stats(std::cout, fns);
+            return 0;
+        }
+
+        if (olean_pool_fn) {
+            std::vector<std::string> fns;
+            for (int i = optind; i < argc; i++) {
+                fns.push_back(argv[i]);
+            }
+            write_olean_pool(*olean_pool_fn, fns);
+            return 0;
+        }
+
         if (use_stdin) {
             if (argc - optind != 0) {
                 mod_fn = argv[optind++];
@@ -727,6 +898,8 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
         if (run && ok) {
             uint32 ret = ir::run_main(env, opts, argc - optind, argv + optind);
             // environment_free_regions(std::move(env));
+            if (profile_json_fn && !write_profiling_json_file(*profile_json_fn))
+                return 1;
             return ret;
         }
         if (olean_fn && ok) {
@@ -756,6 +929,8 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
         }
 
         display_cumulative_profiling_times(std::cerr);
+        if (profile_json_fn && !write_profiling_json_file(*profile_json_fn))
+            return 1;
 
 #ifdef LEAN_SMALL_ALLOCATOR
         // If the small allocator is not enabled, then we assume we are not using the sanitizer.
@@ -770,5 +945,8 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
     } catch (std::bad_alloc & ex) {
         std::cerr << "out of memory" << std::endl;
     }
+    // still report the work done before the failure
+    if (profile_json_fn)
+        write_profiling_json_file(*profile_json_fn);
     return 1;
 }
@@ -0,0 +1,34 @@
+/-! Bulk `ByteArray` and `FloatArray` primitives on large arrays. -/
+
+def mkBytes (n : Nat) : ByteArray := Id.run do
+  let mut s : UInt32 := 17
+  let mut r := ByteArray.mkEmpty n
+  for _ in [0:n] do
+    s := s * 1664525 + 1013904223
+    r := r.push (s >>> 24).toUInt8
+  return r
+
+/-- Count occurrences of `b` by repeatedly searching for it. -/
+partial def count (a : ByteArray) (b : UInt8) (start := 0) (acc := 0) : Nat :=
+  match a.indexOf? b start with
+  | some i => count a b (i + 1) (acc + 1)
+  | none   => acc
+
+def main (args : List String) : IO Unit := do
+  let rounds := args.head!.toNat!
+  let a := mkBytes (1 <<< 24)
+  let b := a.fill 0 0 1
+  let mut n := 0
+  let mut eqs := 0
+  let mut lts := 0
+  for _ in [0:rounds] do
+    n := n + count a 10
+    if a == a.copySlice 0 .empty 0 a.size then eqs := eqs + 1
+    if compare b a == .lt then lts := lts + 1
+  IO.println s!"newlines: {n / rounds}, equal: {eqs}, less: {lts}"
+  let xs : FloatArray := ⟨(Array.range (1 <<< 20)).map (·.toFloat)⟩
+  let ys := xs.fill 1
+  let mut acc := 0
+  for _ in [0:rounds] do
+    acc := acc + ((xs.add ys).mul ys).dot xs
+  IO.println s!"dot: {acc / rounds.toFloat}, sum: {xs.sum}"
@@ -0,0 +1,27 @@
+/-! Read a large text file line by line using `Handle.getLine` vs. batched `Handle.readLines`. -/
+open IO.FS
+
+partial def countGetLine (h : Handle) (acc : Nat := 0) : IO Nat := do
+  let line ← h.getLine
+  if line.isEmpty then pure acc else countGetLine h (acc + line.length)
+
+partial def countReadLines (h : Handle) (acc : Nat := 0) : IO Nat := do
+  let batch ← h.readLines
+  if batch.isEmpty then pure acc else countReadLines h (batch.foldl (· + ·.length + 1) acc)
+
+def main (args : List String) : IO Unit := do
+  let mb := args.head!.toNat!
+  let path : System.FilePath := "getline.tmp"
+  let line := "0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstu\n".toUTF8
+  let chunk := (List.replicate 10000 line).foldl (· ++ ·) ByteArray.empty
+  withFile path .write fun h => do
+    for _ in [0:mb] do
+      h.write chunk
+  let t₀ ← IO.monoMsNow
+  let n₁ ← withFile path .read countGetLine
+  let t₁ ← IO.monoMsNow
+  let n₂ ← withFile path .read countReadLines
+  let t₂ ← IO.monoMsNow
+  IO.eprintln s!"getLine: {t₁ - t₀}ms, readLines: {t₂ - t₁}ms"
+  IO.println s!"chars: {n₁} {n₂}"
+  removeFile path
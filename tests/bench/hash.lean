@@ -0,0 +1,38 @@
+import Lean.Data.HashSet
+
+/-! Throughput of `ByteArray.hash` (MurmurHash64A, also used by `String.hash`) vs. `ByteArray.fastHash`. -/
+
+def mkBytes (n : Nat) (seed : UInt32 := 17) : ByteArray := Id.run do
+  let mut s := seed
+  let mut r := ByteArray.mkEmpty n
+  for _ in [0:n] do
+    s := s * 1664525 + 1013904223
+    r := r.push (s >>> 24).toUInt8
+  return r
+
+@[noinline] def hashAll (f : ByteArray → UInt64) (inputs : Array ByteArray) (rounds : Nat) : UInt64 := Id.run do
+  let mut h : UInt64 := 0
+  for _ in [0:rounds] do
+    for a in inputs do
+      h := h + f a
+  return h
+
+def bench (name : String) (inputs : Array ByteArray) (rounds : Nat) : IO Unit := do
+  for (fn, f) in [("hash", ByteArray.hash), ("fastHash", ByteArray.fastHash)] do
+    let t₀ ← IO.monoNanosNow
+    let h := hashAll f inputs rounds
+    let t₁ ← IO.monoNanosNow
+    let bytes := rounds * inputs.foldl (· + ·.size) 0
+    IO.eprintln s!"{name} {fn}: {(bytes.toFloat / (t₁ - t₀).toFloat)} GB/s ({h})"
+  let distinct := inputs.foldl (·.insert ·.fastHash) (Lean.HashSet.empty : Lean.HashSet UInt64)
+  IO.println s!"{name}: {distinct.size} distinct hashes"
+
+def main (args : List String) : IO Unit := do
+  let rounds := args.head!.toNat!
+  -- short keys, like the components of hierarchical names
+  let names := (Array.range 10000).map fun i => s!"Lean.Meta.aux_{i}".toUTF8
+  bench "names" names rounds
+  let medium := (Array.range 1000).map fun i => mkBytes (64 + i % 192) i.toUInt32
+  bench "medium" medium rounds
+  let large := #[mkBytes (1 <<< 24)]
+  bench "large" large (rounds / 10)
@@ -0,0 +1,20 @@
+/-! Hash a large file by reading it into a `ByteArray` vs. the streaming `IO.FS.hashFile`/`fastHashFile`. -/
+open IO.FS
+
+def main (args : List String) : IO Unit := do
+  let mb := args.head!.toNat!
+  let path : System.FilePath := "hash_file.tmp"
+  let chunk := ByteArray.mk ((List.range (1024 * 1024)).toArray.map (·.toUInt8))
+  withFile path .write fun h => do
+    for _ in [0:mb] do
+      h.write chunk
+  let t₀ ← IO.monoMsNow
+  let h₁ := hash (← readBinFile path)
+  let t₁ ← IO.monoMsNow
+  let h₂ ← hashFile path
+  let t₂ ← IO.monoMsNow
+  let h₃ ← fastHashFile path
+  let t₃ ← IO.monoMsNow
+  IO.eprintln s!"readBinFile+hash: {t₁ - t₀}ms, hashFile: {t₂ - t₁}ms, fastHashFile: {t₃ - t₂}ms"
+  IO.println s!"{h₁ == h₂} {h₃ != 0}"
+  removeFile path
@@ -0,0 +1,31 @@
+/-! Count the lines of a large file using `readBinFile` vs. a zero-copy `MappedFile`. -/
+open IO.FS
+
+partial def countBytes (a : ByteArray) (start := 0) (acc := 0) : Nat :=
+  match a.indexOf? 10 start with
+  | some i => countBytes a (i + 1) (acc + 1)
+  | none   => acc
+
+partial def countMapped (m : MappedFile) (start := 0) (acc := 0) : Nat :=
+  match m.indexOf? 10 start with
+  | some i => countMapped m (i + 1) (acc + 1)
+  | none   => acc
+
+def main (args : List String) : IO Unit := do
+  let mb := args.head!.toNat!
+  let path : System.FilePath := "mmap_read.tmp"
+  let line := "0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstu\n".toUTF8
+  let chunk := (List.replicate 10000 line).foldl (· ++ ·) ByteArray.empty
+  withFile path .write fun h => do
+    for _ in [0:mb] do
+      h.write chunk
+  let t₀ ← IO.monoMsNow
+  let n₁ := countBytes (← readBinFile path)
+  let t₁ ← IO.monoMsNow
+  let m ← MappedFile.mk path
+  m.advise .sequential
+  let n₂ := countMapped m
+  let t₂ ← IO.monoMsNow
+  IO.eprintln s!"readBinFile: {t₁ - t₀}ms, MappedFile: {t₂ - t₁}ms"
+  IO.println s!"lines: {n₁} {n₂}"
+  removeFile path
@@ -0,0 +1,28 @@
+import Lean
+
+/-! Read `.olean` files whose base address is already in use, which forces the relocating (non-`mmap`) path. -/
+open Lean
+
+def modules : Array Name :=
+  #[`Init.Prelude, `Init.Core, `Lean.Expr, `Lean.Environment, `Lean.Meta.Basic, `Lean.Elab.Term, `Lean.Elab.Command]
+
+unsafe def run (n : Nat) : IO Unit := do
+  initSearchPath (← findSysroot)
+  let fnames ← modules.mapM findOLean
+  -- keep a first copy of every file mapped at its base address so that all further reads have to relocate
+  let pinned ← fnames.mapM readModuleData
+  let t₀ ← IO.monoMsNow
+  let mut relocated := 0
+  for _ in [0:n] do
+    for fname in fnames do
+      let (_, region) ← readModuleData fname
+      unless region.isMemoryMapped do
+        relocated := relocated + 1
+      region.free
+  let t₁ ← IO.monoMsNow
+  IO.eprintln s!"relocating read: {(t₁ - t₀) * 1000 / (n * fnames.size)}us per file"
+  IO.println s!"relocated: {relocated}"
+  pinned.forM fun (_, region) => region.free
+
+def main (args : List String) : IO Unit :=
+  unsafe run args.head!.toNat!
@@ -0,0 +1,29 @@
+import Lean
+
+/-! Compare the native `ShareCommon.shareCommon'` with the `StateFactory`-based implementation on a large `Expr`. -/
+open Lean
+
+/-- A complete binary tree of applications of depth `d` where equal subterms are not shared. -/
+@[noinline] def mkTerm : Nat → Nat → Expr
+  | 0,     s => mkApp (mkConst `f [levelOne]) (mkNatLit (s % 2))
+  | d + 1, s => mkApp2 (mkConst `g) (mkTerm d s) (mkTerm d (s + 1))
+
+@[noinline] def shareCommonClosures (e : Expr) : Expr :=
+  (withShareCommon e : ShareCommon.ShareCommonM Expr).run
+
+@[noinline] def shareCommonNative (e : Expr) : Expr :=
+  ShareCommon.shareCommon' e
+
+def main (args : List String) : IO Unit := do
+  let d := args.head!.toNat!
+  let e₁ := mkTerm d 0
+  let e₂ := mkTerm d 0
+  let t₀ ← IO.monoMsNow
+  let r₁ := shareCommonClosures e₁
+  IO.println s!"closures: {r₁.approxDepth}"
+  let t₁ ← IO.monoMsNow
+  let r₂ := shareCommonNative e₂
+  IO.println s!"native: {r₂.approxDepth}"
+  let t₂ ← IO.monoMsNow
+  IO.eprintln s!"closures: {t₁ - t₀}ms, native: {t₂ - t₁}ms"
+  IO.println (r₁ == r₂)
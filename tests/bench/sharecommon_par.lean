@@ -0,0 +1,26 @@
+import Lean
+
+/-! Measure the scaling of `ShareCommon.shareCommonPar` on a large `Expr`. -/
+open Lean
+
+/-- A complete binary tree of applications of depth `d` where equal subterms are not shared. -/
+@[noinline] def mkTerm : Nat → Nat → Expr
+  | 0,     s => mkApp (mkConst `f [levelOne]) (mkNatLit (s % 1024))
+  | d + 1, s => mkApp2 (mkConst `g) (mkTerm d (2 * s)) (mkTerm d (2 * s + 1))
+
+@[noinline] def shareCommonPar (e : Expr) (n : Nat) : Expr :=
+  ShareCommon.shareCommonPar e n.toUInt32
+
+def main (args : List String) : IO Unit := do
+  let d := args.head!.toNat!
+  let mut prev : Option Expr := none
+  for n in [1, 2, 4, 8, 16, 32] do
+    let e := mkTerm d 0
+    let t₀ ← IO.monoMsNow
+    let r := shareCommonPar e n
+    IO.println s!"{n} threads: {r.approxDepth}"
+    let t₁ ← IO.monoMsNow
+    IO.eprintln s!"{n} threads: {t₁ - t₀}ms"
+    if let some p := prev then
+      unless p == r do throw <| IO.userError "results differ"
+    prev := r
@@ -0,0 +1,14 @@
+/-! Spawn many short-lived processes from a process with a large heap. -/
+
+def main (args : List String) : IO Unit := do
+  let n := args.head!.toNat!
+  -- make the heap large enough that copying the page tables on `fork` would be noticeable
+  let big := (List.range 4000000).toArray.map (· + 1)
+  let t₀ ← IO.monoMsNow
+  for _ in [0:n] do
+    let out ← IO.Process.output { cmd := "true" }
+    unless out.exitCode == 0 do
+      throw <| IO.userError "process failed"
+  let t₁ ← IO.monoMsNow
+  IO.eprintln s!"spawn: {(t₁ - t₀) * 1000 / n}us per process"
+  IO.println s!"heap: {big.size}"
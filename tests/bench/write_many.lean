@@ -0,0 +1,27 @@
+/-! Write many small fragments to a file using `Handle.putStr` vs. batched `Handle.putStrMany`. -/
+open IO.FS
+
+def fragments : Array String := Id.run do
+  let mut r := #[]
+  for i in [0:1000] do
+    r := r.push s!"x_{i} "
+    r := r.push "(fun y => y + 1)\n"
+  return r
+
+def main (args : List String) : IO Unit := do
+  let n := args.head!.toNat!
+  let path : System.FilePath := "write_many.tmp"
+  let t₀ ← IO.monoMsNow
+  withFile path .write fun h => do
+    for _ in [0:n] do
+      for s in fragments do
+        h.putStr s
+  let t₁ ← IO.monoMsNow
+  withFile path .write fun h => do
+    h.setBufferSize (1024 * 1024)
+    for _ in [0:n] do
+      h.putStrMany fragments
+  let t₂ ← IO.monoMsNow
+  IO.eprintln s!"putStr: {t₁ - t₀}ms, putStrMany: {t₂ - t₁}ms"
+  IO.println s!"size: {(← path.metadata).byteSize}"
+  removeFile path
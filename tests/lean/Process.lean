@@ -57,3 +57,37 @@ def usingIO {α} (x : IO α) : IO α := x
   let (stdin, lean) ← lean.takeStdin
   stdin.putStr "#exit\n"
   lean.wait
+
+#eval usingIO do
+  let out ← output { cmd := "sh", args := #["-c", "pwd; echo $LEAN_PROCESS_TEST; echo ${HOME:-unset}"], cwd := "/", env := #[("LEAN_PROCESS_TEST", "set"), ("HOME", none)] };
+  IO.print out.stdout
+
+#eval usingIO do
+  let out ← output { cmd := "sh", args := #["-c", "kill -0 -$$ && echo new process group"], setsid := true };
+  IO.print out.stdout
+
+#eval usingIO do
+  -- errors are still reported by the child process
+  let out ← output { cmd := "does-not-exist" };
+  IO.println out.exitCode
+
+#eval usingIO do
+  -- children exit once they have read a line, so they terminate exactly in the order in which they are released
+  let child ← spawn { cmd := "sh", args := #["-c", "read x; exit 3"], stdin := .piped };
+  IO.println (← child.tryWait)
+  let children ← #[4, 0, 2].mapM fun (d : Nat) => return (d,
+    ← spawn { cmd := "sh", args := #["-c", s!"read x; exit {d}"], stdin := .piped })
+  let mut pending := children.map (·.2)
+  let mut order : Array UInt32 := #[]
+  for d in [0, 2, 4] do
+    for (d', c) in children do
+      if d' == d then
+        c.stdin.putStrLn ""
+        c.stdin.flush
+    let (i, code) ← waitAny pending
+    order := order.push code
+    pending := pending.eraseIdx i
+  IO.println order
+  child.stdin.putStrLn ""
+  child.stdin.flush
+  IO.println (← child.wait)
@@ -0,0 +1,48 @@
+import Lean.Util.TestExtern
+
+instance : BEq FloatArray where
+  beq a b := a.data == b.data
+
+def bs : ByteArray := ⟨#[3, 1, 4, 1, 5, 9, 2, 6, 5, 3]⟩
+
+test_extern ByteArray.indexOf? bs 1
+test_extern ByteArray.indexOf? bs 1 2
+test_extern ByteArray.indexOf? bs 1 4
+test_extern ByteArray.indexOf? bs 3 1
+test_extern ByteArray.indexOf? bs 7
+test_extern ByteArray.indexOf? bs 3 100
+test_extern ByteArray.indexOf? ByteArray.empty 0
+
+test_extern ByteArray.beq bs bs
+test_extern ByteArray.beq bs (bs.push 0)
+test_extern ByteArray.beq bs (bs.set! 9 4)
+test_extern ByteArray.beq ByteArray.empty ByteArray.empty
+
+test_extern ByteArray.compare bs bs
+test_extern ByteArray.compare bs (bs.push 0)
+test_extern ByteArray.compare (bs.push 0) bs
+test_extern ByteArray.compare bs (bs.set! 3 0)
+test_extern ByteArray.compare bs (bs.set! 3 200)
+test_extern ByteArray.compare ByteArray.empty bs
+
+test_extern ByteArray.fill bs 7
+test_extern ByteArray.fill bs 7 2 5
+test_extern ByteArray.fill bs 7 5 2
+test_extern ByteArray.fill bs 7 8 100
+test_extern ByteArray.fill bs 7 100 200
+
+def fs : FloatArray := ⟨#[1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19]⟩
+def gs : FloatArray := ⟨#[2, 0, 1, 5, 3, 8, 4, 4, 2, 1, 9, 6, 7, 0, 3, 2, 1, 6]⟩
+
+test_extern FloatArray.sum fs
+test_extern FloatArray.sum FloatArray.empty
+test_extern FloatArray.dot fs gs
+test_extern FloatArray.dot gs fs
+test_extern FloatArray.add fs gs
+test_extern FloatArray.add gs fs
+test_extern FloatArray.mul fs gs
+test_extern FloatArray.fill fs 0.5 3 9
+test_extern FloatArray.fill fs 0.5
+
+-- in-place update of an unshared array
+#eval (((List.replicate 20 1.0).toFloatArray.add fs).mul fs).sum
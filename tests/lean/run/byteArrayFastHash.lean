@@ -0,0 +1,65 @@
+import Lean.Data.HashSet
+
+/-! Sanity checks for `ByteArray.fastHash`: determinism, no collisions on structured inputs, and avalanche. -/
+
+def mkBytes (n : Nat) (seed : UInt32) : ByteArray := Id.run do
+  let mut s := seed
+  let mut r := ByteArray.mkEmpty n
+  for _ in [0:n] do
+    s := s * 1664525 + 1013904223
+    r := r.push (s >>> 24).toUInt8
+  return r
+
+def flipBit (a : ByteArray) (i : Nat) : ByteArray :=
+  a.set! (i / 8) (a.get! (i / 8) ^^^ ((1 : UInt8) <<< (i % 8).toUInt8))
+
+def popCount (x : UInt64) : Nat := Id.run do
+  let mut x := x
+  let mut n := 0
+  for _ in [0:64] do
+    n := n + (x &&& 1).toNat
+    x := x >>> 1
+  return n
+
+-- lengths around all internal code paths (short, 16/48-byte chunks, long striped input)
+def lengths : List Nat := [0, 1, 2, 3, 4, 7, 8, 9, 15, 16, 17, 31, 32, 33, 47, 48, 49, 64, 100, 255, 256, 257, 1023, 1024, 1025, 4096, 5000]
+
+#eval show IO Unit from do
+  for n in lengths do
+    let a := mkBytes n 42
+    -- the hash only depends on the contents, not on the capacity
+    unless a.fastHash == (ByteArray.empty ++ a).fastHash do
+      throw <| IO.userError s!"non-deterministic hash for length {n}"
+
+#eval show IO Unit from do
+  let mut seen : Lean.HashSet UInt64 := {}
+  let mut count := 0
+  -- decimal counters, like generated names
+  for i in [0:20000] do
+    seen := seen.insert (toString i).toUTF8.fastHash
+    count := count + 1
+  -- runs of zero bytes of different lengths
+  for n in [1:600] do
+    seen := seen.insert (ByteArray.mk (Array.mkArray n 0)).fastHash
+    count := count + 1
+  -- single bit flips of a long input
+  let a := mkBytes 3000 7
+  for i in [0:3000 * 8:5] do
+    seen := seen.insert (flipBit a i).fastHash
+    count := count + 1
+  unless seen.size == count do
+    throw <| IO.userError s!"{count - seen.size} collisions"
+
+#eval show IO Unit from do
+  for n in lengths do
+    if n > 0 then
+      let a := mkBytes n 3
+      let h := a.fastHash
+      let mut flipped := 0
+      let mut trials := 0
+      for i in [0:n * 8:(n / 8) + 1] do
+        flipped := flipped + popCount (h ^^^ (flipBit a i).fastHash)
+        trials := trials + 1
+      -- on average, about half of the output bits should change
+      unless 24 * trials ≤ flipped && flipped ≤ 40 * trials do
+        throw <| IO.userError s!"poor avalanche for length {n}: {flipped} bits in {trials} trials"
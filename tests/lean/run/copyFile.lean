@@ -0,0 +1,43 @@
+open IO.FS
+
+def check (b : Bool) (msg : String) : IO Unit :=
+  unless b do throw <| IO.userError msg
+
+def mkBytes (n : Nat) : ByteArray := Id.run do
+  let mut r := ByteArray.mkEmpty n
+  for i in [0:n] do
+    r := r.push (i * 7 + i / 256).toUInt8
+  return r
+
+#eval show IO Unit from do
+  let src : System.FilePath := "copyFile.src.tmp"
+  let dst : System.FilePath := "copyFile.dst.tmp"
+  for n in [0, 1, 4096, 1000003] do
+    let content := mkBytes n
+    writeBinFile src content
+    check ((← readBinFile src) == content) s!"readBinFile {n}"
+    -- overwrite a longer existing file
+    writeBinFile dst (mkBytes (n + 10))
+    copyFile src dst
+    check ((← readBinFile dst) == content) s!"copyFile {n}"
+  removeFile src
+  removeFile dst
+  match (← (copyFile src dst).toBaseIO) with
+  | .error (.noFileOrDirectory ..) => pure ()
+  | _ => throw <| IO.userError "copyFile of missing file"
+  match (← (readBinFile src).toBaseIO) with
+  | .error (.noFileOrDirectory ..) => pure ()
+  | _ => throw <| IO.userError "readBinFile of missing file"
+  -- procfs files report a size of 0, so the in-kernel copy has to fall back to reading them
+  if !System.Platform.isWindows && !System.Platform.isOSX then
+    copyFile "/proc/self/status" dst
+    check (!(← readBinFile dst).isEmpty) "copyFile from procfs"
+    removeFile dst
+  -- copying a file onto itself must not truncate it
+  let content := mkBytes 4096
+  writeBinFile src content
+  match (← (copyFile src src).toBaseIO) with
+  | .error _ => pure ()
+  | .ok _ => throw <| IO.userError "copyFile onto itself succeeded"
+  check ((← readBinFile src) == content) "copyFile onto itself"
+  removeFile src
@@ -0,0 +1,67 @@
+/-! Compiling several files from one `lean --daemon` process, which caches their imports. -/
+
+def dir : System.FilePath := "daemon.tmp"
+
+def lean (args : Array String) (stdin := "") : IO IO.Process.Output := do
+  let child ← IO.Process.spawn {
+    cmd := (← IO.appPath).toString
+    args
+    env := #[("LEAN_PATH", some dir.toString)]
+    stdin := .piped
+    stdout := .piped
+    stderr := .piped
+  }
+  let child ← do
+    let (input, child) ← child.takeStdin
+    input.putStr stdin
+    input.flush
+    pure child
+  let stderr ← IO.asTask child.stderr.readToEnd .dedicated
+  let stdout ← child.stdout.readToEnd
+  let exitCode ← child.wait
+  let stderr ← IO.ofExcept stderr.get
+  return { exitCode, stdout, stderr }
+
+def contains (s pat : String) : Bool :=
+  (s.splitOn pat).length > 1
+
+#eval show IO Unit from do
+  IO.FS.createDirAll dir
+  IO.FS.writeFile (dir / "A.lean") "def greeting : String := \"hello daemon\"\n"
+  IO.FS.writeFile (dir / "B.lean") "import A\ndef b : String := greeting ++ \" b\"\n"
+  IO.FS.writeFile (dir / "C.lean") "import A\ndef main : IO Unit := IO.println greeting\n"
+  IO.FS.writeFile (dir / "Bad.lean") "import A\ndef bad : Nat := greeting\n"
+  let out ← lean #["--root=" ++ dir.toString, "-o", (dir / "A.olean").toString, (dir / "A.lean").toString]
+  unless out.exitCode == 0 do
+    throw <| IO.userError s!"compiling A failed: {out.stdout}{out.stderr}"
+  let path (f : String) := (dir / f).toString
+  -- `B` and `C` share the import of `A`; empty fields between tabs are ignored
+  let requests := [
+    s!"{path "B.lean"}\t-o\t{path "B.olean"}\t\t-i\t{path "B.ilean"}\t-R\t{dir}",
+    s!"{path "C.lean"}\t-R\t{dir}\t-c\t{path "C.c"}",
+    s!"{path "Bad.lean"}\t-R\t{dir}\t-o\t{path "Bad.olean"}",
+    s!"{path "B.lean"}\t--unknown",
+    "",
+    s!"-o\t{path "D.olean"}"]
+  let out ← lean #["--daemon"] ("\n".intercalate requests ++ "\n")
+  unless out.exitCode == 0 do
+    throw <| IO.userError s!"daemon failed: {out.stdout}{out.stderr}"
+  let codes := out.stdout.splitOn "\n" |>.filter (·.startsWith "{\"exitCode\"")
+  unless codes == ["{\"exitCode\": 0}", "{\"exitCode\": 0}", "{\"exitCode\": 1}", "{\"exitCode\": 1}", "{\"exitCode\": 1}"] do
+    throw <| IO.userError s!"unexpected exit codes: {out.stdout}{out.stderr}"
+  for f in ["B.olean", "B.ilean", "C.c"] do
+    unless ← (dir / f).pathExists do
+      throw <| IO.userError s!"{f} was not written"
+  unless contains (← IO.FS.readFile (dir / "C.c")) "l_main" do
+    throw <| IO.userError "unexpected C code"
+  if ← (dir / "Bad.olean").pathExists then
+    throw <| IO.userError ".olean file of a failed request was written"
+  unless contains out.stderr "invalid daemon request argument '--unknown'" &&
+      contains out.stderr "Expected exactly one file name" do
+    throw <| IO.userError s!"unexpected error output: {out.stderr}"
+  -- the daemon's output is importable
+  IO.FS.writeFile (dir / "UseB.lean") "import B\n#eval b\n"
+  let out ← lean #[path "UseB.lean"]
+  unless out.exitCode == 0 && contains out.stdout "hello daemon b" do
+    throw <| IO.userError s!"importing B failed: {out.stdout}{out.stderr}"
+  IO.FS.removeDirAll dir
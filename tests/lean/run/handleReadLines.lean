@@ -0,0 +1,45 @@
+open IO.FS
+
+def check (b : Bool) (msg : String) : IO Unit :=
+  unless b do throw <| IO.userError msg
+
+partial def getLines (h : Handle) (acc : Array String := #[]) : IO (Array String) := do
+  let line ← h.getLine
+  if line.isEmpty then pure acc else getLines h (acc.push line)
+
+partial def readAllLines (h : Handle) (maxLines : USize) (acc : Array String := #[]) : IO (Array String) := do
+  let batch ← h.readLines maxLines
+  if batch.isEmpty then pure acc else readAllLines h maxLines (acc ++ batch)
+
+#eval show IO Unit from do
+  let path : System.FilePath := "handleReadLines.tmp"
+  let long := String.mk (List.replicate 5000 'x')
+  let content := s!"first\n\n{long}\nnul\x00inside\nlast"
+  writeFile path content
+  let expected := #["first", "", long, "nul\x00inside", "last"]
+  -- `getLine` keeps the terminators, also for lines that are longer than any initial buffer
+  let raw ← withFile path .read getLines
+  check (raw == #["first\n", "\n", long ++ "\n", "nul\x00inside\n", "last"]) "getLine"
+  for maxLines in [1, 2, 3, 1024] do
+    let ls ← withFile path .read (readAllLines · maxLines.toUSize)
+    check (ls == expected) s!"readLines {maxLines}"
+  check ((← lines path) == expected) "lines"
+  -- after EOF, further reads keep returning nothing
+  withFile path .read fun h => do
+    let _ ← h.readLines
+    check (← h.readLines).isEmpty "readLines after EOF"
+    check (← h.getLine).isEmpty "getLine after EOF"
+  -- `readLines` and `getLine` share the same stream position
+  withFile path .read fun h => do
+    check ((← h.readLines 1) == #["first"]) "readLines 1"
+    check ((← h.getLine) == "\n") "getLine after readLines"
+    check ((← h.readLines 1) == #[long]) "readLines after getLine"
+  removeFile path
+
+#eval show IO Unit from do
+  let path : System.FilePath := "handleReadLinesEmpty.tmp"
+  writeFile path ""
+  check (← lines path).isEmpty "lines of empty file"
+  writeFile path "\n"
+  check ((← lines path) == #[""]) "single empty line"
+  removeFile path
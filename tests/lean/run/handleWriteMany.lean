@@ -0,0 +1,57 @@
+open IO.FS
+
+def check (b : Bool) (msg : String) : IO Unit :=
+  unless b do throw <| IO.userError msg
+
+def chunks (n size : Nat) : Array ByteArray := Id.run do
+  let mut r := #[]
+  for i in [0:n] do
+    r := r.push (ByteArray.mk (Array.mkArray (size + i % 7) (i % 256).toUInt8))
+  return r
+
+def concat (bs : Array ByteArray) : ByteArray :=
+  bs.foldl (· ++ ·) .empty
+
+#eval show IO Unit from do
+  let path : System.FilePath := "handleWriteMany.tmp"
+  let small := chunks 10 3
+  -- large enough to bypass the handle's buffer, and more fragments than a single `writev` accepts
+  let large := chunks 3000 20
+  withFile path .write fun h => do
+    h.write "a".toUTF8
+    h.writeMany small
+    h.writeMany #[]
+    h.writeMany large
+    h.write "b".toUTF8
+    h.putStrMany #["x", "", "yz", "∀"]
+  let expected := "a".toUTF8 ++ concat small ++ concat large ++ "b".toUTF8 ++ "xyz∀".toUTF8
+  check ((← readBinFile path) == expected) "writeMany"
+  -- the handle position is kept in sync, so truncation after a vectored write works
+  withFile path .write fun h => do
+    h.writeMany large
+    h.writeMany large
+    h.rewind
+    h.writeMany large
+    h.truncate
+  check ((← readBinFile path) == concat large) "truncate after writeMany"
+  removeFile path
+
+#eval show IO Unit from do
+  let path : System.FilePath := "handleBufferSize.tmp"
+  for size in [0, 1, 100, 1024 * 1024] do
+    withFile path .write fun h => do
+      h.setBufferSize size.toUSize
+      h.putStr "hello "
+      h.putStrMany #["buffered ", "world"]
+    check ((← readFile path) == "hello buffered world") s!"setBufferSize {size}"
+  withFile path .read fun h => do
+    h.setBufferSize 1
+    check ((← h.getLine) == "hello buffered world") "read with small buffer"
+  -- the buffer can only be set before any other operation
+  withFile path .read fun h => do
+    discard <| h.getLine
+    check ((← (h.setBufferSize 4096).toBaseIO) matches .error _) "setBufferSize after reading"
+  withFile path .write fun h => do
+    h.setBufferSize 4096
+    check ((← (h.setBufferSize 4096).toBaseIO) matches .error _) "setBufferSize twice"
+  removeFile path
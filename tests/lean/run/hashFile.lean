@@ -0,0 +1,46 @@
+open IO.FS
+
+def check (b : Bool) (msg : String) : IO Unit :=
+  unless b do throw <| IO.userError msg
+
+def mkBytes (n : Nat) : ByteArray := Id.run do
+  let mut r := ByteArray.mkEmpty n
+  for i in [0:n] do
+    r := r.push (i * 13 + i / 97).toUInt8
+  return r
+
+def hex (a : ByteArray) : String :=
+  a.foldl (init := "") fun s b =>
+    let d := fun (n : UInt8) => "0123456789abcdef".get ⟨n.toNat⟩
+    (s.push (d (b / 16))).push (d (b % 16))
+
+#eval show IO Unit from do
+  let path : System.FilePath := "hashFile.tmp"
+  -- sizes around the 8-byte blocks of `hash` and the 1MiB read chunks
+  for n in [0, 1, 7, 8, 9, 1000, 1024 * 1024 - 1, 1024 * 1024, 1024 * 1024 + 9, 3000000] do
+    let content := mkBytes n
+    writeBinFile path content
+    check ((← hashFile path) == hash content) s!"hashFile {n}"
+    check ((← fastHashFile path) == content.fastHash) s!"fastHashFile {n}"
+  writeBinFile path .empty
+  check (hex (← sha256File path) == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855") "sha256 empty"
+  writeFile path "abc"
+  check (hex (← sha256File path) == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad") "sha256 abc"
+  writeFile path "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"
+  check (hex (← sha256File path) == "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1") "sha256 two blocks"
+  writeFile path (String.mk (List.replicate 1000000 'a'))
+  check (hex (← sha256File path) == "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0") "sha256 long"
+  removeFile path
+
+#eval show IO Unit from do
+  let paths := (List.range 40).toArray.map fun i => System.FilePath.mk s!"hashFiles{i}.tmp"
+  for i in [0:paths.size] do
+    writeBinFile paths[i]! (mkBytes (i * 1000))
+  let hs ← hashFiles paths hashFile (batchSize := 3)
+  check (hs == (← paths.mapM hashFile)) "hashFiles"
+  check ((← hashFiles #[] fastHashFile).isEmpty) "hashFiles empty"
+  for p in paths do
+    removeFile p
+  match (← (hashFile "hashFile.missing").toBaseIO) with
+  | .error (.noFileOrDirectory ..) => pure ()
+  | _ => throw <| IO.userError "hashFile of missing file"
@@ -0,0 +1,35 @@
+import Lean
+
+open Lean
+
+unsafe def sameEnv (env₁ env₂ : Environment) : Bool :=
+  ptrAddrUnsafe env₁ == ptrAddrUnsafe env₂
+
+#eval show IO Unit from do
+  setImportCacheLimits 2 0
+  let env₁ ← importModules #[{ module := `Init.Prelude }] {}
+  let env₂ ← importModules #[{ module := `Init.Prelude }] {}
+  unless unsafe sameEnv env₁ env₂ do
+    throw <| IO.userError "environment was not reused"
+  -- a different trust level is a different entry
+  let env₃ ← importModules #[{ module := `Init.Prelude }] {} (trustLevel := 1)
+  if unsafe sameEnv env₁ env₃ then
+    throw <| IO.userError "unexpected environment"
+  -- `Init.Prelude` is read from the module cache, and the least recently used entry is evicted
+  let env₄ ← importModules #[{ module := `Init.Core }] {}
+  unless (env₄.find? ``Nat.add).isSome do
+    throw <| IO.userError "unexpected constants"
+  let cache ← importCacheRef.get
+  unless cache.entries.map (·.trustLevel) == #[1, 0] && cache.entries[1]!.imports == #[{ module := `Init.Core }] do
+    throw <| IO.userError "unexpected cache entries"
+  -- the mapped regions count towards the memory limit and are not freed with an environment
+  unless cache.regionBytes > 0 && env₄.header.regions.all cache.regions.contains do
+    throw <| IO.userError "regions not accounted"
+  env₄.freeRegions
+  unless (env₄.find? ``Nat.add).isSome do
+    throw <| IO.userError "cached region was freed"
+  setImportCacheLimits 0 0
+  unless (← importCacheRef.get).entries.isEmpty do
+    throw <| IO.userError "cache not cleared"
+  unless (← importCacheRef.get).regionBytes == cache.regionBytes do
+    throw <| IO.userError "regions forgotten"
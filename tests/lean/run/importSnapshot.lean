@@ -0,0 +1,37 @@
+import Lean
+
+open Lean
+
+#eval show IO Unit from do
+  let imports : Array Import := #[{ module := `Init.Core }]
+  let (_, s) ← importModulesCore imports |>.run
+  let (const2ModIdx, constantMap) ← mkImportedConstantMaps s
+  let dir : System.FilePath := "importSnapshot.tmp"
+  writeImportSnapshot dir imports s const2ModIdx constantMap
+  let some (snap, _) ← readImportSnapshot? dir imports
+    | throw <| IO.userError "snapshot not found"
+  unless snap.moduleNames == s.moduleNames && snap.moduleData.size == s.moduleData.size do
+    throw <| IO.userError "unexpected modules"
+  unless snap.constantMap.size == constantMap.size && snap.const2ModIdx.size == const2ModIdx.size do
+    throw <| IO.userError "unexpected constant maps"
+  unless (snap.constantMap.find? ``Nat.add).isSome && snap.const2ModIdx.find? ``Nat.add == const2ModIdx.find? ``Nat.add do
+    throw <| IO.userError "unexpected constant"
+  -- snapshots are specific to the import set
+  if (← readImportSnapshot? dir #[{ module := `Init.Prelude }]).isSome then
+    throw <| IO.userError "unexpected snapshot"
+  -- a snapshot is stale once the modification time of one of its .olean files changes
+  let fname := importSnapshotPath dir imports
+  let mtimes := snap.oleanMTimes.modify 0 fun t => { t with sec := t.sec + 1 }
+  saveImportSnapshot fname { snap with oleanMTimes := mtimes }
+  if (← readImportSnapshot? dir imports).isSome then
+    throw <| IO.userError "stale snapshot was used"
+  -- and is replaced by the next import
+  writeImportSnapshot dir imports s const2ModIdx constantMap
+  let some (snap', _) ← readImportSnapshot? dir imports
+    | throw <| IO.userError "snapshot not rewritten"
+  unless snap'.oleanMTimes == snap.oleanMTimes do
+    throw <| IO.userError "unexpected modification times"
+  -- no temporary files are left behind
+  unless (← dir.readDir).size == 1 do
+    throw <| IO.userError "unexpected files"
+  IO.FS.removeDirAll dir
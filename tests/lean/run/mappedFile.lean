@@ -0,0 +1,39 @@
+open IO.FS
+
+def check (b : Bool) (msg : String) : IO Unit :=
+  unless b do throw <| IO.userError msg
+
+#eval show IO Unit from do
+  let path : System.FilePath := "mappedFile.tmp"
+  let content := "hello\nmapped\nworld".toUTF8
+  writeBinFile path content
+  let m ← MappedFile.mk path
+  check (m.size == content.size) "size"
+  check (m.get! 0 == 'h'.toNat.toUInt8) "get!"
+  check (m.get! 1000 == 0) "get! out of bounds"
+  check (m.toByteArray == content) "toByteArray"
+  check (m.extract 6 12 == "mapped".toUTF8) "extract"
+  check (m.extract 12 6 == .empty) "extract empty"
+  check (m.extract 13 1000 == "world".toUTF8) "extract clamped"
+  check (m.indexOf? 10 == some 5) "indexOf?"
+  check (m.indexOf? 10 6 == some 12) "indexOf? with start"
+  check (m.indexOf? 10 13 == none) "indexOf? none"
+  m.advise .sequential
+  m.advise .willNeed 6 12
+  -- the mapping stays valid after the file is removed
+  removeFile path
+  check (m.extract 0 5 == "hello".toUTF8) "extract after removal"
+
+#eval show IO Unit from do
+  let path : System.FilePath := "mappedFileEmpty.tmp"
+  writeBinFile path .empty
+  let m ← MappedFile.mk path
+  check (m.size == 0) "empty size"
+  check (m.indexOf? 0 == none) "empty indexOf?"
+  removeFile path
+
+#eval show IO Unit from do
+  match ← (MappedFile.mk "mappedFileDoesNotExist.tmp").toBaseIO with
+  | .ok _ => throw <| IO.userError "expected an error"
+  | .error (.noFileOrDirectory ..) => pure ()
+  | .error e => throw e
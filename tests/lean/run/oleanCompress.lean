@@ -0,0 +1,83 @@
+import Lean
+
+open Lean
+
+/-! Compressed .olean files (`LEAN_OLEAN_COMPRESS`) and the LZ4 block codec they use. -/
+
+def roundTrip (data : ByteArray) : IO Unit := do
+  let block := Internal.lz4CompressBlock data
+  unless Internal.lz4DecompressBlock block data.size.toUSize == some data do
+    throw <| IO.userError s!"round trip of {data.size} bytes failed"
+  if data.size > 0 && (Internal.lz4DecompressBlock block (data.size + 1).toUSize).isSome then
+    throw <| IO.userError "block of wrong size accepted"
+
+def pseudoRandomBytes (n : Nat) : ByteArray := Id.run do
+  let mut r := ByteArray.mkEmpty n
+  let mut s : UInt64 := 1
+  for _ in [0:n] do
+    s := s * 6364136223846793005 + 1442695040888963407
+    r := r.push (s >>> 56).toUInt8
+  return r
+
+#eval show IO Unit from do
+  -- inputs of at most 12 bytes are stored as literals only
+  for n in [0:14] do
+    roundTrip ⟨(List.range n).toArray.map (·.toUInt8)⟩
+    roundTrip ⟨Array.mkArray n 7⟩
+  -- incompressible data
+  let data := pseudoRandomBytes 100000
+  roundTrip data
+  unless (Internal.lz4CompressBlock data).size ≤ data.size + data.size / 255 + 16 do
+    throw <| IO.userError "compressed block exceeds bound"
+  -- repetitive data with matches longer than the 15-byte token limit
+  let data := (List.range 100000).toArray.map (fun i => (i % 1000 / 50).toUInt8)
+  roundTrip ⟨data⟩
+  unless (Internal.lz4CompressBlock ⟨data⟩).size < data.size / 10 do
+    throw <| IO.userError "data was not compressed"
+
+def dir : System.FilePath := "oleanCompress.tmp"
+
+def constValue (mod : ModuleData) (n : Name) : Option String := do
+  let some (.lit (.strVal v)) := mod.constants.find? (·.name == n) |>.bind (·.value?)
+    | none
+  return v
+
+#eval show IO Unit from do
+  IO.FS.createDirAll dir
+  let src := dir / "OleanCompressTest.lean"
+  let olean := dir / "OleanCompressTest.olean"
+  -- large enough to be split into multiple blocks
+  let defs := (List.range 200).map fun i => s!"def s{i} : String := \"{"".pushn (Char.ofNat (97 + i % 26)) 2000}\""
+  IO.FS.writeFile src ("\n".intercalate defs)
+  let out ← IO.Process.output {
+    cmd := (← IO.appPath).toString
+    args := #["--root=" ++ dir.toString, "-o", olean.toString, src.toString]
+    env := #[("LEAN_OLEAN_COMPRESS", some "1")]
+  }
+  unless out.exitCode == 0 do
+    throw <| IO.userError s!"compilation failed: {out.stdout}{out.stderr}"
+  -- `block_size` field of the header
+  let bytes ← IO.FS.readBinFile olean
+  unless (List.range 8).any fun i => bytes.get! (72 + i) != 0 do
+    throw <| IO.userError "file is not compressed"
+  let expected := "".pushn 'h' 2000
+  -- decompressed into an anonymous mapping at the base address of the file
+  let (mod₁, region₁) ← readModuleData olean
+  unless region₁.isMemoryMapped do
+    throw <| IO.userError "compressed file was not mapped at its base address"
+  unless constValue mod₁ `s7 == some expected do
+    throw <| IO.userError "unexpected module data"
+  -- the base address is in use, so the file is decompressed into `malloc`ed memory and relocated
+  let (mod₂, region₂) ← readModuleData olean
+  if region₂.isMemoryMapped then
+    throw <| IO.userError "unexpected mapping"
+  unless constValue mod₂ `s7 == some expected && mod₂.constNames == mod₁.constNames do
+    throw <| IO.userError "unexpected relocated module data"
+  unsafe region₂.free
+  unsafe region₁.free
+  -- and imported like an uncompressed file
+  initSearchPath (← findSysroot) [dir]
+  let env ← importModules #[{ module := `OleanCompressTest }] {}
+  unless (env.find? `s7 |>.bind (·.value?)) == some (.lit (.strVal expected)) do
+    throw <| IO.userError "unexpected imported constant"
+  IO.FS.removeDirAll dir
@@ -0,0 +1,65 @@
+import Lean
+
+open Lean
+
+/-! Object pools shared between .olean files (`lean --olean-pool`, `LEAN_OLEAN_POOL`). -/
+
+def dir : System.FilePath := "oleanPool.tmp"
+
+def runLean (args : Array String) (pool : Option System.FilePath := none) : IO IO.Process.Output := do
+  IO.Process.output {
+    cmd := (← IO.appPath).toString
+    args
+    env := #[("LEAN_OLEAN_POOL", pool.map (·.toString)), ("LEAN_PATH", some dir.toString)]
+  }
+
+def compile (mod : String) (pool : Option System.FilePath := none) : IO Unit := do
+  let out ← runLean #["--root=" ++ dir.toString, "-o", (dir / s!"{mod}.olean").toString, (dir / s!"{mod}.lean").toString] pool
+  unless out.exitCode == 0 do
+    throw <| IO.userError s!"compiling {mod} failed: {out.stdout}{out.stderr}"
+
+def contains (s pat : String) : Bool :=
+  (s.splitOn pat).length > 1
+
+/-- Compile a module importing `A` and return its error output. -/
+def useA (pool : Option System.FilePath) : IO String := do
+  let out ← runLean #[(dir / "Use.lean").toString] pool
+  if out.exitCode == 0 then
+    unless out.stdout == "hello pool\n" do
+      throw <| IO.userError s!"unexpected output: {out.stdout}"
+  return out.stdout ++ out.stderr
+
+#eval show IO Unit from do
+  IO.FS.createDirAll dir
+  let shared := "theorem shared (xs : List Nat) : xs ++ [] = xs := List.append_nil xs\ndef sharedSum (xs : List Nat) : Nat := xs.foldl (· + ·) 0\n"
+  IO.FS.writeFile (dir / "A.lean") (shared ++ "def poolGreeting : String := \"hello pool\"\n")
+  IO.FS.writeFile (dir / "B.lean") shared
+  IO.FS.writeFile (dir / "C.lean") "def other : Nat := 1\ndef sharedSum (xs : List Nat) : Nat := xs.foldl (· + ·) 0\n"
+  IO.FS.writeFile (dir / "Use.lean") "import A\n#eval IO.println poolGreeting\n"
+  for mod in ["A", "B", "C"] do
+    compile mod
+  let pool := dir / "pool.opool"
+  let out ← runLean #[s!"--olean-pool={pool}", (dir / "A.olean").toString, (dir / "B.olean").toString]
+  unless out.exitCode == 0 do
+    throw <| IO.userError s!"writing the pool failed: {out.stdout}{out.stderr}"
+  -- rebuild `A` against the pool and import it
+  compile "A" pool
+  let err ← useA pool
+  unless err == "hello pool\n" do
+    throw <| IO.userError s!"importing failed: {err}"
+  -- reading `A` requires the pool
+  match (← (readModuleData (dir / "A.olean")).toBaseIO) with
+  | .ok _ => throw <| IO.userError "file referring to a pool was read without it"
+  | .error e => unless contains (toString e) "LEAN_OLEAN_POOL is not set" do throw e
+  let err ← useA (dir / "missing.opool")
+  unless contains err "failed to load object pool" do
+    throw <| IO.userError s!"unexpected error for a missing pool: {err}"
+  -- a pool of different modules has a different identifier
+  let otherPool := dir / "other.opool"
+  let out ← runLean #[s!"--olean-pool={otherPool}", (dir / "B.olean").toString, (dir / "C.olean").toString]
+  unless out.exitCode == 0 do
+    throw <| IO.userError s!"writing the pool failed: {out.stdout}{out.stderr}"
+  let err ← useA otherPool
+  unless contains err "it was written with a different object pool" do
+    throw <| IO.userError s!"unexpected error for a different pool: {err}"
+  IO.FS.removeDirAll dir
@@ -0,0 +1,80 @@
+import Lean
+
+open Lean
+
+/-! Size and composition statistics of .olean files (`lean --olean-stats`). -/
+
+def dir : System.FilePath := "oleanStats.tmp"
+
+def runLean (args : Array String) : IO IO.Process.Output := do
+  IO.Process.output {
+    cmd := (← IO.appPath).toString
+    args
+    env := #[("LEAN_PATH", some dir.toString)]
+  }
+
+def compile (mod : String) : IO Unit := do
+  let out ← runLean #["--root=" ++ dir.toString, "-o", (dir / s!"{mod}.olean").toString, (dir / s!"{mod}.lean").toString]
+  unless out.exitCode == 0 do
+    throw <| IO.userError s!"compiling {mod} failed: {out.stdout}{out.stderr}"
+
+def get (j : Json) (path : List String) : IO Json :=
+  path.foldlM (init := j) fun j k =>
+    IO.ofExcept <| j.getObjVal? k |>.mapError (s!"{k}: " ++ ·)
+
+def getNat (j : Json) (path : List String) : IO Nat := do
+  IO.ofExcept (← get j path).getNat?
+
+def getArr (j : Json) (path : List String) : IO (Array Json) := do
+  IO.ofExcept (← get j path).getArr?
+
+#eval show IO Unit from do
+  IO.FS.createDirAll dir
+  let shared := "def sharedString : String := \"a string stored in both files\"\n"
+  IO.FS.writeFile (dir / "A.lean") (shared ++ "def onlyA (n : Nat) : Nat := n + 1\n")
+  IO.FS.writeFile (dir / "B.lean") shared
+  for mod in ["A", "B"] do
+    compile mod
+  let out ← runLean #["--olean-stats", (dir / "A.olean").toString, (dir / "B.olean").toString]
+  unless out.exitCode == 0 do
+    throw <| IO.userError s!"--olean-stats failed: {out.stdout}{out.stderr}"
+  let stats ← IO.ofExcept <| Json.parse out.stdout
+  let files ← getArr stats ["files"]
+  unless files.size == 2 do
+    throw <| IO.userError s!"unexpected number of files: {files.size}"
+  let a := files[0]!
+  unless (← IO.ofExcept ((← get a ["file"]).getStr?)) == (dir / "A.olean").toString do
+    throw <| IO.userError "unexpected file name"
+  -- the kinds partition the objects of the file
+  let kinds ← get a ["kinds"]
+  let mut objects := 0
+  for k in ["ctor", "closure", "array", "structArray", "scalarArray", "string", "mpz", "thunk", "task", "ref",
+      "external", "reserved"] do
+    if let .ok k := kinds.getObjVal? k then
+      objects := objects + (← getNat k ["objects"])
+  unless objects == (← getNat a ["objects"]) && objects > 0 do
+    throw <| IO.userError s!"kinds do not add up: {objects}"
+  for k in ["ctor", "string"] do
+    discard <| getNat a ["kinds", k, "bytes"]
+  unless (← getNat a ["declarations", "count"]) ≥ 2 do
+    throw <| IO.userError "missing declarations"
+  let top ← getArr a ["declarations", "top"]
+  let names ← top.mapM fun d => IO.ofExcept (d.getObjValAs? String "name")
+  unless names.contains "sharedString" && names.contains "onlyA" do
+    throw <| IO.userError s!"unexpected declarations: {names}"
+  for d in top do
+    discard <| getNat d ["bytes"]
+  discard <| getArr a ["extensions"]
+  discard <| getNat a ["other", "bytes"]
+  -- the string literal is stored in both files
+  let dups ← get stats ["duplicateStrings"]
+  unless (← getNat dups ["count"]) ≥ 1 && (← getNat dups ["redundantBytes"]) > 0 do
+    throw <| IO.userError "missing duplicate strings"
+  let values ← (← getArr dups ["top"]).mapM fun d => IO.ofExcept (d.getObjValAs? String "value")
+  unless values.contains "a string stored in both files" do
+    throw <| IO.userError s!"unexpected duplicate strings: {values}"
+  -- invalid files are reported without writing partial output
+  let out ← runLean #["--olean-stats", (dir / "A.olean").toString, (dir / "A.lean").toString]
+  unless out.exitCode != 0 && out.stdout.isEmpty do
+    throw <| IO.userError s!"invalid file was accepted: {out.stdout}"
+  IO.FS.removeDirAll dir
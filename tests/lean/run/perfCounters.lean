@@ -0,0 +1,18 @@
+def busy (n : Nat) : Nat := Id.run do
+  let mut acc := 0
+  for i in [0:n] do
+    acc := acc + i * i % 7
+  return acc
+
+#eval show IO Unit from do
+  let (r, c) ← IO.withPerfCounters do
+    -- depend on IO input, so that the work can neither be hoisted out of the measured action nor done beforehand
+    let n := 1000000 + (← IO.monoMsNow) % 2
+    return busy n
+  unless r > 0 do throw <| IO.userError "busy"
+  unless c.taskClock > 0 do throw <| IO.userError "no CPU time recorded"
+  if c.hardware then
+    unless c.cycles > 0 && c.instructions > 0 do throw <| IO.userError s!"no hardware counts recorded: {repr c}"
+    unless c.ipc > 0 do throw <| IO.userError "ipc"
+  else
+    unless c.cycles == 0 && c.ipc == 0 do throw <| IO.userError "unavailable counters should be zero"
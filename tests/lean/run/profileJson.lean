@@ -0,0 +1,61 @@
+import Lean
+
+open Lean
+
+/-! Machine-readable profiling output (`lean --profile-json`). -/
+
+def dir : System.FilePath := "profileJson.tmp"
+
+def runLean (args : Array String) : IO IO.Process.Output := do
+  IO.Process.output { cmd := (← IO.appPath).toString, args }
+
+def get (j : Json) (path : List String) : IO Json :=
+  path.foldlM (init := j) fun j k =>
+    IO.ofExcept <| j.getObjVal? k |>.mapError (s!"{k}: " ++ ·)
+
+/-- Read a profile, check its shape, and return the categories and the pairs of declaration and category. -/
+def readProfile (file : System.FilePath) : IO (Array String × Array (String × String)) := do
+  let profile ← IO.ofExcept <| Json.parse (← IO.FS.readFile file)
+  let entry (e : Json) : IO Unit := do
+    for k in ["seconds", "heartbeats", "count"] do
+      discard <| get e [k]
+  let categories ← IO.ofExcept (← get profile ["categories"]).getArr?
+  let categories ← categories.mapM fun c => do
+    entry c
+    IO.ofExcept (c.getObjValAs? String "name")
+  let decls ← IO.ofExcept (← get profile ["declarations"]).getArr?
+  let decls ← decls.mapM fun d => do
+    entry d
+    return (← IO.ofExcept (d.getObjValAs? String "name"), ← IO.ofExcept (d.getObjValAs? String "category"))
+  unless (← IO.ofExcept (← get profile ["peakRss"]).getNat?) > 0 do
+    throw <| IO.userError s!"{file}: missing peak RSS"
+  discard <| get profile ["allocator", "pages"]
+  return (categories, decls)
+
+#eval show IO Unit from do
+  IO.FS.createDirAll dir
+  IO.FS.writeFile (dir / "A.lean") "def foo (n : Nat) : Nat := n + 1\ntheorem t : foo 1 = 2 := rfl\n"
+  let out ← runLean #[s!"--profile-json={dir / "a.json"}", (dir / "A.lean").toString]
+  unless out.exitCode == 0 && out.stdout.isEmpty do
+    throw <| IO.userError s!"compiling A failed: {out.stdout}{out.stderr}"
+  let (categories, decls) ← readProfile (dir / "a.json")
+  unless categories.contains "initialization" && categories.contains "elaboration" do
+    throw <| IO.userError s!"unexpected categories: {categories}"
+  unless decls.contains ("foo", "compilation") do
+    throw <| IO.userError s!"unexpected declarations: {decls}"
+  -- `--run` returns the exit code of `main`
+  IO.FS.writeFile (dir / "Main.lean") "def main : IO UInt32 := return 3\n"
+  let out ← runLean #[s!"--profile-json={dir / "run.json"}", "--run", (dir / "Main.lean").toString]
+  unless out.exitCode == 3 do
+    throw <| IO.userError s!"running Main failed: {out.stdout}{out.stderr}"
+  let (_, decls) ← readProfile (dir / "run.json")
+  unless decls.contains ("main", "interpretation") do
+    throw <| IO.userError s!"unexpected declarations: {decls}"
+  -- the profile is also written when an error ends the process
+  let out ← runLean #[s!"--profile-json={dir / "error.json"}", (dir / "Missing.lean").toString]
+  unless out.exitCode == 1 do
+    throw <| IO.userError s!"missing file was accepted: {out.stdout}"
+  let (categories, _) ← readProfile (dir / "error.json")
+  unless categories.contains "initialization" do
+    throw <| IO.userError s!"unexpected categories: {categories}"
+  IO.FS.removeDirAll dir
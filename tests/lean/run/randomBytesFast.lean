@@ -0,0 +1,24 @@
+import Lean.Data.HashSet
+
+def check (b : Bool) (msg : String) : IO Unit :=
+  unless b do throw <| IO.userError msg
+
+#eval show IO Unit from do
+  for n in [0, 1, 7, 100, 992, 993, 5000, 2000000] do
+    check ((← IO.getRandomBytesFast n.toUSize).size == n) s!"size {n}"
+    check ((← IO.getRandomBytes n.toUSize).size == n) s!"size {n}"
+
+#eval show IO Unit from do
+  let mut seen : Lean.HashSet UInt64 := {}
+  for _ in [0:10000] do
+    seen := seen.insert (← IO.randUInt64)
+  check (seen.size == 10000) "collisions"
+  -- roughly uniform bytes
+  let a ← IO.getRandomBytesFast 100000
+  let ones := a.foldl (fun n b => n + (b &&& 1).toNat) 0
+  check (45000 < ones && ones < 55000) s!"biased output: {ones}"
+  -- concurrent use from several threads
+  let ts ← (List.range 4).mapM fun _ => IO.asTask (IO.getRandomBytesFast 100000)
+  let rs ← ts.mapM fun t => IO.ofExcept t.get
+  check (rs.all (·.size == 100000)) "threads"
+  check (rs.head! != rs.getLast!) "threads produce different output"
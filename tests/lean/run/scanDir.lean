@@ -0,0 +1,41 @@
+open System IO.FS
+
+def check (b : Bool) (msg : String) : IO Unit :=
+  unless b do throw <| IO.userError msg
+
+def sorted (ps : Array FilePath) : Array String :=
+  (ps.map (·.toString)).qsort (· < ·)
+
+#eval show IO Unit from do
+  let root : FilePath := "scanDir.tmp"
+  if (← root.pathExists) then removeDirAll root
+  createDirAll (root / "a" / "b")
+  createDirAll (root / "c")
+  writeFile (root / "x.lean") "x"
+  writeFile (root / "a" / "y.olean") "yy"
+  writeFile (root / "a" / "b" / "z.lean") "zzz"
+  writeFile (root / "a" / ".lean") ""
+  let all ← root.scanDir
+  check (sorted (all.map (·.1)) == sorted (← root.walkDir)) "same entries as walkDir"
+  -- preorder: directories come before their contents
+  let paths := all.map (·.1.toString)
+  let idx (p : FilePath) := ((paths.indexOf? p.toString).map (·.val)).getD paths.size
+  check (idx (root / "a") < idx (root / "a" / "b") && idx (root / "a" / "b") < idx (root / "a" / "b" / "z.lean")) "preorder"
+  check (all.all fun (p, t) => (t == .dir) == (p.extension.isNone && p.fileName != some ".lean")) "types"
+  let top ← root.scanDir (recursive := false)
+  check (sorted (top.map (·.1)) == sorted #[root / "a", root / "c", root / "x.lean"]) "non-recursive"
+  let leans ← root.scanDir (extensions := #["lean"])
+  check (sorted (leans.map (·.1)) == sorted #[root / "x.lean", root / "a" / "b" / "z.lean"]) "extension filter"
+  let meta ← root.scanDirMetadata (extensions := #["lean", "olean"])
+  for (p, m) in meta do
+    check (m.byteSize == (← p.metadata).byteSize) s!"size of {p}"
+    check (m.modified == (← p.metadata).modified) s!"mtime of {p}"
+  check (meta.size == 3) "metadata entries"
+  let par ← root.scanDirMetadataPar (extensions := #["lean", "olean"])
+  check (sorted (par.map (·.1)) == sorted (meta.map (·.1))) "parallel"
+  let parAll ← root.scanDirMetadataPar
+  check (sorted (parAll.map (·.1)) == sorted (all.map (·.1))) "parallel without filter"
+  match (← (root / "missing").scanDir.toBaseIO) with
+  | .error (.noFileOrDirectory ..) => pure ()
+  | _ => throw <| IO.userError "missing directory"
+  removeDirAll root
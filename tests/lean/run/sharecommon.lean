@@ -145,3 +145,34 @@ check $ ptrAddrUnsafe a != ptrAddrUnsafe c
 pure ()
 
 #eval (tst6 2).run
+
+unsafe def tst7 : IO Unit := do
+let o := (mkFoo1 10 true, mkFoo2 10 true, mkFoo2 10 false)
+let a := (o, #[mkByteArray1 2, mkByteArray2 2, mkByteArray2 3], #["hello", "hel" ++ "lo"], [0, 1].map (· + 1))
+let ((o1, o2, o3), bs, ss, xs) := ShareCommon.shareCommon' a
+IO.println xs
+unless ptrAddrUnsafe o1 == ptrAddrUnsafe o2 && ptrAddrUnsafe o1 != ptrAddrUnsafe o3 do
+  throw $ IO.userError "ctor check failed"
+unless ptrAddrUnsafe bs[0]! == ptrAddrUnsafe bs[1]! && ptrAddrUnsafe bs[0]! != ptrAddrUnsafe bs[2]! do
+  throw $ IO.userError "byte array check failed"
+unless ptrAddrUnsafe ss[0]! == ptrAddrUnsafe ss[1]! do
+  throw $ IO.userError "string check failed"
+-- objects whose children are already maximally shared are reused
+let b := ShareCommon.shareCommon' bs
+unless ptrAddrUnsafe b == ptrAddrUnsafe bs do
+  throw $ IO.userError "reuse check failed"
+
+#eval tst7
+
+unsafe def tst8 : IO Unit := do
+let a := (List.range 200).toArray.map fun i => ((i % 3, toString (i % 3)), [mkByteArray1 (i % 2)])
+let b := ShareCommon.shareCommonPar a 4
+unless b.size == 200 && b.toList.map (·.1.1) == (List.range 200).map (· % 3) do
+  throw $ IO.userError "value check failed"
+for i in [0:200] do
+  unless ptrAddrUnsafe b[i]! == ptrAddrUnsafe b[i % 6]! do
+    throw $ IO.userError "sharing check failed"
+unless ptrAddrUnsafe b[0]! != ptrAddrUnsafe b[1]! do
+  throw $ IO.userError "distinct check failed"
+
+#eval tst8